@@ -0,0 +1,486 @@
+#include "batch.h"
+#include "maskedblur.h"
+#include "utils.h"
+#include "FreeImage.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace batch
+{
+  namespace
+  {
+    typedef std::chrono::steady_clock batch_clock;
+
+    double seconds(batch_clock::time_point from)
+    {
+      return std::chrono::duration<double>(batch_clock::now() - from).count();
+    }
+
+    bool hasExtension(const std::string& path, const char *ext)
+    {
+      const size_t n = strlen(ext);
+      if (path.size() < n)
+        return false;
+
+      for (size_t i = 0; i < n; i++)
+        if (tolower((unsigned char)path[path.size() - n + i]) != ext[i])
+          return false;
+      return true;
+    }
+
+    // image rows top first, 8-bit RGBA
+    class source
+    {
+    public:
+      virtual ~source() {}
+      virtual bool read(size_t rows, unsigned char *rgba) = 0; // the next rows
+
+      size_t _width  = 0;
+      size_t _height = 0;
+    };
+
+    class sink
+    {
+    public:
+      virtual ~sink() {}
+      virtual bool write(size_t rows, const unsigned char *rgba) = 0; // the next rows
+      virtual bool finish() {return true;}
+    };
+
+    // binary PPM (P6) or PAM (P7, RGB or RGB_ALPHA), 8 bits per channel
+    class pnm_source : public source
+    {
+    public:
+      bool open(const std::string& path)
+      {
+        _in.open(path, std::ios::binary);
+        if (!_in)
+          return false;
+
+        size_t maxval = 0;
+        const std::string magic = token();
+        if (magic == "P6")
+        {
+          _width    = number();
+          _height   = number();
+          maxval    = number();
+          _channels = 3;
+        }
+        else if (magic == "P7")
+        {
+          for (std::string key = token(); _in && key != "ENDHDR"; key = token())
+            if      (key == "WIDTH")    _width    = number();
+            else if (key == "HEIGHT")   _height   = number();
+            else if (key == "DEPTH")    _channels = number();
+            else if (key == "MAXVAL")   maxval    = number();
+            else if (key == "TUPLTYPE") token();
+        }
+        else
+          return false;
+
+        _in.get(); // the one whitespace before the pixels
+        return _in.good() && maxval == 255 && _width > 0 && _height > 0 && (_channels == 3 || _channels == 4);
+      }
+
+      bool read(size_t rows, unsigned char *rgba) override
+      {
+        const size_t count = rows * _width;
+        if (_channels == 4)
+          return bool(_in.read((char*)rgba, count * 4));
+
+        _buffer.resize(count * 3);
+        if (!_in.read((char*)_buffer.data(), _buffer.size()))
+          return false;
+
+        for (size_t i = 0; i < count; i++)
+        {
+          memcpy(rgba + 4 * i, &_buffer[3 * i], 3);
+          rgba[4 * i + 3] = 255;
+        }
+        return true;
+      }
+
+    private:
+      std::string token() // skips whitespace and # comments
+      {
+        std::string t;
+        for (int c = _in.get(); c != EOF; c = _in.get())
+        {
+          if (c == '#' && t.empty())
+            while (c != EOF && c != '\n')
+              c = _in.get();
+          else if (isspace(c))
+          {
+            if (!t.empty())
+            {
+              _in.unget();
+              break;
+            }
+          }
+          else
+            t += char(c);
+        }
+        return t;
+      }
+
+      size_t number() {return size_t(std::strtoul(token().c_str(), nullptr, 10));}
+
+      std::ifstream              _in;
+      size_t                     _channels = 0;
+      std::vector<unsigned char> _buffer;
+    };
+
+    class pnm_sink : public sink
+    {
+    public:
+      bool open(const std::string& path, size_t w, size_t h, bool alpha)
+      {
+        _out.open(path, std::ios::binary);
+        _width = w;
+        _alpha = alpha;
+        if (alpha)
+          _out << "P7\nWIDTH " << w << "\nHEIGHT " << h << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+        else
+          _out << "P6\n" << w << " " << h << "\n255\n";
+        return _out.good();
+      }
+
+      bool write(size_t rows, const unsigned char *rgba) override
+      {
+        const size_t count = rows * _width;
+        if (_alpha)
+          return bool(_out.write((const char*)rgba, count * 4));
+
+        _buffer.resize(count * 3);
+        for (size_t i = 0; i < count; i++)
+          memcpy(&_buffer[3 * i], rgba + 4 * i, 3);
+        return bool(_out.write((const char*)_buffer.data(), _buffer.size()));
+      }
+
+      bool finish() override
+      {
+        _out.close();
+        return !_out.fail();
+      }
+
+    private:
+      std::ofstream              _out;
+      size_t                     _width = 0;
+      bool                       _alpha = false;
+      std::vector<unsigned char> _buffer;
+    };
+
+    // anything FreeImage reads; the whole image is decoded up front
+    class image_source : public source
+    {
+    public:
+      ~image_source() override
+      {
+        if (_bitmap)
+          FreeImage_Unload(_bitmap);
+      }
+
+      bool open(const std::string& path)
+      {
+        FREE_IMAGE_FORMAT format = FreeImage_GetFileType(path.c_str(), 0);
+        if (format == FIF_UNKNOWN)
+          format = FreeImage_GetFIFFromFilename(path.c_str());
+        if (format == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(format))
+          return false;
+
+        FIBITMAP *bitmap = FreeImage_Load(format, path.c_str());
+        if (!bitmap)
+          return false;
+
+        _bitmap = FreeImage_ConvertTo32Bits(bitmap);
+        FreeImage_Unload(bitmap);
+        if (!_bitmap)
+          return false;
+
+        _width  = FreeImage_GetWidth(_bitmap);
+        _height = FreeImage_GetHeight(_bitmap);
+        return true;
+      }
+
+      bool read(size_t rows, unsigned char *rgba) override
+      {
+        for (size_t r = 0; r < rows; r++, _next++)
+        {
+          const BYTE *line = FreeImage_GetScanLine(_bitmap, int(_height - 1 - _next)); // bottom-up
+          unsigned char *out = rgba + 4 * _width * r;
+          for (size_t x = 0; x < _width; x++, line += 4, out += 4)
+          {
+            out[0] = line[FI_RGBA_RED];
+            out[1] = line[FI_RGBA_GREEN];
+            out[2] = line[FI_RGBA_BLUE];
+            out[3] = line[FI_RGBA_ALPHA];
+          }
+        }
+        return true;
+      }
+
+    private:
+      FIBITMAP *_bitmap = nullptr;
+      size_t    _next   = 0;
+    };
+
+    // anything FreeImage writes; rows are collected and the image is saved by finish()
+    class image_sink : public sink
+    {
+    public:
+      ~image_sink() override
+      {
+        if (_bitmap)
+          FreeImage_Unload(_bitmap);
+      }
+
+      bool open(const std::string& path, size_t w, size_t h)
+      {
+        _path   = path;
+        _format = FreeImage_GetFIFFromFilename(path.c_str());
+        if (_format == FIF_UNKNOWN || !FreeImage_FIFSupportsWriting(_format))
+          return false;
+
+        _bitmap = FreeImage_Allocate(int(w), int(h), 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+        _width  = w;
+        _height = h;
+        return _bitmap != nullptr;
+      }
+
+      bool write(size_t rows, const unsigned char *rgba) override
+      {
+        for (size_t r = 0; r < rows; r++, _next++)
+        {
+          BYTE *line = FreeImage_GetScanLine(_bitmap, int(_height - 1 - _next));
+          const unsigned char *in = rgba + 4 * _width * r;
+          for (size_t x = 0; x < _width; x++, line += 4, in += 4)
+          {
+            line[FI_RGBA_RED]   = in[0];
+            line[FI_RGBA_GREEN] = in[1];
+            line[FI_RGBA_BLUE]  = in[2];
+            line[FI_RGBA_ALPHA] = in[3];
+          }
+        }
+        return true;
+      }
+
+      bool finish() override
+      {
+        // formats without alpha (jpg) need 24 bits
+        FIBITMAP *out = FreeImage_FIFSupportsExportBPP(_format, 32) ? _bitmap : FreeImage_ConvertTo24Bits(_bitmap);
+        const bool saved = out && FreeImage_Save(_format, out, _path.c_str()) == TRUE;
+        if (out && out != _bitmap)
+          FreeImage_Unload(out);
+        return saved;
+      }
+
+    private:
+      std::string       _path;
+      FREE_IMAGE_FORMAT _format = FIF_UNKNOWN;
+      FIBITMAP         *_bitmap = nullptr;
+      size_t            _width = 0, _height = 0, _next = 0;
+    };
+
+    bool streamed(const std::string& path)
+    {
+      return hasExtension(path, ".ppm") || hasExtension(path, ".pam");
+    }
+
+    std::unique_ptr<source> openSource(const std::string& path)
+    {
+      if (streamed(path))
+      {
+        std::unique_ptr<pnm_source> s(new pnm_source);
+        if (s->open(path))
+          return s;
+        return nullptr;
+      }
+
+      std::unique_ptr<image_source> s(new image_source);
+      if (s->open(path))
+        return s;
+      return nullptr;
+    }
+
+    std::unique_ptr<sink> openSink(const std::string& path, size_t w, size_t h)
+    {
+      if (streamed(path))
+      {
+        std::unique_ptr<pnm_sink> s(new pnm_sink);
+        if (s->open(path, w, h, hasExtension(path, ".pam")))
+          return s;
+        return nullptr;
+      }
+
+      std::unique_ptr<image_sink> s(new image_sink);
+      if (s->open(path, w, h))
+        return s;
+      return nullptr;
+    }
+  }
+
+  void usage()
+  {
+    std::cerr << "usage: Blurred -batch <input> <output> [options]\n"
+                 "  .ppm/.pam (binary) are streamed in strips, other formats are loaded whole by FreeImage\n"
+                 "  -mask smooth|edge|peak\n"
+                 "  -strip N           rows per strip (256)\n"
+                 "  -threads N         blur threads (0: all cores)\n";
+  }
+
+  bool parse(int argc, char **argv, options& o)
+  {
+    if (argc < 2)
+      return false;
+
+    o._input  = argv[0];
+    o._output = argv[1];
+
+    for (int i = 2; i < argc; i++)
+    {
+      const std::string name = argv[i];
+      if (i + 1 >= argc)
+      {
+        std::cerr << "missing value for " << name << "\n";
+        return false;
+      }
+      const char *value = argv[++i];
+
+      bool ok = true;
+      if (name == "-strip")
+        ok = (o._strip = size_t(std::atoi(value))) > 0;
+      else if (name == "-threads")
+        o._threads = size_t(std::max(std::atoi(value), 0));
+      else if (name == "-mask")
+      {
+        if      (strcmp(value, "smooth") == 0) o._mask = mask::SMOOTH;
+        else if (strcmp(value, "edge")   == 0) o._mask = mask::EDGE;
+        else if (strcmp(value, "peak")   == 0) o._mask = mask::PEAK_AT_CENTER;
+        else ok = false;
+      }
+      else
+      {
+        std::cerr << "unknown option " << name << "\n";
+        return false;
+      }
+
+      if (!ok)
+      {
+        std::cerr << "bad value for " << name << ": " << value << "\n";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int run(const options& o)
+  {
+    const batch_clock::time_point start = batch_clock::now();
+
+    std::unique_ptr<source> in = openSource(o._input);
+    if (!in)
+    {
+      std::cerr << o._input.c_str() << ": unable to read image\n";
+      return -1;
+    }
+    const double tOpen = seconds(start);
+
+    const size_t w = in->_width, h = in->_height;
+    std::unique_ptr<sink> out = openSink(o._output, w, h);
+    if (!out)
+    {
+      std::cerr << o._output.c_str() << ": unable to write image\n";
+      return -1;
+    }
+
+    // the blur is horizontal, so strips need no halo rows; the masks only vary horizontally,
+    // so one strip of mask rows serves every strip
+    const size_t strip = std::min(o._strip, h);
+    std::vector<unsigned char> strips[2], blurred(w * strip * 4), maskRows(w * strip);
+    strips[0].resize(w * strip * 4);
+    strips[1].resize(w * strip * 4);
+    mask::build(o._mask, w, strip, maskRows.data());
+
+    const blur::MaskedBlur engine(blur::MaskedBlur::supported(), o._threads);
+
+    double tRead = 0., tBlur = 0., tWrite = 0.;
+    batch_clock::time_point t = batch_clock::now();
+    bool ok = in->read(strip, strips[0].data());
+    tRead += seconds(t);
+
+    for (size_t y = 0, s = 0; ok && y < h; y += strip, s++)
+    {
+      const size_t rows = std::min(strip, h - y);
+      const size_t nextRows = std::min(strip, h - std::min(h, y + strip));
+
+      // the next strip is read while this one is blurred and written
+      std::future<bool> next;
+      if (nextRows > 0)
+      {
+        source *src = in.get();
+        unsigned char *buffer = strips[(s + 1) % 2].data();
+        next = std::async(std::launch::async, [src, nextRows, buffer]() {return src->read(nextRows, buffer);});
+      }
+
+      t = batch_clock::now();
+      engine.apply(strips[s % 2].data(), w, rows, maskRows.data(), blurred.data());
+      tBlur += seconds(t);
+
+      t = batch_clock::now();
+      ok = out->write(rows, blurred.data());
+      tWrite += seconds(t);
+
+      if (next.valid())
+      {
+        t = batch_clock::now();
+        ok = next.get() && ok;
+        tRead += seconds(t); // only the part not hidden behind the blur
+      }
+    }
+
+    t = batch_clock::now();
+    ok = ok && out->finish();
+    tWrite += seconds(t);
+
+    if (!ok)
+    {
+      std::cerr << "batch blur of " << o._input.c_str() << " to " << o._output.c_str() << " failed\n";
+      return -1;
+    }
+
+    const double total = seconds(start);
+    const double mpix  = double(w) * h / 1e6;
+    const size_t stripBytes = strips[0].size() * 3 + maskRows.size();
+    std::cout << o._input.c_str() << " -> " << o._output.c_str() << ": " << w << "x" << h << ", "
+              << (h + strip - 1) / strip << " strips of " << strip << " rows, " << engine.GetThreads() << " threads"
+              << (streamed(o._input) && streamed(o._output) ? "" : " (whole image through FreeImage)") << "\n"
+              << "  open  " << tOpen  * 1000. << " ms\n"
+              << "  read  " << tRead  * 1000. << " ms waiting\n"
+              << "  blur  " << tBlur  * 1000. << " ms, " << mpix / tBlur << " Mpix/s\n"
+              << "  write " << tWrite * 1000. << " ms\n"
+              << "  total " << total  * 1000. << " ms, " << mpix / total << " Mpix/s\n"
+              << "  memory: strip buffers " << stripBytes / (1024 * 1024) << " MB, image "
+              << size_t(w * h * 4 / (1024 * 1024)) << " MB, peak resident " << utils::peakMemory() / (1024 * 1024) << " MB\n";
+    return 0;
+  }
+
+  int run(int argc, char **argv)
+  {
+    options o;
+    if (!parse(argc, argv, o))
+    {
+      usage();
+      return -1;
+    }
+    return run(o);
+  }
+}
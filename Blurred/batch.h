@@ -0,0 +1,32 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "mask.h"
+#include <string>
+
+// masked blur of still images of any size, started as "Blurred -batch <input> <output> [options]":
+// the image goes through blur::MaskedBlur in horizontal strips, reading the next strip while the
+// current one is blurred and writing each one as soon as it is done.
+// Binary PPM/PAM (.ppm, .pam) are streamed, so memory is bounded by the strip size; other formats
+// go through FreeImage, which decodes and encodes whole images
+
+namespace batch
+{
+  struct options
+  {
+    std::string _input;
+    std::string _output;
+    mask::type  _mask    = mask::SMOOTH;
+    size_t      _strip   = 256; // rows per strip
+    size_t      _threads = 0;   // 0: hardware_concurrency
+  };
+
+  // false and a message on std::cerr for unknown or malformed options
+  bool parse(int argc, char **argv, options& o);
+  void usage();
+
+  int run(const options& o);
+  int run(int argc, char **argv); // parse + run
+}
+
+#endif
@@ -0,0 +1,1228 @@
+#include "bench.h"
+#include "utils.h"
+#include "mesh.h"
+#include "blur.h"
+#include "mask.h"
+#include "scene.h"
+#include "headless.h"
+#include "texture.h"
+#include "maskedblur.h"
+#include "cull.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench
+{
+  namespace
+  {
+    typedef std::chrono::steady_clock bench_clock;
+
+    double seconds(bench_clock::time_point from)
+    {
+      return std::chrono::duration<double>(bench_clock::now() - from).count();
+    }
+
+    int intArg(int argc, char **argv, int ind, int def)
+    {
+      return argc > ind ? std::atoi(argv[ind]) : def;
+    }
+
+    const char* strArg(int argc, char **argv, int ind, const char *def)
+    {
+      return argc > ind ? argv[ind] : def;
+    }
+
+    template<typename T>
+    bool sameBits(const std::vector<T>& a, const std::vector<T>& b)
+    {
+      return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), sizeof(T) * a.size()) == 0);
+    }
+  }
+
+  int run(int argc, char **argv)
+  {
+    const std::string name = argc > 0 ? argv[0] : "";
+
+    if (name == "obj")
+      return loadOBJ(strArg(argc, argv, 1, "obj.obj"), intArg(argc, argv, 2, 10));
+
+    if (name == "vcache")
+      return vertexCache(strArg(argc, argv, 1, "obj.obj"));
+
+    if (name == "meshcache")
+      return meshCache(strArg(argc, argv, 1, "obj.obj"), intArg(argc, argv, 2, 10));
+
+    if (name == "vformat")
+      return vertexFormat(intArg(argc, argv, 1, 10));
+
+    if (name == "blurtaps")
+      return blurTaps(intArg(argc, argv, 1, 256));
+
+    if (name == "mask")
+      return masks(intArg(argc, argv, 1, 4096), intArg(argc, argv, 2, 5));
+
+    if (name == "maskedblur")
+      return maskedBlur(intArg(argc, argv, 1, 2048), intArg(argc, argv, 2, 5));
+
+    if (name == "cull")
+      return culling(intArg(argc, argv, 1, 100000), intArg(argc, argv, 2, 10));
+
+    if (name == "reconfigure")
+      return reconfigure(intArg(argc, argv, 1, 10));
+
+    if (name == "texture")
+      return textures(strArg(argc, argv, 1, "background.png"), intArg(argc, argv, 2, 5));
+
+    if (name == "instancing")
+      return instancing(intArg(argc, argv, 1, 10000), intArg(argc, argv, 2, 60));
+
+    if (name == "lod")
+      return lods(strArg(argc, argv, 1, "obj.obj"), intArg(argc, argv, 2, 60));
+
+    if (name == "blurradius")
+      return blurRadii(intArg(argc, argv, 1, 30));
+
+    if (name == "tiles")
+      return maskTiles(intArg(argc, argv, 1, 30));
+
+    if (name == "render")
+      return render(intArg(argc, argv, 1, 30), strArg(argc, argv, 2, "bench_render_baseline.csv"),
+                    (argc > 3 ? std::atof(argv[3]) : 10.) / 100.);
+
+    std::cerr << "unknown benchmark '" << name << "', available:\n"
+                 "  obj [file] [iterations]\n"
+                 "  vcache [file]\n"
+                 "  meshcache [file] [iterations]\n"
+                 "  vformat [iterations]\n"
+                 "  blurtaps [image size]\n"
+                 "  mask [size] [iterations]\n"
+                 "  maskedblur [size] [iterations]\n"
+                 "  cull [boxes] [iterations]\n"
+                 "  reconfigure [iterations]\n"
+                 "  texture [image] [iterations]\n"
+                 "  render [frames] [baseline.csv] [tolerance %]\n"
+                 "  instancing [max count] [frames]\n"
+                 "  lod [file] [frames]\n"
+                 "  blurradius [frames]\n"
+                 "  tiles [frames]\n";
+    return -1;
+  }
+
+  int loadOBJ(const char *path, int iterations)
+  {
+    utils::MappedFile file(path);
+    if (!file.valid())
+    {
+      std::cerr << "cannot open file " << path;
+      return -1;
+    }
+    const double mb = file.size() / (1024. * 1024.);
+
+    typedef size_t (*loader)(const char*, std::vector<float>&, std::vector<float>&, std::vector<float>&);
+    const loader loaders[2] = {utils::loadOBJ_scanf, utils::loadOBJ};
+    const char  *names  [2] = {"fscanf", "mapped"};
+
+    std::vector<float> vs[2], uvs[2], ns[2];
+    double best[2] = {0., 0.};
+
+    for (int l = 0; l < 2; l++)
+      for (int i = 0; i < iterations; i++)
+      {
+        vs[l].clear();
+        uvs[l].clear();
+        ns[l].clear();
+
+        bench_clock::time_point start = bench_clock::now();
+        if (loaders[l](path, vs[l], uvs[l], ns[l]) == 0)
+          return -1;
+
+        const double t = seconds(start);
+        if (i == 0 || t < best[l])
+          best[l] = t;
+      }
+
+    for (int l = 0; l < 2; l++)
+      std::cout << names[l] << ": " << best[l] * 1000. << " ms, " << mb / best[l] << " MB/s\n";
+
+    const bool same = sameBits(vs[0], vs[1]) && sameBits(uvs[0], uvs[1]) && sameBits(ns[0], ns[1]);
+    std::cout << "speedup x" << best[0] / best[1] << ", results " << (same ? "identical" : "DIFFER") << "\n";
+
+    std::vector<float> ivs, iuvs, ins;
+    std::vector<unsigned int> indices;
+    bench_clock::time_point start = bench_clock::now();
+    const size_t count = utils::loadOBJ(path, ivs, iuvs, ins, indices);
+    const double t = seconds(start);
+
+    const size_t unique = ivs.size() / 3;
+    const size_t vertexBytes = sizeof(float) * 8;
+    const size_t indexBytes  = unique <= 65536 ? sizeof(unsigned short) : sizeof(unsigned int);
+    std::cout << "indexed: " << t * 1000. << " ms, " << unique << " unique vertices for " << count << " indices (x"
+              << double(count) / unique << "), "
+              << (count * vertexBytes) / 1024 << " KB -> " << (unique * vertexBytes + count * indexBytes) / 1024 << " KB\n";
+
+    return same ? 0 : 1;
+  }
+
+  namespace
+  {
+    void reportCache(const char *name, std::vector<float> vs, std::vector<float> uvs, std::vector<float> ns, std::vector<unsigned int> indices)
+    {
+      const size_t vertexCount = vs.size() / 3;
+      const mesh::cache_stats fifo_before = mesh::simulateCache(indices, vertexCount, 32, true);
+      const mesh::cache_stats lru_before  = mesh::simulateCache(indices, vertexCount, 16, false);
+      const float overdraw_before = mesh::analyzeOverdraw(indices, vs);
+
+      bench_clock::time_point start = bench_clock::now();
+      mesh::optimizeVertexCache(indices, vertexCount);
+      const double tCache = seconds(start);
+      const mesh::cache_stats fifo_cache = mesh::simulateCache(indices, vertexCount, 32, true);
+      const float overdraw_cache = mesh::analyzeOverdraw(indices, vs);
+
+      start = bench_clock::now();
+      mesh::optimizeOverdraw(indices, vs);
+      const double tOverdraw = seconds(start);
+      const float overdraw_after = mesh::analyzeOverdraw(indices, vs);
+
+      start = bench_clock::now();
+      mesh::optimizeVertexFetch(indices, vs, uvs, ns);
+      const double tFetch = seconds(start);
+
+      const mesh::cache_stats fifo_after = mesh::simulateCache(indices, vs.size() / 3, 32, true);
+      const mesh::cache_stats lru_after  = mesh::simulateCache(indices, vs.size() / 3, 16, false);
+
+      std::cout << name << ": " << indices.size() / 3 << " triangles, " << vertexCount << " vertices\n"
+                << "  fifo32 ACMR " << fifo_before._acmr << " -> " << fifo_cache._acmr << " -> " << fifo_after._acmr << ", ATVR " << fifo_before._atvr << " -> " << fifo_after._atvr << "\n"
+                << "  lru16  ACMR " << lru_before ._acmr << " -> " << lru_after ._acmr << ", ATVR " << lru_before ._atvr << " -> " << lru_after ._atvr << "\n"
+                << "  overdraw " << overdraw_before << " -> " << overdraw_cache << " -> " << overdraw_after << "\n"
+                << "  cache order " << tCache * 1000. << " ms, overdraw order " << tOverdraw * 1000. << " ms, fetch order " << tFetch * 1000. << " ms\n";
+    }
+  }
+
+  int vertexCache(const char *path)
+  {
+    std::vector<float> vs, uvs, ns;
+    std::vector<unsigned int> indices;
+
+    if (utils::loadOBJ(path, vs, uvs, ns, indices) == 0)
+      return -1;
+    reportCache(path, vs, uvs, ns, indices);
+
+    const size_t spheres[3][2] = {{32, 64}, {256, 512}, {1024, 2048}};
+    for (auto& size : spheres)
+    {
+      vs.clear();
+      uvs.clear();
+      ns.clear();
+      indices.clear();
+
+      mesh::makeSphere(size[0], size[1], vs, uvs, ns, indices);
+      const std::string name = "sphere " + std::to_string(size[0]) + "x" + std::to_string(size[1]);
+      reportCache(name.c_str(), vs, uvs, ns, indices);
+    }
+
+    // spheres in a row hide each other, where the overdraw order pays off
+    vs.clear();
+    uvs.clear();
+    ns.clear();
+    indices.clear();
+    for (int s = 0; s < 8; s++)
+    {
+      const size_t first = vs.size();
+      mesh::makeSphere(64, 128, vs, uvs, ns, indices);
+      for (size_t i = first; i < vs.size(); i += 3)
+      {
+        vs[i]     += 0.7f * s;
+        vs[i + 1] += 0.3f * (s % 3);
+      }
+    }
+    reportCache("8 overlapping spheres 64x128", vs, uvs, ns, indices);
+    return 0;
+  }
+
+  int meshCache(const char *path, int iterations)
+  {
+    const std::string mesh_path = std::string(path) + ".bench.mesh";
+    double cold = 0., warm = 0.;
+
+    for (int i = 0; i < iterations; i++)
+    {
+      std::remove(mesh_path.c_str());
+
+      bench_clock::time_point start = bench_clock::now();
+      std::shared_ptr<mesh::MeshFile> built = mesh::load(path, mesh_path.c_str(), true, true);
+      const double t = seconds(start);
+      if (!built || !built->valid())
+        return -1;
+
+      if (i == 0 || t < cold)
+        cold = t;
+    }
+
+    size_t bytes = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+      bench_clock::time_point start = bench_clock::now();
+      std::shared_ptr<mesh::MeshFile> mapped = mesh::load(path, mesh_path.c_str(), true, true);
+      const double t = seconds(start);
+      if (!mapped || !mapped->valid())
+        return -1;
+
+      const mesh::file_header& header = mapped->header();
+      bytes = size_t(header._vertexCount) * header._vertexSize + header._indexCount * header._indexSize;
+
+      if (i == 0 || t < warm)
+        warm = t;
+    }
+
+    std::remove(mesh_path.c_str());
+
+    std::cout << "cold (parse + optimize + write):  " << cold * 1000. << " ms\n"
+              << "warm (stamp + map + index check): " << warm * 1000. << " ms\n"
+              << "speedup x" << cold / warm << ", " << bytes / 1024 << " KB ready for upload\n";
+    return 0;
+  }
+
+  int vertexFormat(int iterations)
+  {
+    std::vector<float> vs, uvs, ns;
+    std::vector<unsigned int> indices;
+    mesh::makeSphere(1024, 2048, vs, uvs, ns, indices);
+
+    const size_t count = vs.size() / 3;
+    std::vector<mesh::vertex> vertices(count);
+    for (size_t v = 0; v < count; v++)
+    {
+      std::copy(&vs [v * 3], &vs [v * 3] + 3, vertices[v]._pos);
+      std::copy(&uvs[v * 2], &uvs[v * 2] + 2, vertices[v]._uv);
+      std::copy(&ns [v * 3], &ns [v * 3] + 3, vertices[v]._n);
+    }
+
+    std::vector<mesh::packed_vertex> packed[2];
+    double best[2] = {0., 0.};
+    const char *names[2] = {"scalar", "simd"};
+
+    for (int p = 0; p < 2; p++)
+    {
+      packed[p].resize(count);
+      for (int i = 0; i < iterations; i++)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        mesh::pack(vertices.data(), count, packed[p].data(), p == 1);
+        const double t = seconds(start);
+        if (i == 0 || t < best[p])
+          best[p] = t;
+      }
+    }
+
+    float uvError = 0.f, nError = 0.f;
+    for (size_t v = 0; v < count; v++)
+    {
+      const mesh::packed_vertex& pv = packed[1][v];
+      for (int c = 0; c < 2; c++)
+        uvError = std::max(uvError, std::fabs(mesh::halfToFloat(pv._uv[c]) - vertices[v]._uv[c]));
+
+      for (int c = 0; c < 3; c++)
+      {
+        int q = int(pv._n >> (c * 10)) & 0x3FF;
+        if (q >= 512)
+          q -= 1024;
+        nError = std::max(nError, std::fabs(std::max(q / 511.f, -1.f) - vertices[v]._n[c]));
+      }
+    }
+
+    const double mb = count * sizeof(mesh::vertex) / (1024. * 1024.);
+    for (int p = 0; p < 2; p++)
+      std::cout << names[p] << ": " << best[p] * 1000. << " ms, " << mb / best[p] << " MB/s of float vertices\n";
+
+    const bool same = sameBits(packed[0], packed[1]);
+    std::cout << count << " vertices, " << sizeof(mesh::vertex) << " -> " << sizeof(mesh::packed_vertex) << " bytes per vertex, "
+              << "max error uv " << uvError << ", normal " << nError << ", simd " << (same ? "matches" : "DIFFERS FROM") << " scalar\n";
+    return same ? 0 : 1;
+  }
+
+  int blurTaps(int size)
+  {
+    const size_t w = size_t(size), h = size_t(size), channels = 4;
+
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<float> image(w * h * channels);
+    for (auto& v : image)
+      v = byte(rng) / 255.f;
+
+    std::vector<float> reference(image.size()), exact(image.size()), gpu(image.size());
+    bool ok = true;
+
+    for (int radius : {1, 4, 16, 32, 64})
+    {
+      const std::vector<float> weights = blur::gaussianWeights(radius);
+      std::vector<float> offsets, linWeights;
+      blur::linearTaps(weights, offsets, linWeights);
+
+      blur::separable      (image.data(), w, h, channels, weights, reference.data());
+      blur::separableLinear(image.data(), w, h, channels, offsets, linWeights, 0, exact.data());
+      blur::separableLinear(image.data(), w, h, channels, offsets, linWeights, 8, gpu.data());
+
+      float errExact = 0.f, errGpu = 0.f;
+      for (size_t i = 0; i < image.size(); i++)
+      {
+        errExact = std::max(errExact, std::fabs(exact[i] - reference[i]));
+        errGpu   = std::max(errGpu,   std::fabs(gpu  [i] - reference[i]));
+      }
+
+      // exact merged taps must reproduce the discrete kernel, 8-bit subtexel precision may cost about a level
+      ok = ok && errExact * 255.f < 0.01f && errGpu * 255.f < 1.f;
+
+      std::cout << "radius " << radius << ": fetches per pixel " << 2 * (2 * radius + 1) << " -> " << 2 * (2 * offsets.size() - 1)
+                << ", max error (0..255) exact " << errExact * 255.f << ", 8-bit subtexel " << errGpu * 255.f << "\n";
+    }
+
+    std::cout << (ok ? "merged taps match the reference\n" : "merged taps DIFFER from the reference\n");
+    return ok ? 0 : 1;
+  }
+
+  int masks(int size, int iterations)
+  {
+    const size_t w = size_t(size), h = size_t(size);
+    const double mpix = double(w) * h / 1e6;
+    const char *typeNames[mask::TYPE_COUNT] = {"smooth", "edge", "peak"};
+    const char *pathNames[4] = {"reference", "scalar rows", "simd rows", "simd row replicated"};
+
+    std::vector<unsigned char> reference(w * h), out(w * h);
+    bool ok = true;
+
+    for (int t = 0; t < mask::TYPE_COUNT; t++)
+    {
+      const mask::type type = mask::type(t);
+      std::cout << typeNames[t] << " " << w << "x" << h << ":\n";
+
+      for (int path = 0; path < 4; path++)
+      {
+        double best = 0.;
+        for (int i = 0; i < iterations; i++)
+        {
+          bench_clock::time_point start = bench_clock::now();
+          if (path == 0)
+            mask::buildReference(type, w, h, reference.data());
+          else
+            mask::build(type, w, h, out.data(), path == 3, path != 1);
+
+          const double t = seconds(start);
+          if (i == 0 || t < best)
+            best = t;
+        }
+
+        const bool same = path == 0 || reference == out;
+        ok = ok && same;
+        std::cout << "  " << pathNames[path] << ": " << best * 1000. << " ms, " << mpix / best << " Mpix/s"
+                  << (same ? "" : ", DIFFERS from reference") << "\n";
+      }
+    }
+
+    mask::Cache cache;
+    bench_clock::time_point start = bench_clock::now();
+    cache.get(mask::SMOOTH, w, h);
+    const double tMiss = seconds(start);
+
+    start = bench_clock::now();
+    cache.get(mask::SMOOTH, w, h);
+    const double tHit = seconds(start);
+    std::cout << "cache: miss " << tMiss * 1000. << " ms, hit " << tHit * 1e6 << " us\n";
+
+    std::cout << (ok ? "all paths match the reference\n" : "paths DIFFER from the reference\n");
+    return ok ? 0 : 1;
+  }
+
+  int maskedBlur(int size, int iterations)
+  {
+    const size_t w = size_t(size), h = size_t(size);
+    const double mpix = double(w) * h / 1e6;
+
+    // noise, so every tap matters, and the smooth mask for every blend factor
+    std::vector<unsigned char> src(w * h * 4), mask(w * h), reference(w * h * 4);
+    std::mt19937 rng(1);
+    for (unsigned char& c : src)
+      c = (unsigned char)(rng() & 255);
+    mask::build(mask::SMOOTH, w, h, mask.data());
+
+    bench_clock::time_point start = bench_clock::now();
+    blur::maskedBlurReference(src.data(), w, h, mask.data(), reference.data());
+    const double tReference = seconds(start);
+    std::cout << w << "x" << h << ", shader transcription: " << tReference * 1000. << " ms, " << mpix / tReference << " Mpix/s\n";
+
+    auto measure = [&](const blur::MaskedBlur& engine, std::vector<unsigned char>& out)
+    {
+      double best = 0.;
+      for (int i = 0; i < iterations; i++)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        engine.apply(src.data(), w, h, mask.data(), out.data());
+        const double t = seconds(start);
+        if (i == 0 || t < best)
+          best = t;
+      }
+      return best;
+    };
+
+    // one thread per instruction set; all must give the same bytes, within 1 of the shader
+    const char *isaNames[3] = {"scalar", "SSE2", "AVX2"};
+    std::vector<unsigned char> out[3];
+    bool ok = true;
+    for (int set = blur::MaskedBlur::SCALAR; set <= blur::MaskedBlur::supported(); set++)
+    {
+      out[set].resize(w * h * 4);
+      const double t = measure(blur::MaskedBlur(blur::MaskedBlur::isa(set), 1), out[set]);
+
+      int maxDiff = 0;
+      size_t off = 0;
+      for (size_t i = 0; i < reference.size(); i++)
+      {
+        const int d = std::abs(int(out[set][i]) - int(reference[i]));
+        maxDiff = std::max(maxDiff, d);
+        off += d > 0;
+      }
+      const bool same = sameBits(out[set], out[0]);
+      ok = ok && same && maxDiff <= 1;
+
+      std::cout << "  " << isaNames[set] << ", 1 thread: " << t * 1000. << " ms, " << mpix / t << " Mpix/s, max diff to shader "
+                << maxDiff << " (" << 100. * off / reference.size() << "% of channels)" << (same ? "" : ", DIFFERS from scalar") << "\n";
+    }
+
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned char> threaded(w * h * 4);
+    for (size_t threads = 1; ; threads = std::min(threads * 2, cores))
+    {
+      const blur::MaskedBlur engine(blur::MaskedBlur::supported(), threads);
+      const double t = measure(engine, threaded);
+      ok = ok && threaded == out[0];
+      std::cout << "  " << isaNames[engine.GetIsa()] << ", " << threads << " threads: " << mpix / t << " Mpix/s\n";
+      if (threads == cores)
+        break;
+    }
+
+    std::cout << (ok ? "all paths agree, within 1 of the shader\n" : "paths DIFFER\n");
+    return ok ? 0 : 1;
+  }
+
+  int culling(int count, int iterations)
+  {
+    // boxes scattered around the origin, the camera of Scene::draw3DObject looking at it
+    std::vector<cull::aabb> boxes(count);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> pos(-30.f, 30.f), size(0.1f, 0.5f);
+    for (cull::aabb& b : boxes)
+    {
+      const glm::vec3 c(pos(rng), pos(rng), pos(rng));
+      b._min = c - glm::vec3(size(rng));
+      b._max = c + glm::vec3(size(rng));
+    }
+
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 3.f, 3.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+    const cull::frustum f = cull::fromMatrix(glm::perspective(45.f, 1.f, 0.1f, 20.f) * view);
+
+    auto best = [iterations](const std::function<void()>& fn)
+    {
+      double t = 0.;
+      for (int i = 0; i < iterations; i++)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        fn();
+        const double s = seconds(start);
+        if (i == 0 || s < t)
+          t = s;
+      }
+      return t * 1000.;
+    };
+
+    std::vector<uint32_t> brute;
+    const double tBrute = best([&]()
+    {
+      brute.clear();
+      for (size_t i = 0; i < boxes.size(); i++)
+        if (cull::test(f, boxes[i]) != cull::OUTSIDE)
+          brute.push_back(uint32_t(i));
+    });
+
+    cull::BVH bvh;
+    const double tBuild = best([&]() {bvh.build(boxes);});
+
+    // every box moves a little, the tree is refit instead of rebuilt
+    for (cull::aabb& b : boxes)
+    {
+      b._min += glm::vec3(0.05f);
+      b._max += glm::vec3(0.05f);
+    }
+    const double tRefit = best([&]() {bvh.refit(boxes);});
+
+    std::vector<uint32_t> movedBrute;
+    for (size_t i = 0; i < boxes.size(); i++)
+      if (cull::test(f, boxes[i]) != cull::OUTSIDE)
+        movedBrute.push_back(uint32_t(i));
+
+    std::cout << count << " boxes, " << bvh.nodeCount() << " nodes: build " << tBuild << " ms, refit " << tRefit
+              << " ms; every box tested: " << tBrute << " ms, " << brute.size() << " visible\n";
+
+    // BVH leaves are accepted whole, so it may report a few more than the per-box test, never fewer
+    bool ok = true;
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int simd = 0; simd < 2; simd++)
+      for (size_t threads = 1; ; threads = std::min(threads * 2, cores))
+      {
+        std::vector<uint32_t> visible;
+        const double t = best([&]() {bvh.cull(f, visible, simd == 1, threads);});
+        const bool complete = std::includes(visible.begin(), visible.end(), movedBrute.begin(), movedBrute.end());
+        ok = ok && complete;
+
+        std::cout << "  BVH " << (simd ? "SSE2  " : "scalar") << ", " << threads << " threads: " << t << " ms, "
+                  << visible.size() << " visible, " << count - visible.size() << " culled" << (complete ? "" : ", MISSES visible boxes") << "\n";
+        if (threads == cores)
+          break;
+      }
+
+    std::cout << (ok ? "no visible box culled\n" : "visible boxes were culled\n");
+    return ok ? 0 : 1;
+  }
+
+  int reconfigure(int iterations)
+  {
+    headless::Context context(64, 64);
+    if (!context.valid())
+      return -1;
+
+    const Scene::Size sizes[2] = {Scene::Size(512, 512), Scene::Size(256, 256)};
+    const Scene::mask_type maskTypes[2] = {Scene::SMOOTH, Scene::EDGE};
+
+    Scene scene;
+    scene.Load(sizes[0], sizes[0], maskTypes[0]);
+    glFinish();
+
+    // average ms of one setting change, alternating between two values so every call changes something
+    auto measure = [&](bool incremental, bool changeRtt)
+    {
+      bench_clock::time_point start = bench_clock::now();
+      for (int i = 1; i <= iterations; i++)
+      {
+        const Scene::Size      rtt = changeRtt ? sizes[i % 2] : scene.GetRttSize();
+        const Scene::mask_type m   = changeRtt ? scene.GetMaskType() : maskTypes[i % 2];
+        if (incremental)
+          scene.Reconfigure(rtt, scene.GetMaskSize(), m);
+        else
+          scene.Load(rtt, scene.GetMaskSize(), m);
+        glFinish();
+      }
+      return seconds(start) * 1000. / iterations;
+    };
+
+    for (int what = 0; what < 2; what++)
+    {
+      const bool changeRtt = what == 0;
+      const double full        = measure(false, changeRtt);
+      const double incremental = measure(true,  changeRtt);
+
+      std::cout << (changeRtt ? "RTT size" : "mask type") << " change: Load " << full << " ms, Reconfigure "
+                << incremental << " ms (x" << full / incremental << ")\n";
+    }
+
+    const gl::ProgramCache::stats& st = scene.GetProgramCacheStats();
+    std::cout << "program binary cache during Load: " << st._hits << " hits, " << st._misses << " misses, "
+              << st._savedSeconds * 1000. << " ms saved\n";
+    return 0;
+  }
+
+  int textures(const char *path, int iterations)
+  {
+    utils::image img;
+    double tDecode = 0.;
+    bool synthetic = !utils::MappedFile(path).valid();
+    if (!synthetic)
+    {
+      bench_clock::time_point start = bench_clock::now();
+      synthetic = !utils::decodeImage(path, img);
+      tDecode = seconds(start);
+    }
+    if (synthetic)
+    {
+      // smooth gradients with some noise, like a photo
+      img._width = img._height = 1024;
+      img._alpha = false;
+      img._bits.resize(img._width * img._height * 4);
+      std::mt19937 rng(1);
+      std::uniform_int_distribution<int> noise(-8, 8);
+      for (size_t y = 0; y < img._height; y++)
+        for (size_t x = 0; x < img._width; x++)
+        {
+          unsigned char *p = &img._bits[4 * (y * img._width + x)];
+          p[0] = (unsigned char)std::min(255, std::max(0, int(x / 4) + noise(rng)));
+          p[1] = (unsigned char)std::min(255, std::max(0, int(y / 4) + noise(rng)));
+          p[2] = (unsigned char)std::min(255, std::max(0, int((x + y) / 8) + noise(rng)));
+          p[3] = 255;
+        }
+      std::cout << path << " not found, synthetic ";
+    }
+    else
+      std::cout << path << ": decode " << tDecode * 1000. << " ms, ";
+    std::cout << img._width << "x" << img._height << (img._alpha ? " with alpha" : "") << "\n";
+
+    // first mip level, scalar vs SSE2, same bytes expected
+    const size_t w = img._width, h = img._height;
+    std::vector<unsigned char> mip[2];
+    double best[2] = {0., 0.};
+    for (int simd = 0; simd < 2; simd++)
+    {
+      mip[simd].resize(std::max<size_t>(w / 2, 1) * std::max<size_t>(h / 2, 1) * 4);
+      for (int i = 0; i < iterations; i++)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        texture::downsample(img._bits.data(), w, h, mip[simd].data(), simd == 1);
+        const double t = seconds(start);
+        if (i == 0 || t < best[simd])
+          best[simd] = t;
+      }
+    }
+    const bool same = mip[0] == mip[1];
+    const double mpix = double(w) * h / 1e6;
+    std::cout << "mip 0 -> 1: scalar " << best[0] * 1000. << " ms, SSE2 " << best[1] * 1000. << " ms (" << mpix / best[1]
+              << " Mpix/s, x" << best[0] / best[1] << "), results " << (same ? "identical" : "DIFFER") << "\n";
+
+    // BC1 of the top level
+    std::vector<unsigned char> blocks(texture::levelSize(texture::BC1, w, h));
+    bench_clock::time_point start = bench_clock::now();
+    texture::compressBC1(img._bits.data(), w, h, blocks.data());
+    const double tBC1 = seconds(start);
+
+    std::vector<unsigned char> decoded(w * h * 4);
+    texture::decompressBC1(blocks.data(), w, h, decoded.data());
+
+    double sqErr = 0.;
+    for (size_t i = 0; i < w * h * 4; i++)
+      if (i % 4 != 3)
+      {
+        const double d = double(decoded[i]) - img._bits[i];
+        sqErr += d * d;
+      }
+    std::cout << "BC1: " << tBC1 * 1000. << " ms, " << mpix / tBC1 << " Mpix/s, RMSE " << std::sqrt(sqErr / (3. * w * h)) << "\n";
+
+    // whole files with every mip level
+    bool ok = same;
+    for (int f = 0; f < 2; f++)
+    {
+      const texture::format format = f == 0 ? texture::BGRA8 : texture::BC1;
+      std::vector<char> bytes;
+      start = bench_clock::now();
+      texture::serialize(img, format, 0, 0, bytes);
+      const double tBuild = seconds(start);
+
+      const size_t fileSize = bytes.size();
+      const char *tmp = "bench_texture.tex";
+      texture::TextureFile(bytes).write(tmp);
+
+      // unmapped before the file is removed
+      {
+        start = bench_clock::now();
+        texture::TextureFile mapped(tmp);
+        const double tMap = seconds(start);
+
+        if (!mapped.valid())
+        {
+          std::cout << "could not map " << tmp << "\n";
+          ok = false;
+        }
+        else
+          std::cout << (f == 0 ? "BGRA8" : "BC1  ") << " file: " << mapped.header()._levels << " levels, " << fileSize / 1024 << " KB, build "
+                    << tBuild * 1000. << " ms, warm map " << tMap * 1000. << " ms\n";
+      }
+      remove(tmp);
+    }
+
+    return ok ? 0 : 1;
+  }
+
+  namespace
+  {
+    struct render_result
+    {
+      std::string _config;
+      double      _fps;
+      double      _frameMs;                          // mean wall time per frame, glFinish at the end of the batch
+      double      _cpuP50[profiler::PASS_COUNT];     // submission, ms
+      double      _gpuP50[profiler::PASS_COUNT];     // GL_TIME_ELAPSED, ms, 0 without timer queries
+    };
+
+    // config -> fps of a previous run's CSV
+    bool readBaseline(const char *path, std::map<std::string, double>& out)
+    {
+      std::ifstream in(path);
+      if (!in)
+        return false;
+
+      std::string line;
+      std::getline(in, line); // header
+      while (std::getline(in, line))
+      {
+        std::istringstream row(line);
+        std::string config, fps;
+        if (std::getline(row, config, ',') && std::getline(row, fps, ','))
+          out[config] = std::atof(fps.c_str());
+      }
+      return true;
+    }
+
+    std::shared_ptr<mesh::MeshFile> sphereMesh(size_t rings, size_t segments)
+    {
+      std::vector<float> vs, uvs, ns;
+      std::vector<unsigned int> indices;
+      mesh::makeSphere(rings, segments, vs, uvs, ns, indices);
+      mesh::optimizeVertexCache(indices, vs.size() / 3);
+      mesh::optimizeVertexFetch(indices, vs, uvs, ns);
+
+      std::vector<mesh::lod> lods;
+      mesh::buildLods(indices, vs, uvs, ns, true, lods);
+
+      std::vector<char> bytes;
+      mesh::serialize(vs, uvs, ns, indices, 0, 0, 0, true, bytes, lods);
+      return std::make_shared<mesh::MeshFile>(bytes);
+    }
+
+    const float PI = 3.141592f;
+
+    // hidden side x side window and a scene loaded into it, RTT and smooth mask of the same size
+    struct bench_scene
+    {
+      explicit bench_scene(size_t side): _context(side, side)
+      {
+        if (!_context.valid())
+          return;
+
+        std::cout << "GL_RENDERER " << (const char*)glGetString(GL_RENDERER) << "\n";
+        _scene.Load(Scene::Size(side, side), Scene::Size(side, side), Scene::SMOOTH);
+        _scene.SetSize(Scene::Size(side, side));
+      }
+
+      bool valid() const {return _context.valid();}
+
+      headless::Context _context; // declared first, destroyed after the scene released its GL objects
+      Scene             _scene;
+    };
+
+    struct frames_profile
+    {
+      double            _seconds;                    // wall time of the timed frames, glFinish included
+      profiler::summary _cpu[profiler::PASS_COUNT];
+      profiler::summary _gpu[profiler::PASS_COUNT];
+    };
+
+    // 3 warm-up frames at angle 0 so programs and buffers are ready, then `frames` timed ones
+    // turning anglePerFrame radians each; the profile only covers the timed frames
+    frames_profile runFrames(Scene& scene, int frames, float anglePerFrame)
+    {
+      for (int f = 0; f < 3; f++)
+      {
+        scene.SetAngle(0.f);
+        scene.Frame();
+      }
+      glFinish();
+
+      profiler::Profiler& prof = scene.GetProfiler();
+      prof.reset();
+
+      bench_clock::time_point start = bench_clock::now();
+      for (int f = 0; f < frames; f++)
+      {
+        scene.SetAngle(anglePerFrame * f);
+        scene.Frame();
+      }
+      glFinish();
+
+      frames_profile r;
+      r._seconds = seconds(start);
+      prof.collect();
+      for (int p = 0; p < profiler::PASS_COUNT; p++)
+      {
+        r._cpu[p] = prof.cpu(profiler::pass(p));
+        r._gpu[p] = prof.gpu(profiler::pass(p));
+      }
+      return r;
+    }
+  }
+
+  int render(int frames, const char *baseline, double tolerance)
+  {
+    bench_scene bench(512); // output size, the window's default framebuffer
+    if (!bench.valid())
+      return -1;
+
+    struct mesh_case
+    {
+      const char *_name;
+      size_t      _rings, _segments; // 0: obj.obj
+    };
+    const mesh_case meshes[] = {{"obj", 0, 0}, {"sphere32", 32, 64}, {"sphere256", 256, 512}};
+    const size_t rttSides[]  = {512, 256};
+    const size_t maskDivs[]  = {1, 8};    // mask size = RTT size / div
+    const Scene::mask_type maskTypes[] = {Scene::SMOOTH, Scene::EDGE, Scene::PEAK_AT_CENTER};
+    const char *maskNames[] = {"smooth", "edge", "peak"};
+    const char *blurNames[Scene::BLUR_MODE_COUNT] = {"simple", "separable", "pyramid", "compute"};
+
+    Scene& scene = bench._scene;
+    scene.SetBlurRadius(16);
+
+    std::vector<render_result> results;
+    for (const mesh_case& m : meshes)
+    {
+      scene.SetObjectMesh(m._rings > 0 ? sphereMesh(m._rings, m._segments) : nullptr);
+
+      for (size_t rtt : rttSides)
+        for (size_t div : maskDivs)
+          for (int t = 0; t < 3; t++)
+          {
+            scene.Reconfigure(Scene::Size(rtt, rtt), Scene::Size(rtt / div, rtt / div), maskTypes[t]);
+
+            for (int light = 1; light >= 0; light--)
+              for (int b = 0; b < Scene::BLUR_MODE_COUNT; b++)
+              {
+                scene.SetLightOn(light == 1);
+                scene.SetBlurMode(Scene::blur_mode(b));
+
+                // same angles every run
+                const frames_profile prof = runFrames(scene, frames, 2.f * PI / frames);
+
+                std::ostringstream config;
+                config << m._name << " rtt=" << rtt << " mask=" << rtt / div << " " << maskNames[t]
+                       << (light ? " light" : " nolight") << " " << blurNames[b];
+
+                render_result r;
+                r._config  = config.str();
+                r._fps     = frames / prof._seconds;
+                r._frameMs = prof._seconds * 1000. / frames;
+                for (int p = 0; p < profiler::PASS_COUNT; p++)
+                {
+                  r._cpuP50[p] = prof._cpu[p]._p50;
+                  r._gpuP50[p] = prof._gpu[p]._p50;
+                }
+                results.push_back(r);
+                std::cout << r._config << ": " << r._fps << " FPS\n";
+              }
+          }
+    }
+    scene.SetObjectMesh(nullptr);
+
+    const char *out_path = "bench_render.csv";
+    {
+      std::ofstream out(out_path);
+      out << "config,fps,frame_ms";
+      for (int p = 0; p < profiler::PASS_COUNT; p++)
+        out << "," << profiler::passName(profiler::pass(p)) << "_cpu_p50_ms," << profiler::passName(profiler::pass(p)) << "_gpu_p50_ms";
+      out << "\n";
+      for (const render_result& r : results)
+      {
+        out << r._config << "," << r._fps << "," << r._frameMs;
+        for (int p = 0; p < profiler::PASS_COUNT; p++)
+          out << "," << r._cpuP50[p] << "," << r._gpuP50[p];
+        out << "\n";
+      }
+      if (!out)
+      {
+        std::cerr << out_path << ": unable to write results\n";
+        return -1;
+      }
+    }
+    std::cout << results.size() << " configurations, " << frames << " frames each, written to " << out_path << "\n";
+
+    std::map<std::string, double> base;
+    if (!readBaseline(baseline, base))
+    {
+      std::cout << "no baseline " << baseline << ", copy " << out_path << " there to compare future runs\n";
+      return 0;
+    }
+
+    size_t regressions = 0, compared = 0;
+    for (const render_result& r : results)
+    {
+      auto it = base.find(r._config);
+      if (it == base.end() || it->second <= 0.)
+        continue;
+
+      compared++;
+      const double change = r._fps / it->second - 1.;
+      if (change < -tolerance)
+      {
+        std::cout << "REGRESSION " << r._config << ": " << it->second << " -> " << r._fps << " FPS ("
+                  << change * 100. << "%)\n";
+        regressions++;
+      }
+    }
+    std::cout << compared << " configurations compared with " << baseline << ", " << regressions
+              << " slower by more than " << tolerance * 100. << "%\n";
+    return regressions > 0 ? 1 : 0;
+  }
+
+  int instancing(int maxCount, int frames)
+  {
+    bench_scene bench(512);
+    if (!bench.valid())
+      return -1;
+
+    Scene& scene = bench._scene;
+    const std::shared_ptr<mesh::MeshFile> sphere = sphereMesh(8, 16);
+    std::cout << "sphere of " << sphere->header()._lodCount[0] / 3 << " triangles\n"
+              << "    count  mode          cull  visible  draws  object cpu ms  object gpu ms  cull ms  frame ms\n";
+
+    for (int count = std::min(100, maxCount); ; count = std::min(count * 10, maxCount))
+    {
+      // a cube of small spheres around the object, same layout every run
+      std::vector<Scene::instance> instances(count);
+      std::mt19937 rng(1);
+      std::uniform_real_distribution<float> pos(-2.f, 2.f), tint(0.3f, 1.f);
+      for (Scene::instance& inst : instances)
+      {
+        inst._model = glm::scale(glm::translate(glm::mat4(), glm::vec3(pos(rng), pos(rng), pos(rng))), glm::vec3(0.04f));
+        inst._tint  = glm::vec4(tint(rng), tint(rng), tint(rng), 1.f);
+      }
+
+      scene.ClearInstances();
+      scene.AddInstances(sphere, instances);
+
+      for (int mode = 0; mode < 4; mode++)
+      {
+        const bool instanced = mode / 2 == 1, culled = mode % 2 == 1;
+        scene.SetInstancing(instanced);
+        scene.SetCulling(culled);
+        const frames_profile prof = runFrames(scene, frames, 0.1f);
+
+        const Scene::cull_stats& cs = scene.GetCullStats();
+        char line[160];
+        snprintf(line, sizeof(line), "%9d  %-12s  %-4s  %7zu  %5zu  %13.3f  %13.3f  %7.3f  %8.3f\n", count,
+                 instanced ? "instanced" : "per instance", culled ? "on" : "off", culled ? cs._visible : size_t(count) + 1,
+                 scene.GetDrawCalls(), prof._cpu[profiler::OBJECT]._p50, prof._gpu[profiler::OBJECT]._p50, cs._seconds * 1000.,
+                 prof._seconds * 1000. / frames);
+        std::cout << line;
+      }
+
+      if (count == maxCount)
+        break;
+    }
+    return 0;
+  }
+
+  namespace
+  {
+    void reportLods(const char *name, const std::vector<float>& vs, const std::vector<float>& uvs, const std::vector<float>& ns,
+      const std::vector<unsigned int>& indices)
+    {
+      std::vector<mesh::lod> lods;
+      const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+      double t[2] = {};
+      for (int i = 0; i < 2; i++)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        mesh::buildLods(indices, vs, uvs, ns, true, lods, i == 0 ? 1 : cores);
+        t[i] = seconds(start);
+      }
+
+      float extent = 0.f;
+      for (float c : vs)
+        extent = std::max(extent, std::abs(c));
+
+      std::cout << name << ": " << indices.size() / 3 << " triangles, extent " << extent << "; chain built in " << t[0] * 1000.
+                << " ms on 1 thread, " << t[1] * 1000. << " ms on " << cores << "\n";
+      for (size_t l = 0; l < lods.size(); l++)
+        std::cout << "  level " << l + 1 << ": " << lods[l]._indices.size() / 3 << " triangles, error " << lods[l]._error << "\n";
+    }
+  }
+
+  int lods(const char *path, int frames)
+  {
+    {
+      std::vector<float> vs, uvs, ns;
+      std::vector<unsigned int> indices;
+      if (utils::loadOBJ(path, vs, uvs, ns, indices) == 0)
+        return -1;
+      mesh::optimizeVertexCache(indices, vs.size() / 3);
+      mesh::optimizeVertexFetch(indices, vs, uvs, ns);
+      reportLods(path, vs, uvs, ns, indices);
+
+      vs.clear();
+      uvs.clear();
+      ns.clear();
+      indices.clear();
+      mesh::makeSphere(256, 512, vs, uvs, ns, indices);
+      reportLods("sphere 256x512", vs, uvs, ns, indices);
+    }
+
+    const size_t side = 512;
+    bench_scene bench(side);
+    if (!bench.valid())
+      return -1;
+
+    Scene& scene = bench._scene;
+    struct policy
+    {
+      const char *_name;
+      float       _pixels;
+    };
+    const policy policies[] = {{"full", 0.f}, {"0.5 px", 0.5f}, {"1 px", 1.f}, {"4 px", 4.f}, {"coarsest", FLT_MAX}};
+    const size_t rttSides[] = {512, 256, 128};
+
+    std::cout << "mesh       rtt  policy    triangles  frame ms  object gpu ms\n";
+    for (int m = 0; m < 2; m++)
+    {
+      scene.SetObjectMesh(m == 0 ? nullptr : sphereMesh(256, 512));
+
+      for (size_t rtt : rttSides)
+      {
+        scene.Reconfigure(Scene::Size(rtt, rtt), Scene::Size(side, side), Scene::SMOOTH);
+        for (const policy& p : policies)
+        {
+          scene.SetLodThreshold(p._pixels);
+          const frames_profile prof = runFrames(scene, frames, 2.f * PI / frames);
+
+          char line[160];
+          snprintf(line, sizeof(line), "%-9s  %4zu  %-8s  %9zu  %8.3f  %13.3f\n", m == 0 ? "obj" : "sphere256", rtt, p._name,
+                   scene.GetTriangles(), prof._seconds * 1000. / frames, prof._gpu[profiler::OBJECT]._p50);
+          std::cout << line;
+        }
+      }
+    }
+    scene.SetObjectMesh(nullptr);
+    return 0;
+  }
+
+  int blurRadii(int frames)
+  {
+    const int radii[] = {1, 2, 4, 8, 16, 32, 64};
+
+    std::cout << "radius  boxes       sigma gauss  sigma boxes  max weight diff\n";
+    for (int radius : radii)
+    {
+      int boxes[blur::box_passes];
+      blur::boxRadii(radius, boxes);
+      const std::vector<float> g = blur::gaussianWeights(radius), b = blur::boxWeights(boxes);
+
+      double gVar = 0., bVar = 0., diff = 0.;
+      for (size_t i = 0; i < std::max(g.size(), b.size()); i++)
+      {
+        const double gw = i < g.size() ? g[i] : 0., bw = i < b.size() ? b[i] : 0.;
+        gVar += i == 0 ? 0. : 2. * gw * i * i;
+        bVar += i == 0 ? 0. : 2. * bw * i * i;
+        diff = std::max(diff, std::fabs(gw - bw));
+      }
+
+      char line[120];
+      snprintf(line, sizeof(line), "%6d  %2d %2d %2d    %11.2f  %11.2f  %15.4f\n", radius, boxes[0], boxes[1], boxes[2],
+               std::sqrt(gVar), std::sqrt(bVar), diff);
+      std::cout << line;
+    }
+
+    bench_scene bench(512);
+    if (!bench.valid())
+      return -1;
+
+    Scene& scene = bench._scene;
+    if (!scene.GetComputeBlur())
+      std::cout << "no compute shaders, the compute column is the separable fallback\n";
+
+    const Scene::blur_mode modes[] = {Scene::BLUR_SEPARABLE, Scene::BLUR_PYRAMID, Scene::BLUR_COMPUTE};
+    const size_t rttSides[] = {512, 1024};
+
+    std::cout << "blur pass GPU p50 ms\n"
+                 " rtt  radius  separable  pyramid  compute\n";
+    for (size_t rtt : rttSides)
+    {
+      scene.Reconfigure(Scene::Size(rtt, rtt), Scene::Size(rtt, rtt), Scene::SMOOTH);
+      for (int radius : radii)
+      {
+        scene.SetBlurRadius(radius);
+
+        double ms[3];
+        for (int m = 0; m < 3; m++)
+        {
+          scene.SetBlurMode(modes[m]);
+          ms[m] = runFrames(scene, frames, 2.f * PI / frames)._gpu[profiler::BLUR]._p50;
+        }
+
+        char line[120];
+        snprintf(line, sizeof(line), "%4zu  %6d  %9.3f  %7.3f  %7.3f\n", rtt, radius, ms[0], ms[1], ms[2]);
+        std::cout << line;
+      }
+    }
+    return 0;
+  }
+
+  int maskTiles(int frames)
+  {
+    const size_t side = 512, tile = 32;
+    const char *typeNames[] = {"smooth", "edge", "peak"};
+
+    std::cout << "type    classify ms  cache hit us   copy %  blur only %  blended %  quads  fetches saved %\n";
+    for (int t = 0; t < mask::TYPE_COUNT; t++)
+    {
+      mask::Cache cache;
+      cache.get(mask::type(t), side, side);
+
+      bench_clock::time_point start = bench_clock::now();
+      const mask::Cache::tile_set tiles = cache.getTiles(mask::type(t), side, side, side, side, tile);
+      const double tMiss = seconds(start);
+
+      start = bench_clock::now();
+      cache.getTiles(mask::type(t), side, side, side, side, tile);
+      const double tHit = seconds(start);
+
+      size_t total = 0, quads = 0, fetched = 0;
+      for (int c = 0; c < mask::TILE_CLASS_COUNT; c++)
+      {
+        total   += tiles->_pixels[c];
+        quads   += tiles->_runs[c].size();
+        fetched += tiles->_pixels[c] * mask::tile_fetches[c];
+      }
+
+      char line[160];
+      snprintf(line, sizeof(line), "%-6s  %11.3f  %12.3f  %7.1f  %11.1f  %9.1f  %5zu  %15.1f\n", typeNames[t], tMiss * 1000., tHit * 1e6,
+               100. * tiles->_pixels[mask::TILE_NONE] / total, 100. * tiles->_pixels[mask::TILE_FULL] / total,
+               100. * tiles->_pixels[mask::TILE_PARTIAL] / total, quads,
+               100. - 100. * fetched / (total * mask::tile_fetches[mask::TILE_PARTIAL]));
+      std::cout << line;
+    }
+
+    bench_scene bench(side);
+    if (!bench.valid())
+      return -1;
+
+    Scene& scene = bench._scene;
+    scene.SetBlurMode(Scene::BLUR_SIMPLE);
+
+    const Scene::mask_type maskTypes[] = {Scene::SMOOTH, Scene::EDGE, Scene::PEAK_AT_CENTER};
+
+    std::cout << "blur pass GPU p50 ms\n"
+                 "type    full screen   tiles\n";
+    for (int t = 0; t < 3; t++)
+    {
+      scene.Reconfigure(Scene::Size(side, side), Scene::Size(side, side), maskTypes[t]);
+
+      double ms[2];
+      for (int on = 0; on < 2; on++)
+      {
+        scene.SetMaskTiles(on != 0);
+        ms[on] = runFrames(scene, frames, 2.f * PI / frames)._gpu[profiler::BLUR]._p50;
+      }
+
+      char line[120];
+      snprintf(line, sizeof(line), "%-6s  %11.3f  %6.3f\n", typeNames[t], ms[0], ms[1]);
+      std::cout << line;
+    }
+    return 0;
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// offline benchmarks, started as "Blurred -bench <name> [args]"
+
+namespace bench
+{
+  int run(int argc, char **argv);
+
+  // MB/s of the fscanf loader vs the mapped parallel one, checks both give the same data
+  int loadOBJ(const char *path, int iterations);
+
+  // ACMR/ATVR, overdraw and optimization time for the object and synthetic spheres (after the cache pass,
+  // then after the overdraw pass), no GPU needed
+  int vertexCache(const char *path);
+
+  // float -> packed vertex conversion: scalar vs SSE2 speed, bit equality, quantization error, sizes
+  int vertexFormat(int iterations);
+
+  // separable gaussian: discrete CPU reference vs the shader's merged bilinear taps
+  int blurTaps(int size);
+
+  // cold (parse .obj, build mesh file) vs warm (map mesh file) object loading
+  int meshCache(const char *path, int iterations);
+
+  // blur mask generation per type: reference loop vs SIMD rows on threads vs one replicated row, plus cache hits
+  int masks(int size, int iterations);
+
+  // CPU BLUR_SIMPLE composite: Mpix/s per instruction set and thread count, difference to the shader transcription
+  int maskedBlur(int size, int iterations);
+
+  // frustum culling of random boxes: per-box test vs BVH (build, refit, scalar/SSE2 traversal per thread count)
+  int culling(int count, int iterations);
+
+  // RTT size and mask type changes: full Scene::Load vs Scene::Reconfigure; needs an OpenGL context and the scene resources
+  int reconfigure(int iterations);
+
+  // texture files: decode, mip chain scalar vs SSE2, BC1 compression error and size, cold vs warm load;
+  // a synthetic image is used if path does not exist
+  int textures(const char *path, int iterations);
+
+  // fixed matrix of meshes (obj.obj, generated spheres), RTT and mask sizes, mask types, light and blur
+  // modes, frames at fixed angles; throughput and per-pass p50 go to bench_render.csv, and configurations
+  // slower than baseline by more than tolerance (0.1 = 10%) are reported and make it return 1.
+  // Needs only OpenGL 3.3 in a hidden window, Mesa llvmpipe works (LIBGL_ALWAYS_SOFTWARE=1, X or xvfb-run)
+  int render(int frames, const char *baseline, double tolerance);
+
+  // 100, 1000 .. maxCount small spheres: a draw per instance vs one instanced draw; draw calls,
+  // CPU submission and GPU time of the object pass, frame time
+  int instancing(int maxCount, int frames);
+
+  // BLUR_SEPARABLE, BLUR_PYRAMID and BLUR_COMPUTE at radii 2..64 and two RTT sizes: GPU time of the blur pass;
+  // first how close the compute blur's boxes come to the gaussian of each radius
+  int blurRadii(int frames);
+
+  // LOD chains of the .obj and a 256x512 sphere (levels, errors, build time on 1 and all threads), then both
+  // drawn at each RTT size with LOD thresholds from 'full mesh' to 'coarsest level': triangles submitted,
+  // frame time and GPU time of the object pass
+  int lods(const char *path, int frames);
+
+  // screen tiles of each mask type at 512x512: classification time cold and from the cache, share of pixels
+  // copied / blurred only / blended and texture fetches saved; then GPU time of BLUR_SIMPLE with and without tiles
+  int maskTiles(int frames);
+}
+
+#endif
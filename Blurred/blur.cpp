@@ -0,0 +1,166 @@
+#include "blur.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace blur
+{
+  namespace
+  {
+    inline size_t clampIndex(ptrdiff_t i, size_t size)
+    {
+      return size_t(std::min<ptrdiff_t>(std::max<ptrdiff_t>(i, 0), ptrdiff_t(size) - 1));
+    }
+
+    // one pass along x (stride = channels) or y (stride = w * channels) over the whole image
+    template<typename Sample>
+    void pass(const float *src, size_t w, size_t h, size_t channels, bool vertical, Sample sample, float *dst)
+    {
+      const size_t len = vertical ? h : w;
+      const size_t step = vertical ? w * channels : channels;
+
+      for (size_t y = 0; y < h; y++)
+        for (size_t x = 0; x < w; x++)
+          for (size_t c = 0; c < channels; c++)
+          {
+            const float *line = src + (vertical ? x * channels : y * w * channels) + c;
+            dst[(y * w + x) * channels + c] = sample(line, step, vertical ? y : x, len);
+          }
+    }
+  }
+
+  std::vector<float> gaussianWeights(int radius, float sigma)
+  {
+    assert(radius >= 0 && radius <= max_radius);
+    if (sigma <= 0.f)
+      sigma = std::max(radius / 3.f, 0.5f);
+
+    std::vector<float> weights(radius + 1);
+    float sum = 0.f;
+    for (int i = 0; i <= radius; i++)
+    {
+      weights[i] = std::exp(-float(i * i) / (2.f * sigma * sigma));
+      sum += i == 0 ? weights[i] : 2.f * weights[i];
+    }
+
+    for (auto& w : weights)
+      w /= sum;
+
+    return weights;
+  }
+
+  float pyramidLevel(int radius)
+  {
+    // measured with the progressive upsample: level k blurs with a sigma of about 0.78 * 2^k pixels,
+    // a gaussian of this radius has radius / 3
+    const float level = std::log2(float(std::max(radius, 1)) / 2.34f);
+    return std::min(std::max(level, 1.f), float(pyramid_levels));
+  }
+
+  void boxRadii(int radius, int radii[box_passes])
+  {
+    assert(radius >= 0 && radius <= max_radius);
+    const float sigma = std::max(radius / 3.f, 0.5f); // as gaussianWeights()
+
+    // n boxes of widths wl or wl + 2 (odd) whose variances (w^2 - 1) / 12 add up to sigma^2
+    const int   n      = box_passes;
+    const float ideal  = std::sqrt(12.f * sigma * sigma / n + 1.f);
+    int         wl     = int(std::floor(ideal));
+    if (wl % 2 == 0)
+      wl--;
+    const float mIdeal = (12.f * sigma * sigma - n * wl * wl - 4.f * n * wl - 3.f * n) / (-4.f * wl - 4.f);
+    const int   m      = int(std::round(mIdeal)); // boxes of width wl, the rest are wl + 2
+
+    int sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+      radii[i] = std::max((i < m ? wl : wl + 2) - 1, 0) / 2;
+      if (sum + radii[i] > radius) // rounding never grows the footprint beyond the gaussian's
+        radii[i] = radius - sum;
+      sum += radii[i];
+    }
+
+    // tiny radii round every box down to width 1, which would not blur at all
+    if (radius > 0 && sum == 0)
+      radii[n - 1] = 1;
+  }
+
+  std::vector<float> boxWeights(const int radii[box_passes])
+  {
+    std::vector<float> kernel(1, 1.f); // full kernel, odd size, center in the middle
+    for (int i = 0; i < box_passes; i++)
+    {
+      const int r = radii[i];
+      std::vector<float> next(kernel.size() + 2 * r, 0.f);
+      for (size_t k = 0; k < kernel.size(); k++)
+        for (int j = 0; j <= 2 * r; j++)
+          next[k + j] += kernel[k] / float(2 * r + 1);
+      kernel.swap(next);
+    }
+
+    return std::vector<float>(kernel.begin() + kernel.size() / 2, kernel.end());
+  }
+
+  void linearTaps(const std::vector<float>& weights, std::vector<float>& offsets, std::vector<float>& linWeights)
+  {
+    offsets   .assign(1, 0.f);
+    linWeights.assign(1, weights[0]);
+
+    for (size_t i = 1; i < weights.size(); i += 2)
+    {
+      const float w1 = weights[i];
+      const float w2 = i + 1 < weights.size() ? weights[i + 1] : 0.f;
+      const float w  = w1 + w2;
+
+      offsets   .push_back(w > 0.f ? (i * w1 + (i + 1) * w2) / w : float(i));
+      linWeights.push_back(w);
+    }
+  }
+
+  void separable(const float *src, size_t w, size_t h, size_t channels, const std::vector<float>& weights, float *dst)
+  {
+    auto sample = [&](const float *line, size_t step, size_t pos, size_t len)
+    {
+      float sum = line[pos * step] * weights[0];
+      for (size_t i = 1; i < weights.size(); i++)
+        sum += (line[clampIndex(ptrdiff_t(pos) + ptrdiff_t(i), len) * step] +
+                line[clampIndex(ptrdiff_t(pos) - ptrdiff_t(i), len) * step]) * weights[i];
+      return sum;
+    };
+
+    std::vector<float> tmp(w * h * channels);
+    pass(src,        w, h, channels, false, sample, tmp.data());
+    pass(tmp.data(), w, h, channels, true,  sample, dst);
+  }
+
+  void separableLinear(const float *src, size_t w, size_t h, size_t channels, const std::vector<float>& offsets, const std::vector<float>& linWeights, int subtexelBits, float *dst)
+  {
+    const float subtexel = subtexelBits > 0 ? float(1 << subtexelBits) : 0.f;
+
+    // bilinear fetch at pos + offset, clamp to edge like GL_CLAMP_TO_EDGE
+    auto fetch = [&](const float *line, size_t step, size_t pos, size_t len, float offset)
+    {
+      const float at = pos + offset;
+      const float base = std::floor(at);
+      float frac = at - base;
+      if (subtexel > 0.f)
+        frac = std::floor(frac * subtexel + 0.5f) / subtexel;
+
+      const float a = line[clampIndex(ptrdiff_t(base),     len) * step];
+      const float b = line[clampIndex(ptrdiff_t(base) + 1, len) * step];
+      return a + (b - a) * frac;
+    };
+
+    auto sample = [&](const float *line, size_t step, size_t pos, size_t len)
+    {
+      float sum = line[pos * step] * linWeights[0];
+      for (size_t i = 1; i < offsets.size(); i++)
+        sum += (fetch(line, step, pos, len, offsets[i]) + fetch(line, step, pos, len, -offsets[i])) * linWeights[i];
+      return sum;
+    };
+
+    std::vector<float> tmp(w * h * channels);
+    pass(src,        w, h, channels, false, sample, tmp.data());
+    pass(tmp.data(), w, h, channels, true,  sample, dst);
+  }
+}
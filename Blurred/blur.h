@@ -0,0 +1,46 @@
+#ifndef BLUR_H
+#define BLUR_H
+
+#include <vector>
+#include <cstddef>
+
+// blur kernels shared by the shaders and their CPU reference
+
+namespace blur
+{
+  const int max_radius   = 64;
+  const int max_lin_taps = max_radius / 2 + 1; // must match tapOffsets/tapWeights size in 2D_blur_sep.frag
+  const int pyramid_levels = 5;                // BLUR_PYRAMID downsample levels, RTT / 2 .. RTT / 32
+  const int box_passes   = 3;                  // must match boxRadii in 2D_blur_box.comp
+
+  // one side of a normalized gaussian: w[0] is the center, w[i] applies to offsets +i and -i
+  std::vector<float> gaussianWeights(int radius, float sigma = 0.f); // sigma 0: radius / 3
+
+  // pyramid level (fractional, 1..pyramid_levels) whose dual Kawase blur matches a gaussian
+  // of this radius best; each level halves the resolution, so the footprint doubles
+  float pyramidLevel(int radius);
+
+  // radii of box_passes box filters whose repeated application approximates gaussianWeights(radius);
+  // they add up to at most radius, so the combined kernel is no wider than the gaussian's,
+  // and at least one is non-zero for radius > 0
+  void boxRadii(int radius, int radii[box_passes]);
+
+  // one side of the kernel the boxes combine to, same layout as gaussianWeights();
+  // with separable() it is the CPU reference of the compute blur
+  std::vector<float> boxWeights(const int radii[box_passes]);
+
+  // merges neighbour taps into one bilinear fetch each (offset between the two texels),
+  // center stays at offset 0; radius r needs 1 + ceil(r / 2) entries instead of 1 + r
+  void linearTaps(const std::vector<float>& weights, std::vector<float>& offsets, std::vector<float>& linWeights);
+
+  // CPU reference, float images with 'channels' interleaved values per pixel, clamp to edge.
+  // horizontal then vertical pass with the discrete kernel
+  void separable(const float *src, size_t w, size_t h, size_t channels, const std::vector<float>& weights, float *dst);
+
+  // same, but sampled like the shader does: bilinear fetches at linearTaps() offsets,
+  // interpolation factor rounded to subtexelBits like texture units do (0 keeps it exact)
+  void separableLinear(const float *src, size_t w, size_t h, size_t channels,
+    const std::vector<float>& offsets, const std::vector<float>& linWeights, int subtexelBits, float *dst);
+}
+
+#endif
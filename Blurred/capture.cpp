@@ -0,0 +1,204 @@
+#include "capture.h"
+#include <cassert>
+#include <iostream>
+
+namespace capture
+{
+  namespace
+  {
+    double seconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+      return std::chrono::duration<double>(to - from).count();
+    }
+  }
+
+  FrameCapture::FrameCapture(size_t ringSize, const writer& w)
+    : _slots(ringSize), _toWriter(ringSize), _fromWriter(ringSize), _writer(w), _stop(false)
+  {
+    assert(ringSize > 0);
+    _thread = std::thread(&FrameCapture::writerLoop, this);
+  }
+
+  FrameCapture::~FrameCapture()
+  {
+    finish();
+    release();
+
+    _stop = true;
+    wakeWriter();
+    _thread.join();
+  }
+
+  void FrameCapture::allocate(size_t width, size_t height)
+  {
+    finish();
+    release();
+
+    _width  = width;
+    _height = height;
+    for (auto& s : _slots)
+    {
+      glGenBuffers(1, &s._pbo);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s._pbo);
+      glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  void FrameCapture::release()
+  {
+    assert(_pendingCount == 0 && _inFlight == 0);
+    for (auto& s : _slots)
+    {
+      glDeleteBuffers(1, &s._pbo);
+      s = slot();
+    }
+    _next = _oldestPending = 0;
+  }
+
+  void FrameCapture::capture(GLuint fbo, size_t width, size_t height)
+  {
+    if (width != _width || height != _height)
+      allocate(width, height);
+
+    const clock::time_point start = clock::now();
+    if (!_started)
+    {
+      _first   = start;
+      _started = true;
+    }
+
+    collect(false);
+
+    if (_slots[_next]._state != FREE)
+    {
+      // ring is full: either the GPU or the writer is behind
+      _stats._stalls++;
+      while (_slots[_next]._state != FREE)
+        if (!collect(true))
+          std::this_thread::yield(); // writer still busy with it
+    }
+
+    const clock::time_point issue = clock::now();
+    _stats._wait += seconds(start, issue);
+
+    slot& s = _slots[_next];
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s._pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, GLsizei(width), GLsizei(height), GL_BGRA, GL_UNSIGNED_BYTE, 0); // returns at once, copies to the PBO
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    s._fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s._state  = PENDING;
+    s._frame  = _frameCounter++;
+    s._issued = issue;
+    if (_pendingCount++ == 0)
+      _oldestPending = _next;
+
+    _next = (_next + 1) % _slots.size();
+    _stats._issue += seconds(issue, clock::now());
+    _stats._frames++;
+  }
+
+  bool FrameCapture::collect(bool block)
+  {
+    bool changed = false;
+
+    size_t done = 0;
+    while (_fromWriter.pop(done))
+    {
+      slot& s = _slots[done];
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s._pbo);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      s._pixels = nullptr;
+      s._state  = FREE;
+      _inFlight--;
+      changed = true;
+    }
+
+    // pending slots finish in the order they were issued
+    while (_pendingCount > 0)
+    {
+      slot& s = _slots[_oldestPending];
+      const GLuint64 timeout = block && !changed ? GLuint64(1000000000) : 0; // 1 s
+      const GLenum st = glClientWaitSync(s._fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+      if (st != GL_ALREADY_SIGNALED && st != GL_CONDITION_SATISFIED)
+      {
+        if (st == GL_WAIT_FAILED)
+          std::cerr << "capture: fence wait failed";
+        break;
+      }
+
+      glDeleteSync(s._fence);
+      s._fence = 0;
+
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s._pbo);
+      s._pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, _width * _height * 4, GL_MAP_READ_BIT);
+      s._state  = MAPPED;
+      s._mapped = clock::now();
+      _stats._transfer += seconds(s._issued, s._mapped);
+
+      const bool queued = _toWriter.push(_oldestPending);
+      assert(queued && "writer queue holds the whole ring");
+      (void)queued;
+      wakeWriter();
+
+      _inFlight++;
+      _pendingCount--;
+      _oldestPending = (_oldestPending + 1) % _slots.size();
+      changed = true;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return changed;
+  }
+
+  void FrameCapture::finish()
+  {
+    while (_pendingCount > 0 || _inFlight > 0)
+      if (!collect(true))
+        std::this_thread::yield();
+
+    _stats._write = _writeSeconds;
+    if (_started)
+      _stats._total = seconds(_first, _lastWritten);
+  }
+
+  void FrameCapture::wakeWriter()
+  {
+    {
+      // a writer that just found the queue empty is either waiting already or will see the new state
+      std::lock_guard<std::mutex> lock(_wakeMutex);
+    }
+    _wake.notify_one();
+  }
+
+  void FrameCapture::writerLoop()
+  {
+    size_t ind = 0;
+    while (!_stop)
+    {
+      if (!_toWriter.pop(ind))
+      {
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _wake.wait(lock, [this]() {return _stop || !_toWriter.empty();});
+        continue;
+      }
+
+      const slot& s = _slots[ind];
+      if (s._pixels)
+      {
+        frame f = {s._frame, _width, _height, s._pixels};
+        _writer(f);
+      }
+      else
+        std::cerr << "capture: unable to map frame " << s._frame;
+
+      _lastWritten   = clock::now();
+      _writeSeconds += seconds(s._mapped, _lastWritten);
+
+      _fromWriter.push(ind);
+    }
+  }
+}
@@ -0,0 +1,146 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// asynchronous readback of rendered frames: glReadPixels into a ring of pixel buffer objects,
+// mapped once their fence signals and handed to a writer thread, so frame K's transfer
+// overlaps rendering of frame K+1
+
+namespace capture
+{
+  // bounded single producer / single consumer queue, lock-free; one slot is kept empty
+  template<typename T>
+  class spsc_queue
+  {
+  public:
+    explicit spsc_queue(size_t capacity): _items(capacity + 1), _head(0), _tail(0) {}
+
+    bool push(const T& value) // producer thread only
+    {
+      const size_t head = _head.load(std::memory_order_relaxed);
+      const size_t next = (head + 1) % _items.size();
+      if (next == _tail.load(std::memory_order_acquire))
+        return false;
+
+      _items[head] = value;
+      _head.store(next, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(T& value) // consumer thread only
+    {
+      const size_t tail = _tail.load(std::memory_order_relaxed);
+      if (tail == _head.load(std::memory_order_acquire))
+        return false;
+
+      value = _items[tail];
+      _tail.store((tail + 1) % _items.size(), std::memory_order_release);
+      return true;
+    }
+
+    bool empty() const // consumer thread only
+    {
+      return _tail.load(std::memory_order_relaxed) == _head.load(std::memory_order_acquire);
+    }
+
+  private:
+    std::vector<T>      _items;
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+  };
+
+  // one captured frame as the writer sees it, pixels stay valid during the callback only
+  struct frame
+  {
+    size_t               _index;
+    size_t               _width, _height;
+    const unsigned char *_bgra; // bottom row first
+  };
+
+  struct stats
+  {
+    size_t _frames   = 0;
+    size_t _stalls   = 0;  // capture() found the next buffer busy and had to wait
+    double _issue    = 0.; // seconds summed over frames: glReadPixels + fence on the render thread
+    double _wait     = 0.; // render thread blocked by stalls
+    double _transfer = 0.; // readback issued -> buffer mapped
+    double _write    = 0.; // mapped -> writer callback done
+    double _total    = 0.; // first capture -> last frame written
+  };
+
+  class FrameCapture
+  {
+  public:
+    typedef std::function<void(const frame&)> writer;
+
+    // ringSize pixel buffers in flight, w runs on its own thread in frame order
+    FrameCapture(size_t ringSize, const writer& w);
+    ~FrameCapture();
+
+    // queue a readback of framebuffer fbo (render thread, GL context current)
+    void capture(GLuint fbo, size_t width, size_t height);
+
+    // waits for every queued frame to be written, render thread
+    void finish();
+
+    const stats& GetStats() const {return _stats;} // complete after finish()
+
+  private:
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+
+    typedef std::chrono::steady_clock clock;
+
+    enum slot_state { FREE, PENDING, MAPPED };
+
+    struct slot
+    {
+      GLuint            _pbo   = 0;
+      GLsync            _fence = 0;
+      slot_state        _state = FREE;
+      size_t            _frame = 0;
+      const unsigned char *_pixels = nullptr;
+      clock::time_point _issued, _mapped;
+    };
+
+    void allocate(size_t width, size_t height);
+    void release();
+    bool collect(bool block); // unmaps written slots, maps the oldest signaled ones; true if anything changed
+    void writerLoop();
+    void wakeWriter(); // after queueing a slot or setting _stop
+
+    std::vector<slot>   _slots;
+    size_t              _next = 0;         // slot for the next capture
+    size_t              _oldestPending = 0;
+    size_t              _pendingCount  = 0;
+    size_t              _width = 0, _height = 0;
+    size_t              _frameCounter = 0;
+
+    spsc_queue<size_t>  _toWriter;         // mapped slots
+    spsc_queue<size_t>  _fromWriter;       // written slots, to unmap
+    size_t              _inFlight = 0;     // mapped and not yet returned
+
+    writer              _writer;
+    std::thread         _thread;
+    std::atomic<bool>   _stop;
+    std::mutex          _wakeMutex;        // orders wake-ups against the writer's check of the queue
+    std::condition_variable _wake;
+
+    stats               _stats;
+    double              _writeSeconds = 0.; // writer thread only, merged in finish()
+    clock::time_point   _lastWritten;
+    clock::time_point   _first;
+    bool                _started = false;
+  };
+}
+
+#endif
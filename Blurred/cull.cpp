@@ -0,0 +1,311 @@
+#include "cull.h"
+#include "utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CULL_SSE2
+#endif
+
+namespace cull
+{
+  namespace
+  {
+    const size_t min_jobs = 16; // subtrees handed to threads, for balance
+
+    // below this the thread start-up costs more than the traversal, which is well under a millisecond
+    const size_t min_parallel_boxes = 64 * 1024;
+
+    aabb merge(const aabb& a, const aabb& b)
+    {
+      aabb r;
+      r._min = glm::min(a._min, b._min);
+      r._max = glm::max(a._max, b._max);
+      return r;
+    }
+
+    const aabb empty_box = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+  }
+
+  aabb transform(const aabb& box, const glm::mat4& m)
+  {
+    // Arvo: per axis, the extreme of each matrix term picks min or max of the source box
+    aabb r;
+    r._min = r._max = glm::vec3(m[3]);
+    for (int col = 0; col < 3; col++)
+      for (int row = 0; row < 3; row++)
+      {
+        const float a = m[col][row] * box._min[col];
+        const float b = m[col][row] * box._max[col];
+        r._min[row] += std::min(a, b);
+        r._max[row] += std::max(a, b);
+      }
+    return r;
+  }
+
+  frustum fromMatrix(const glm::mat4& vp)
+  {
+    // Gribb/Hartmann: row 3 +- rows 0..2 of the (column major) matrix
+    frustum f;
+    for (int p = 0; p < 8; p++)
+    {
+      if (p >= 6)
+      {
+        f._nx[p] = f._ny[p] = f._nz[p] = 0.f;
+        f._d[p] = 1.f;
+        continue;
+      }
+
+      const int row = p / 2;
+      const float sign = p % 2 == 0 ? 1.f : -1.f;
+      f._nx[p] = vp[0][3] + sign * vp[0][row];
+      f._ny[p] = vp[1][3] + sign * vp[1][row];
+      f._nz[p] = vp[2][3] + sign * vp[2][row];
+      f._d [p] = vp[3][3] + sign * vp[3][row];
+    }
+    return f;
+  }
+
+  result test(const frustum& f, const aabb& box, bool simd)
+  {
+    // per plane: the corner furthest along the normal (p) decides outside,
+    // the nearest one (n) decides fully inside
+#ifdef CULL_SSE2
+    if (simd)
+    {
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 minX = _mm_set1_ps(box._min.x), minY = _mm_set1_ps(box._min.y), minZ = _mm_set1_ps(box._min.z);
+      const __m128 maxX = _mm_set1_ps(box._max.x), maxY = _mm_set1_ps(box._max.y), maxZ = _mm_set1_ps(box._max.z);
+
+      auto select = [](__m128 mask, __m128 a, __m128 b) {return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));};
+
+      bool inside = true;
+      for (int g = 0; g < 8; g += 4)
+      {
+        const __m128 nx = _mm_loadu_ps(f._nx + g), ny = _mm_loadu_ps(f._ny + g), nz = _mm_loadu_ps(f._nz + g);
+        const __m128 d  = _mm_loadu_ps(f._d + g);
+        const __m128 sx = _mm_cmpge_ps(nx, zero), sy = _mm_cmpge_ps(ny, zero), sz = _mm_cmpge_ps(nz, zero);
+
+        const __m128 pDist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, select(sx, maxX, minX)),
+                                                              _mm_mul_ps(ny, select(sy, maxY, minY))),
+                                                   _mm_mul_ps(nz, select(sz, maxZ, minZ))), d);
+        if (_mm_movemask_ps(_mm_cmplt_ps(pDist, zero)) != 0)
+          return OUTSIDE;
+
+        const __m128 nDist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, select(sx, minX, maxX)),
+                                                              _mm_mul_ps(ny, select(sy, minY, maxY))),
+                                                   _mm_mul_ps(nz, select(sz, minZ, maxZ))), d);
+        inside = inside && _mm_movemask_ps(_mm_cmplt_ps(nDist, zero)) == 0;
+      }
+      return inside ? INSIDE : INTERSECTS;
+    }
+#else
+    (void)simd;
+#endif
+
+    bool inside = true;
+    for (int p = 0; p < 8; p++)
+    {
+      const bool sx = f._nx[p] >= 0.f, sy = f._ny[p] >= 0.f, sz = f._nz[p] >= 0.f;
+      const float pDist = f._nx[p] * (sx ? box._max.x : box._min.x) + f._ny[p] * (sy ? box._max.y : box._min.y)
+                        + f._nz[p] * (sz ? box._max.z : box._min.z) + f._d[p];
+      if (pDist < 0.f)
+        return OUTSIDE;
+
+      const float nDist = f._nx[p] * (sx ? box._min.x : box._max.x) + f._ny[p] * (sy ? box._min.y : box._max.y)
+                        + f._nz[p] * (sz ? box._min.z : box._max.z) + f._d[p];
+      inside = inside && nDist >= 0.f;
+    }
+    return inside ? INSIDE : INTERSECTS;
+  }
+
+  void BVH::build(const std::vector<aabb>& boxes, size_t leafSize)
+  {
+    assert(boxes.size() < UINT32_MAX && leafSize > 0);
+
+    _nodes.clear();
+    _items.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++)
+      _items[i] = uint32_t(i);
+
+    _boxes.clear();
+    if (boxes.empty())
+      return;
+
+    _nodes.reserve(2 * (boxes.size() / leafSize + 1));
+    buildNode(boxes, 0, boxes.size(), leafSize);
+
+    _boxes.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++)
+      _boxes[i] = boxes[_items[i]];
+  }
+
+  uint32_t BVH::buildNode(const std::vector<aabb>& boxes, size_t first, size_t count, size_t leafSize)
+  {
+    const uint32_t index = uint32_t(_nodes.size());
+    _nodes.push_back(node());
+
+    aabb bounds = empty_box, centers = empty_box;
+    for (size_t i = first; i < first + count; i++)
+    {
+      const aabb& b = boxes[_items[i]];
+      bounds = merge(bounds, b);
+      const glm::vec3 c = (b._min + b._max) * 0.5f;
+      centers = merge(centers, aabb{c, c});
+    }
+
+    node n;
+    for (int a = 0; a < 3; a++)
+    {
+      n._min[a] = bounds._min[a];
+      n._max[a] = bounds._max[a];
+    }
+
+    if (count <= leafSize)
+    {
+      n._offset = uint32_t(first);
+      n._count  = uint32_t(count);
+      _nodes[index] = n;
+      return index;
+    }
+
+    const glm::vec3 extent = centers._max - centers._min;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    const size_t half = count / 2;
+    std::nth_element(_items.begin() + first, _items.begin() + first + half, _items.begin() + first + count,
+      [&boxes, axis](uint32_t a, uint32_t b) {return boxes[a]._min[axis] + boxes[a]._max[axis] < boxes[b]._min[axis] + boxes[b]._max[axis];});
+
+    buildNode(boxes, first, half, leafSize); // left child is index + 1
+    n._offset = buildNode(boxes, first + half, count - half, leafSize);
+    n._count  = 0;
+    _nodes[index] = n;
+    return index;
+  }
+
+  void BVH::refit(const std::vector<aabb>& boxes)
+  {
+    assert(boxes.size() == _items.size() && "refit needs the boxes the tree was built from");
+
+    for (size_t i = 0; i < _items.size(); i++)
+      _boxes[i] = boxes[_items[i]];
+
+    // children always come after their parent
+    for (size_t i = _nodes.size(); i-- > 0; )
+    {
+      node& n = _nodes[i];
+      aabb bounds = empty_box;
+      if (n._count > 0)
+        for (uint32_t k = n._offset; k < n._offset + n._count; k++)
+          bounds = merge(bounds, _boxes[k]);
+      else
+      {
+        const node& l = _nodes[i + 1], &r = _nodes[n._offset];
+        bounds = merge(aabb{glm::vec3(l._min[0], l._min[1], l._min[2]), glm::vec3(l._max[0], l._max[1], l._max[2])},
+                       aabb{glm::vec3(r._min[0], r._min[1], r._min[2]), glm::vec3(r._max[0], r._max[1], r._max[2])});
+      }
+
+      for (int a = 0; a < 3; a++)
+      {
+        n._min[a] = bounds._min[a];
+        n._max[a] = bounds._max[a];
+      }
+    }
+  }
+
+  void BVH::collect(uint32_t root, std::vector<uint32_t>& out) const
+  {
+    // a subtree's leaves cover one contiguous range of _items: from its leftmost to its rightmost leaf
+    uint32_t first = root, last = root;
+    while (_nodes[first]._count == 0)
+      first = first + 1;
+    while (_nodes[last]._count == 0)
+      last = _nodes[last]._offset;
+
+    const uint32_t begin = _nodes[first]._offset, end = _nodes[last]._offset + _nodes[last]._count;
+    out.insert(out.end(), _items.begin() + begin, _items.begin() + end);
+  }
+
+  void BVH::traverse(uint32_t root, const frustum& f, bool simd, std::vector<uint32_t>& out) const
+  {
+    uint32_t stack[64];
+    size_t   top = 0;
+    stack[top++] = root;
+
+    while (top > 0)
+    {
+      const uint32_t i = stack[--top];
+      const node& n = _nodes[i];
+      const aabb box = {glm::vec3(n._min[0], n._min[1], n._min[2]), glm::vec3(n._max[0], n._max[1], n._max[2])};
+
+      const result r = test(f, box, simd);
+      if (r == OUTSIDE)
+        continue;
+
+      if (r == INSIDE)
+        collect(i, out);
+      else if (n._count > 0)
+      {
+        for (uint32_t k = n._offset; k < n._offset + n._count; k++)
+          if (test(f, _boxes[k], simd) != OUTSIDE)
+            out.push_back(_items[k]);
+      }
+      else
+      {
+        assert(top + 2 <= 64 && "BVH too deep");
+        stack[top++] = n._offset;
+        stack[top++] = i + 1;
+      }
+    }
+  }
+
+  void BVH::cull(const frustum& f, std::vector<uint32_t>& visible, bool simd, size_t threads) const
+  {
+    visible.clear();
+    if (_nodes.empty())
+      return;
+
+    if (threads == 1 || _items.size() < min_parallel_boxes)
+    {
+      traverse(0, f, simd, visible);
+      std::sort(visible.begin(), visible.end());
+      return;
+    }
+
+    // split the top of the tree into subtrees, each a job; inner nodes on the way are tested here
+    std::vector<uint32_t> roots(1, 0), next;
+    while (roots.size() < min_jobs)
+    {
+      next.clear();
+      bool split = false;
+      for (uint32_t i : roots)
+      {
+        const node& n = _nodes[i];
+        const aabb box = {glm::vec3(n._min[0], n._min[1], n._min[2]), glm::vec3(n._max[0], n._max[1], n._max[2])};
+        const result r = n._count == 0 ? test(f, box, simd) : INTERSECTS;
+        if (r == OUTSIDE)
+          continue;
+
+        if (n._count == 0 && r == INTERSECTS)
+        {
+          next.push_back(i + 1);
+          next.push_back(n._offset);
+          split = true;
+        }
+        else
+          next.push_back(i);
+      }
+      roots.swap(next);
+      if (!split)
+        break;
+    }
+
+    std::vector<std::vector<uint32_t>> found(roots.size());
+    utils::parallel_for(roots.size(), [&](size_t job) {traverse(roots[job], f, simd, found[job]);}, threads);
+
+    for (const std::vector<uint32_t>& part : found)
+      visible.insert(visible.end(), part.begin(), part.end());
+    std::sort(visible.begin(), visible.end());
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// view frustum culling of many boxes: a flat bounding volume hierarchy that can be refit
+// when the boxes move, traversed with SSE plane tests, on parallel_for threads for large trees
+
+namespace cull
+{
+  struct aabb
+  {
+    glm::vec3 _min, _max;
+  };
+
+  // box around m applied to every corner of box
+  aabb transform(const aabb& box, const glm::mat4& m);
+
+  // the 6 planes of a view-projection matrix (GL clip space), normals pointing inside
+  struct frustum
+  {
+    // structure of arrays, planes 6 and 7 pass everything
+    float _nx[8], _ny[8], _nz[8], _d[8];
+  };
+
+  frustum fromMatrix(const glm::mat4& vp);
+
+  enum result { OUTSIDE, INTERSECTS, INSIDE };
+
+  result test(const frustum& f, const aabb& box, bool simd = true); // both paths give the same result
+
+  class BVH
+  {
+  public:
+    // leafSize boxes at most per leaf, split at the median of the longest axis
+    void build(const std::vector<aabb>& boxes, size_t leafSize = 4);
+
+    // same boxes moved: bounds are recomputed bottom-up, the tree shape stays
+    void refit(const std::vector<aabb>& boxes);
+
+    // indices of the boxes inside or crossing f, ascending, exactly those test() keeps unless a whole
+    // subtree is inside; subtrees go to `threads` threads (0: all cores), trees under 64k boxes
+    // are walked serially since parallel_for starts its threads on every call
+    void cull(const frustum& f, std::vector<uint32_t>& visible, bool simd = true, size_t threads = 0) const;
+
+    size_t nodeCount() const {return _nodes.size();}
+    size_t boxCount()  const {return _items.size();}
+
+  private:
+    // 32 bytes; children of an inner node are the next node and node _offset
+    struct node
+    {
+      float    _min[3];
+      uint32_t _offset; // leaf: first entry of _items, inner: right child
+      float    _max[3];
+      uint32_t _count;  // leaf: box count, inner: 0
+    };
+
+    uint32_t buildNode(const std::vector<aabb>& boxes, size_t first, size_t count, size_t leafSize);
+    void     collect(uint32_t root, std::vector<uint32_t>& out) const; // every box below root
+    void     traverse(uint32_t root, const frustum& f, bool simd, std::vector<uint32_t>& out) const;
+
+    std::vector<node>     _nodes;
+    std::vector<uint32_t> _items; // box indices, leaves refer to ranges of it
+    std::vector<aabb>     _boxes; // boxes in _items order, tested one by one in crossed leaves
+  };
+}
+
+#endif
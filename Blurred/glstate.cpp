@@ -0,0 +1,306 @@
+#include "glstate.h"
+#include "utils.h"
+#include "programcache.h"
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace gl
+{
+  namespace
+  {
+    const char* const uniform_names[UNIFORM_COUNT] =
+    {
+      "MVP", "V", "M", "LightPosition_worldspace", "LightPower", "Light_On", "currTex", "maskTex",
+      "baseTex", "blurStep", "tapCount", "tapOffsets", "tapWeights", "composite",
+      "pyramidTex", "halfpixel", "maxLevel", "VP", "Instanced", "MaterialTint", "boxRadii", "level"
+    };
+  }
+
+  const char* uniformName(uniform u)
+  {
+    return uniform_names[u];
+  }
+
+  bool loadProgram(const char *vertex_file_path, const char *fragment_file_path, program& p)
+  {
+    program_build b;
+    return beginProgram(vertex_file_path, fragment_file_path, b) && finishProgram(b, p);
+  }
+
+  void enableParallelCompile()
+  {
+    if (GLEW_ARB_parallel_shader_compile)
+      glMaxShaderCompilerThreadsARB(0xFFFFFFFF); // implementation decides
+  }
+
+  namespace
+  {
+    typedef std::chrono::steady_clock build_clock;
+
+    double seconds(build_clock::time_point from)
+    {
+      return std::chrono::duration<double>(build_clock::now() - from).count();
+    }
+
+    GLuint compile(GLenum type, const std::string& source)
+    {
+      GLuint id = glCreateShader(type);
+      const char *sourcePointer = source.c_str();
+      glShaderSource(id, 1, &sourcePointer, NULL);
+      glCompileShader(id);
+      return id;
+    }
+
+    // prints the info log if status is false
+    template<typename Get, typename Log>
+    bool check(GLuint id, GLenum status, Get get, Log log, const std::string& name)
+    {
+      GLint result = GL_FALSE, length = 0;
+      get(id, status, &result);
+      if (result == GL_TRUE)
+        return true;
+
+      get(id, GL_INFO_LOG_LENGTH, &length);
+      std::vector<char> message(length + 1);
+      log(id, length, NULL, message.data());
+      std::cerr << name << ": shader error: " << message.data();
+      return false;
+    }
+  }
+
+  bool beginProgram(const char *vertex_file_path, const char *fragment_file_path, program_build& b, ProgramCache *cache)
+  {
+    b._name  = std::string(vertex_file_path) + " + " + fragment_file_path;
+    b._cache = cache;
+
+    std::string vertexSource, fragmentSource;
+    if (!utils::readFile(vertex_file_path, vertexSource) || !utils::readFile(fragment_file_path, fragmentSource))
+      return false;
+
+    if (cache && cache->enabled())
+    {
+      b._key = cache->key(vertexSource, fragmentSource);
+      b._id  = cache->load(b._key);
+      if (b._id)
+        return true;
+    }
+
+    const build_clock::time_point start = build_clock::now();
+    b._vs = compile(GL_VERTEX_SHADER,   vertexSource);
+    b._fs = compile(GL_FRAGMENT_SHADER, fragmentSource);
+
+    // linking a failed compile just fails the link, errors are reported by finishProgram
+    b._id = glCreateProgram();
+    glAttachShader(b._id, b._vs);
+    glAttachShader(b._id, b._fs);
+    if (cache && cache->enabled())
+      glProgramParameteri(b._id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(b._id);
+    b._seconds += seconds(start);
+    return true;
+  }
+
+  bool beginComputeProgram(const char *compute_file_path, program_build& b, ProgramCache *cache)
+  {
+    b._name  = compute_file_path;
+    b._cache = cache;
+
+    std::string computeSource;
+    if (!utils::readFile(compute_file_path, computeSource))
+      return false;
+
+    if (cache && cache->enabled())
+    {
+      b._key = cache->key(computeSource, std::string());
+      b._id  = cache->load(b._key);
+      if (b._id)
+        return true;
+    }
+
+    const build_clock::time_point start = build_clock::now();
+    b._vs = compile(GL_COMPUTE_SHADER, computeSource);
+
+    b._id = glCreateProgram();
+    glAttachShader(b._id, b._vs);
+    if (cache && cache->enabled())
+      glProgramParameteri(b._id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(b._id);
+    b._seconds += seconds(start);
+    return true;
+  }
+
+  bool programReady(const program_build& b)
+  {
+    if (!b._vs || !GLEW_ARB_parallel_shader_compile) // binaries from the cache are linked already
+      return true;
+
+    GLint done = GL_FALSE;
+    glGetProgramiv(b._id, GL_COMPLETION_STATUS_ARB, &done);
+    return done == GL_TRUE;
+  }
+
+  bool finishProgram(program_build& b, program& p)
+  {
+    if (!b._vs) // from the cache
+    {
+      p._id = b._id;
+      reflect(p);
+      return true;
+    }
+
+    // the first status query waits for a compile or link the driver has not finished yet
+    const build_clock::time_point start = build_clock::now();
+    const bool ok = check(b._vs, GL_COMPILE_STATUS, glGetShaderiv,  glGetShaderInfoLog,  b._name) &&
+                    (!b._fs || check(b._fs, GL_COMPILE_STATUS, glGetShaderiv, glGetShaderInfoLog, b._name)) &&
+                    check(b._id, GL_LINK_STATUS,    glGetProgramiv, glGetProgramInfoLog, b._name);
+    b._seconds += seconds(start);
+
+    glDetachShader(b._id, b._vs);
+    glDeleteShader(b._vs);
+    if (b._fs)
+    {
+      glDetachShader(b._id, b._fs);
+      glDeleteShader(b._fs);
+    }
+    b._vs = b._fs = 0;
+
+    if (!ok)
+    {
+      glDeleteProgram(b._id);
+      b._id = 0;
+      return false;
+    }
+
+    if (b._cache)
+      b._cache->store(b._key, b._id, b._seconds);
+
+    p._id = b._id;
+    reflect(p);
+    return true;
+  }
+
+  void reflect(program& p)
+  {
+    for (auto& location : p._uniforms)
+      location = -1;
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(p._id, GL_ACTIVE_UNIFORMS,           &count);
+    glGetProgramiv(p._id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> name(maxLength + 1);
+    for (GLint i = 0; i < count; i++)
+    {
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(p._id, GLuint(i), GLsizei(name.size()), nullptr, &size, &type, name.data());
+
+      const GLint location = glGetUniformLocation(p._id, name.data());
+
+      char *subscript = strstr(name.data(), "[0]"); // arrays are reported as "name[0]"
+      if (subscript)
+        *subscript = 0;
+
+      for (int u = 0; u < UNIFORM_COUNT; u++)
+        if (strcmp(name.data(), uniform_names[u]) == 0)
+          p._uniforms[u] = location;
+    }
+  }
+
+  void deleteProgram(program& p)
+  {
+    glDeleteProgram(p._id);
+    p._id = 0;
+  }
+
+  void setDefaults()
+  {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glDepthFunc(GL_LESS);
+
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  }
+
+  bool StateCache::changed(GLuint& current, GLuint value)
+  {
+    if (current == value)
+    {
+      _frame._skipped++;
+      return false;
+    }
+
+    current = value;
+    _frame._issued++;
+    return true;
+  }
+
+  void StateCache::useProgram(GLuint id)
+  {
+    if (changed(_program, id))
+      glUseProgram(id);
+  }
+
+  void StateCache::activeTexture(GLuint unit)
+  {
+    assert(unit < texture_units);
+    if (changed(_activeUnit, unit))
+      glActiveTexture(GL_TEXTURE0 + unit);
+  }
+
+  void StateCache::bindTexture(GLuint unit, GLuint tex)
+  {
+    assert(unit < texture_units);
+    if (_textures[unit] == tex)
+    {
+      _frame._skipped++;
+      return;
+    }
+
+    // only the GL calls made are counted: a unit that is already active is not a skipped call of the caller's
+    if (_activeUnit != unit)
+    {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      _activeUnit = unit;
+      _frame._issued++;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, tex);
+    _textures[unit] = tex;
+    _frame._issued++;
+  }
+
+  void StateCache::bindVertexArray(GLuint vao)
+  {
+    if (changed(_vao, vao))
+      glBindVertexArray(vao);
+  }
+
+  void StateCache::bindFramebuffer(GLuint fbo)
+  {
+    if (changed(_framebuffer, fbo))
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  }
+
+  void StateCache::invalidate()
+  {
+    _program     = unknown;
+    _activeUnit  = unknown;
+    _vao         = unknown;
+    _framebuffer = unknown;
+    for (auto& tex : _textures)
+      tex = unknown;
+  }
+
+  void StateCache::beginFrame()
+  {
+    _lastFrame = _frame;
+    _frame = counters();
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <string>
+#include <cstdint>
+
+namespace gl
+{
+  // every uniform used by the scene shaders; program::_uniforms is indexed by these
+  enum uniform
+  {
+    U_MVP, U_V, U_M, U_LIGHT_POSITION, U_LIGHT_POWER, U_LIGHT_ON, U_CURR_TEX, U_MASK_TEX,
+    U_BASE_TEX, U_BLUR_STEP, U_TAP_COUNT, U_TAP_OFFSETS, U_TAP_WEIGHTS, U_COMPOSITE,
+    U_PYRAMID_TEX, U_HALF_PIXEL, U_MAX_LEVEL, U_VP, U_INSTANCED, U_MATERIAL_TINT, U_BOX_RADII, U_LEVEL,
+    UNIFORM_COUNT
+  };
+
+  const char* uniformName(uniform u);
+
+  struct program
+  {
+    GLuint _id = 0;
+    GLint  _uniforms[UNIFORM_COUNT]; // -1 if not active in this program, arrays: location of [0]
+
+    GLint operator[](uniform u) const {return _uniforms[u];}
+  };
+
+  // compile + link, then all active uniforms are looked up once
+  bool loadProgram(const char *vertex_file_path, const char *fragment_file_path, program& p);
+
+  class ProgramCache;
+
+  // non-blocking variant: beginProgram submits compile and link without reading any status,
+  // programReady polls GL_COMPLETION_STATUS_ARB when the driver compiles in parallel (always true otherwise),
+  // finishProgram checks the logs and reflects; with a cache, a stored binary replaces compile and link,
+  // and newly linked programs are stored
+  struct program_build
+  {
+    GLuint        _vs = 0, _fs = 0, _id = 0; // compute programs: the compute shader in _vs, no _fs
+    std::string   _name;            // for error messages
+    ProgramCache *_cache = nullptr;
+    uint64_t      _key   = 0;
+    double        _seconds = 0.;    // GL thread time in compile, link and their status checks, not the work in between
+  };
+
+  void enableParallelCompile(); // GL_ARB_parallel_shader_compile with as many driver threads as it likes
+  bool beginProgram(const char *vertex_file_path, const char *fragment_file_path, program_build& b, ProgramCache *cache = nullptr);
+  bool beginComputeProgram(const char *compute_file_path, program_build& b, ProgramCache *cache = nullptr); // needs GL 4.3
+  bool programReady(const program_build& b);
+  bool finishProgram(program_build& b, program& p);
+  void reflect(program& p);
+  void deleteProgram(program& p);
+
+  // blending, depth test and culling as the scene expects them, once per context
+  void setDefaults();
+
+  // drops binds that would not change the current GL state;
+  // anything binding behind its back must call invalidate()
+  class StateCache
+  {
+  public:
+    struct counters
+    {
+      size_t _issued  = 0;
+      size_t _skipped = 0;
+    };
+
+    StateCache() {invalidate();}
+
+    void useProgram     (GLuint id);
+    void activeTexture  (GLuint unit);
+    void bindTexture    (GLuint unit, GLuint tex); // GL_TEXTURE_2D
+    void bindVertexArray(GLuint vao);
+    void bindFramebuffer(GLuint fbo);
+
+    void invalidate();
+
+    void beginFrame(); // moves current counters to lastFrame()
+    const counters& lastFrame() const {return _lastFrame;}
+
+  private:
+    static const GLuint unknown = ~0u;
+    static const size_t texture_units = 8;
+
+    bool changed(GLuint& current, GLuint value);
+
+    GLuint _program;
+    GLuint _activeUnit;
+    GLuint _textures[texture_units];
+    GLuint _vao;
+    GLuint _framebuffer;
+
+    counters _frame, _lastFrame;
+  };
+}
+
+#endif
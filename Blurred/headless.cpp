@@ -0,0 +1,392 @@
+#include "headless.h"
+#include "glstate.h"
+#include "utils.h"
+#include "capture.h"
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace headless
+{
+  namespace
+  {
+    typedef std::chrono::steady_clock headless_clock;
+
+    double seconds(headless_clock::time_point from)
+    {
+      return std::chrono::duration<double>(headless_clock::now() - from).count();
+    }
+
+    // "640x480"
+    bool parseSize(const char *s, size_t& w, size_t& h)
+    {
+      unsigned int x = 0, y = 0;
+      if (sscanf(s, "%ux%u", &x, &y) != 2 || x == 0 || y == 0)
+        return false;
+
+      w = x;
+      h = y;
+      return true;
+    }
+
+    // the -out pattern goes to snprintf: exactly one %d or %0Nd (N up to 2 digits), %% for a percent sign
+    bool checkPattern(const std::string& pattern)
+    {
+      int conversions = 0;
+      for (size_t i = 0; i < pattern.size(); i++)
+      {
+        if (pattern[i] != '%')
+          continue;
+
+        if (++i < pattern.size() && pattern[i] == '%')
+          continue;
+
+        if (i < pattern.size() && pattern[i] == '0')
+        {
+          size_t digits = 0;
+          while (++i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9')
+            digits++;
+          if (digits == 0 || digits > 2)
+            return false;
+        }
+
+        if (i >= pattern.size() || pattern[i] != 'd' || ++conversions > 1)
+          return false;
+      }
+      return conversions == 1;
+    }
+
+    bool writeFrame(const std::string& pattern, size_t index, size_t w, size_t h, const void *bgra)
+    {
+      if (pattern.empty())
+        return true;
+      if (!checkPattern(pattern)) // parse() rejects these already, the writer thread must never format one
+        return false;
+
+      std::vector<char> fileName(pattern.size() + 128);
+      snprintf(fileName.data(), fileName.size(), pattern.c_str(), int(index));
+      return utils::saveImage(fileName.data(), w, h, bgra);
+    }
+
+    void setFrameAngle(const options& o, Scene& scene, int frame)
+    {
+      const float degrees = o._angle + o._angleStep * frame;
+      scene.SetAngle(degrees * 3.141592f / 180.f);
+    }
+
+    // each stage waits for the previous one: render, glFinish, glReadPixels to memory, write
+    int renderSync(const options& o, Scene& scene, GLuint fbo)
+    {
+      std::vector<unsigned char> pixels(o._width * o._height * 4);
+
+      double tRender = 0., tRead = 0., tWrite = 0.;
+      headless_clock::time_point batchStart = headless_clock::now();
+      for (int frame = 0; frame < o._frames; frame++)
+      {
+        setFrameAngle(o, scene, frame);
+
+        headless_clock::time_point start = headless_clock::now();
+        scene.Frame();
+        glFinish(); // time the GPU work, not just its submission
+        tRender += seconds(start);
+
+        start = headless_clock::now();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, GLsizei(o._width), GLsizei(o._height), GL_BGRA, GL_UNSIGNED_BYTE, pixels.data());
+        tRead += seconds(start);
+
+        start = headless_clock::now();
+        if (!writeFrame(o._output, frame, o._width, o._height, pixels.data()))
+          return -1;
+        tWrite += seconds(start);
+      }
+      const double tTotal = seconds(batchStart);
+
+      const double frames = o._frames;
+      std::cout << "synchronous readback\n"
+                << "  render   " << tRender * 1000. / frames << " ms/frame, " << frames / tRender << " FPS\n"
+                << "  readback " << tRead   * 1000. / frames << " ms/frame\n"
+                << "  write    " << tWrite  * 1000. / frames << " ms/frame\n"
+                << "  total    " << frames / tTotal << " FPS\n";
+      return 0;
+    }
+
+    // readbacks go through a ring of o._async PBOs, files are written on the capture thread
+    int renderAsync(const options& o, Scene& scene)
+    {
+      std::atomic<bool> failed(false);
+      std::shared_ptr<capture::FrameCapture> frameCapture = std::make_shared<capture::FrameCapture>(size_t(o._async),
+        [&](const capture::frame& f)
+        {
+          if (!writeFrame(o._output, f._index, f._width, f._height, f._bgra))
+            failed = true;
+        });
+      scene.SetCapture(frameCapture);
+
+      headless_clock::time_point batchStart = headless_clock::now();
+      for (int frame = 0; frame < o._frames && !failed; frame++)
+      {
+        setFrameAngle(o, scene, frame);
+        scene.Frame();
+      }
+      const double tSubmit = seconds(batchStart);
+
+      frameCapture->finish();
+      scene.SetCapture(nullptr);
+      const double tTotal = seconds(batchStart);
+
+      const capture::stats& st = frameCapture->GetStats();
+      const double frames = double(st._frames);
+      std::cout << "asynchronous readback, " << o._async << " buffers\n"
+                << "  render   " << tSubmit * 1000. / frames << " ms/frame incl. readback issue, " << frames / tSubmit << " FPS\n"
+                << "  issue    " << st._issue    * 1000. / frames << " ms/frame\n"
+                << "  stalls   " << st._stalls << " frames, " << st._wait * 1000. << " ms waiting for a free buffer\n"
+                << "  transfer " << st._transfer * 1000. / frames << " ms latency (issue -> mapped)\n"
+                << "  write    " << st._write    * 1000. / frames << " ms latency (mapped -> written)\n"
+                << "  total    " << frames / tTotal << " FPS\n";
+      return failed ? -1 : 0;
+    }
+
+    // color + depth renderbuffers the final blur pass draws to instead of the window
+    struct target
+    {
+      GLuint _fbo = 0, _color = 0, _depth = 0;
+
+      bool create(size_t w, size_t h)
+      {
+        glGenFramebuffers(1, &_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+
+        glGenRenderbuffers(1, &_color);
+        glBindRenderbuffer(GL_RENDERBUFFER, _color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, GLsizei(w), GLsizei(h));
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _color);
+
+        glGenRenderbuffers(1, &_depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, _depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, GLsizei(w), GLsizei(h));
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depth);
+
+        GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+        glDrawBuffers(1, &drawBuffer);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+        auto st = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (st != GL_FRAMEBUFFER_COMPLETE)
+        {
+          std::cerr << "offscreen framebuffer error: " << st;
+          return false;
+        }
+        return true;
+      }
+
+      ~target()
+      {
+        glDeleteFramebuffers (1, &_fbo);
+        glDeleteRenderbuffers(1, &_color);
+        glDeleteRenderbuffers(1, &_depth);
+      }
+    };
+  }
+
+  void usage()
+  {
+    std::cerr << "usage: Blurred -headless [options]\n"
+                 "  -size WxH          output resolution (512x512)\n"
+                 "  -rtt WxH           render target resolution (output size)\n"
+                 "  -frames N          frames to render (60)\n"
+                 "  -angle A           first frame angle, degrees (0)\n"
+                 "  -step A            angle between frames, degrees (6)\n"
+                 "  -mask smooth|edge|peak\n"
+                 "  -blur simple|separable|pyramid|compute\n"
+                 "  -radius R          blur radius, all but simple (16)\n"
+                 "  -nolight\n"
+                 "  -bc1               BC1 compressed textures (opaque images only)\n"
+                 "  -async N           read back through a ring of N pixel buffers, written on another thread (3, 0: synchronous)\n"
+                 "  -out PATTERN       file name with one %d or %0Nd for the frame number, %% for a percent sign\n"
+                 "                     (frame_%04d.png), \"\" to skip writing\n"
+                 "  -profile FILE      write per-pass timing percentiles, FILE.json or FILE.csv\n";
+  }
+
+  bool parse(int argc, char **argv, options& o)
+  {
+    for (int i = 0; i < argc; i++)
+    {
+      const std::string name = argv[i];
+      if (name == "-nolight")
+      {
+        o._lightOn = false;
+        continue;
+      }
+      if (name == "-bc1")
+      {
+        o._bc1 = true;
+        continue;
+      }
+
+      if (i + 1 >= argc)
+      {
+        std::cerr << "missing value for " << name << "\n";
+        return false;
+      }
+      const char *value = argv[++i];
+
+      bool ok = true;
+      if (name == "-size")
+        ok = parseSize(value, o._width, o._height);
+      else if (name == "-rtt")
+        ok = parseSize(value, o._rttWidth, o._rttHeight);
+      else if (name == "-frames")
+        ok = (o._frames = std::atoi(value)) > 0;
+      else if (name == "-angle")
+        o._angle = float(std::atof(value));
+      else if (name == "-step")
+        o._angleStep = float(std::atof(value));
+      else if (name == "-radius")
+        ok = (o._blurRadius = std::atoi(value)) > 0;
+      else if (name == "-async")
+        ok = (o._async = std::atoi(value)) >= 0;
+      else if (name == "-out")
+        ok = (o._output = value).empty() || checkPattern(o._output);
+      else if (name == "-profile")
+        o._profile = value;
+      else if (name == "-mask")
+      {
+        if      (strcmp(value, "smooth") == 0) o._mask = Scene::SMOOTH;
+        else if (strcmp(value, "edge")   == 0) o._mask = Scene::EDGE;
+        else if (strcmp(value, "peak")   == 0) o._mask = Scene::PEAK_AT_CENTER;
+        else ok = false;
+      }
+      else if (name == "-blur")
+      {
+        if      (strcmp(value, "simple")    == 0) o._blur = Scene::BLUR_SIMPLE;
+        else if (strcmp(value, "separable") == 0) o._blur = Scene::BLUR_SEPARABLE;
+        else if (strcmp(value, "pyramid")   == 0) o._blur = Scene::BLUR_PYRAMID;
+        else if (strcmp(value, "compute")   == 0) o._blur = Scene::BLUR_COMPUTE;
+        else ok = false;
+      }
+      else
+      {
+        std::cerr << "unknown option " << name << "\n";
+        return false;
+      }
+
+      if (!ok)
+      {
+        std::cerr << "bad value '" << value << "' for " << name << "\n";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int run(int argc, char **argv)
+  {
+    options o;
+    if (!parse(argc, argv, o))
+    {
+      usage();
+      return -1;
+    }
+    return run(o);
+  }
+
+  Context::Context(size_t width, size_t height)
+  {
+    if (glfwInit() != GL_TRUE)
+    {
+      std::cerr << "glfwInit failed";
+      return;
+    }
+
+    // a hidden window only provides the context, everything is drawn to offscreen targets
+    glfwWindowHint(GLFW_VISIBLE,   GL_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(int(width), int(height), "Blurred (headless)", NULL, NULL);
+    if (!window)
+    {
+      std::cerr << "unable to create an OpenGL context";
+      glfwTerminate();
+      return;
+    }
+    glfwMakeContextCurrent(window);
+
+    GLenum init_result = glewInit();
+    if (init_result != GLEW_OK)
+    {
+      std::cerr << "glew init error : " << glewGetErrorString(init_result);
+      glfwDestroyWindow(window);
+      glfwTerminate();
+      return;
+    }
+
+    gl::setDefaults();
+    _window = window;
+  }
+
+  Context::~Context()
+  {
+    if (!_window)
+      return;
+
+    glfwDestroyWindow(_window);
+    glfwTerminate();
+  }
+
+  int run(const options& o)
+  {
+    Context context(o._width, o._height);
+    if (!context.valid())
+      return -1;
+
+    int result = 0;
+    {
+      target offscreen;
+      Scene scene;
+      if (!offscreen.create(o._width, o._height))
+        result = -1;
+      else
+      {
+        const Scene::Size rtt_size(o._rttWidth ? o._rttWidth : o._width, o._rttHeight ? o._rttHeight : o._height);
+
+        headless_clock::time_point start = headless_clock::now();
+        scene.SetTextureCompression(o._bc1);
+        scene.Load(rtt_size, rtt_size, o._mask);
+        const double tLoad = seconds(start);
+
+        scene.SetSize(Scene::Size(o._width, o._height));
+        scene.SetTarget(offscreen._fbo);
+        scene.SetLightOn(o._lightOn);
+        scene.SetBlurMode(o._blur);
+        scene.SetBlurRadius(o._blurRadius);
+
+        std::cout << o._frames << " frames " << o._width << "x" << o._height
+                  << ", rtt " << rtt_size._x << "x" << rtt_size._y << ", load " << tLoad * 1000. << " ms\n";
+
+        if (o._async > 0)
+          result = renderAsync(o, scene);
+        else
+          result = renderSync(o, scene, offscreen._fbo);
+
+        const profiler::Profiler& prof = scene.GetProfiler();
+        prof.print(std::cout);
+        if (!o._profile.empty())
+        {
+          const bool json = o._profile.size() >= 5 && o._profile.compare(o._profile.size() - 5, 5, ".json") == 0;
+          if (!(json ? prof.writeJSON(o._profile) : prof.writeCSV(o._profile)))
+            result = -1;
+        }
+      }
+    }
+
+    return result;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "scene.h"
+#include <string>
+
+struct GLFWwindow;
+
+// batch rendering without a visible window, started as "Blurred -headless [options]":
+// renders frames through Scene::Frame() into an offscreen framebuffer, reads them back and saves images
+
+namespace headless
+{
+  // hidden window with a current GL context and gl::setDefaults() applied; glfw is terminated with it
+  class Context
+  {
+  public:
+    Context(size_t width, size_t height);
+    ~Context();
+
+    bool valid() const {return _window != nullptr;}
+
+  private:
+    Context(const Context&);
+    Context& operator=(const Context&);
+
+    GLFWwindow *_window = nullptr;
+  };
+
+  struct options
+  {
+    size_t           _width     = 512;
+    size_t           _height    = 512;
+    size_t           _rttWidth  = 0;    // 0: same as the output
+    size_t           _rttHeight = 0;
+    int              _frames    = 60;
+    float            _angle     = 0.f;  // degrees, first frame
+    float            _angleStep = 6.f;  // degrees between frames
+    Scene::mask_type _mask       = Scene::SMOOTH;
+    Scene::blur_mode _blur       = Scene::BLUR_SIMPLE;
+    int              _blurRadius = 16;
+    bool             _lightOn    = true;
+    bool             _bc1        = false; // BC1 compressed texture files
+    int              _async      = 3;    // PBO ring size for readback, 0: synchronous glReadPixels
+    std::string      _output     = "frame_%04d.png"; // printf pattern for the frame number, empty: no files
+    std::string      _profile;                         // per-pass timings, .json or .csv by extension, empty: printed only
+  };
+
+  // false and a message on std::cerr for unknown or malformed options
+  bool parse(int argc, char **argv, options& o);
+  void usage();
+
+  int run(const options& o);
+  int run(int argc, char **argv);
+}
+
+#endif
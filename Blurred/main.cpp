@@ -1,191 +1,370 @@
-#include "utils.h"
-#include "scene.h"
-#include <GLFW/glfw3.h>
-
-#include <iostream>
-#include <memory>
-
-const int screen_size[2] = {512, 512}; 
-const float PI = 3.141592f;
-const float g_rotationSpeed = 0.2f;  // full rounds per second
-
-std::shared_ptr<Scene> g_scene;
-
-float& angle()
-{
-  static float angle = 0.f;
-  return angle;
-}
-
-float& FPS()
-{
-  static float fps = 30.f;
-  return fps;
-}
-
-void cycle_fps()
-{
-  static const float fps[3] = {30.f, 45.f, 15.f};
-  static unsigned int fps_ind = 0;
-
-  fps_ind = (fps_ind + 1) % 3;
-  FPS() = fps[fps_ind];
-
-  std::cout << "FPS now " << FPS() << "\n";
-}
-
-void toggle_light()
-{
-  bool enable = !g_scene->GetLightOn();
-  g_scene->SetLightOn(enable);
-
-  std::cout << "Light is now " << (enable ? "ON" : "OFF") << "\n";
-}
-
-void cycle_rtt_size()
-{
-  static const size_t sizes[3][2] = {{512, 512}, {256, 256}, {128, 128}};
-  static unsigned int cur_size = 0;
-
-  cur_size = (cur_size + 1) % 3;
-
-  g_scene->Load(Scene::Size(sizes[cur_size][0], sizes[cur_size][1]), g_scene->GetMaskSize(), g_scene->GetMaskType());
-
-  std::cout << "RTT size now " << sizes[cur_size][0] << ", " << sizes[cur_size][1] << "\n";
-}
-
-void cycle_mask_type()
-{
-  Scene::mask_type mask_t = Scene::mask_type((g_scene->GetMaskType() + 1) % 3);
-
-  g_scene->Load(g_scene->GetRttSize(), g_scene->GetMaskSize(), mask_t);
-
-  std::cout << "mask type now " << (mask_t == Scene::SMOOTH ? "Smooth" : (mask_t == Scene::EDGE ? "Edge" : "Peak at center")) << "\n";
-}
-
-void changeLightPower(float dPower)
-{
-  float prevPower = g_scene->GetLightPower();
-  float newPower = prevPower + dPower;
-  if (newPower >= 0.f)
-  {
-    g_scene->SetLightPower(newPower);
-    std::cout << "light power is " << newPower << "\n";
-  }  
-}
-
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
-{
-  if (action == GLFW_PRESS)
-  {
-    switch (key)
-    {
-    case GLFW_KEY_SPACE:
-      toggle_light();
-      break;
-    case GLFW_KEY_ENTER:
-      cycle_rtt_size();
-      break;
-    case GLFW_KEY_BACKSPACE:
-      cycle_mask_type();
-      break;
-    case GLFW_KEY_TAB:
-      cycle_fps();
-      break;
-    case GLFW_KEY_UP:
-      changeLightPower(1.f);
-      break;
-    case GLFW_KEY_DOWN:
-      changeLightPower(-1.f);
-      break;
-    default:
-      break;
-    }
-  }
-}
-
-inline void rotate(float dt)
-{
-  angle() = std::fmod(angle() + (2.f * PI) * g_rotationSpeed * dt, 2.f * PI);
-  g_scene->SetAngle(angle());
-}
-
-int main(void)
-{
-  if(glfwInit() != GL_TRUE)
-  {
-    std::cerr << "glfwInit failed";
-    return -1;
-  }
-  
-  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-  GLFWwindow* window = glfwCreateWindow(screen_size[0], screen_size[1], "Blurred", NULL, NULL);
-  glfwMakeContextCurrent(window);
-  glfwSwapInterval(1);
-  
-  GLenum init_result = glewInit();
-  if(init_result != GLEW_OK)
-  {
-    std::cerr << "glew init error : " << glewGetErrorString(init_result);
-    return -1;
-  }
-  
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_CULL_FACE);
-  glDepthFunc(GL_LESS);
-
-  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-
-  clock_t timeLastRedraw = 0;
-
-  Scene::Size rtt_size (screen_size[0], screen_size[1]);
-  Scene::Size mask_size = rtt_size;
-  Scene::mask_type mask_t = Scene::SMOOTH;
-
-  g_scene = std::make_shared<Scene>();
-  
-  std::cout << "Loading scene..\n";
-  g_scene->Load(rtt_size, mask_size, mask_t);
-  g_scene->SetSize(Scene::Size(screen_size[0], screen_size[1]));
-  g_scene->SetLightOn(true);
-
-  glfwSetKeyCallback(window, key_callback);
-
-  std::cout << 
-    "Scene is ready! \n\n\
-    Feel free to change the settings: \n\n\
-    - TAB to change FPS \n\
-    - BACKSPACE to change blur mask type \n\
-    - ENTER to change RTT resolution \n\
-    - SPACE to turn lights On/Off \n\
-    - UP/DOWN ARROWS to change light power (when light is ON) \n\n\
-    ENJOY!\n\n";
-
-  do 
-  {
-    clock_t frameStartTime = clock();
-    float delta = utils::dt(frameStartTime, timeLastRedraw);
-    if(delta >= 1.f / FPS())
-    {
-      timeLastRedraw = frameStartTime;
-
-      rotate(delta);
-      
-      g_scene->Frame();
-      
-      glfwSwapBuffers(window);
-    }
-
-    glfwPollEvents();    
-  }
-  while(!glfwWindowShouldClose(window));
-
-  g_scene.reset();
-
-  glfwDestroyWindow(window);
-  glfwTerminate();
-  return 0;
+#include "utils.h"
+#include "scene.h"
+#include "bench.h"
+#include "headless.h"
+#include "batch.h"
+#include "scheduler.h"
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+const int screen_size[2] = {512, 512}; 
+const float PI = 3.141592f;
+const float g_rotationSpeed = 0.2f;  // full rounds per second
+
+std::shared_ptr<Scene> g_scene;
+std::shared_ptr<scheduler::FrameScheduler> g_scheduler;
+
+float& angle()
+{
+  static float angle = 0.f;
+  return angle;
+}
+
+void cycle_fps()
+{
+  static const float fps[3] = {30.f, 45.f, 15.f};
+  static unsigned int fps_ind = 0;
+
+  fps_ind = (fps_ind + 1) % 3;
+  g_scheduler->setRate(fps[fps_ind]);
+  if (g_scheduler->getMode() != scheduler::FIXED) // setMode restarts the pacing, which would skip a frame
+    g_scheduler->setMode(scheduler::FIXED);
+
+  std::cout << "FPS now " << g_scheduler->getRate() << "\n";
+}
+
+void cycle_frame_mode()
+{
+  scheduler::mode m = scheduler::mode((g_scheduler->getMode() + 1) % scheduler::MODE_COUNT);
+  g_scheduler->setMode(m);
+  g_scheduler->reset();
+
+  std::cout << "frame pacing now " << scheduler::modeName(m) << "\n";
+}
+
+void print_frame_pacing()
+{
+  g_scheduler->print(std::cout);
+}
+
+void toggle_light()
+{
+  bool enable = !g_scene->GetLightOn();
+  g_scene->SetLightOn(enable);
+
+  std::cout << "Light is now " << (enable ? "ON" : "OFF") << "\n";
+}
+
+void cycle_rtt_size()
+{
+  static const size_t sizes[3][2] = {{512, 512}, {256, 256}, {128, 128}};
+  static unsigned int cur_size = 0;
+
+  cur_size = (cur_size + 1) % 3;
+
+  g_scene->Reconfigure(Scene::Size(sizes[cur_size][0], sizes[cur_size][1]), g_scene->GetMaskSize(), g_scene->GetMaskType());
+
+  std::cout << "RTT size now " << sizes[cur_size][0] << ", " << sizes[cur_size][1] << "\n";
+}
+
+void cycle_mask_type()
+{
+  Scene::mask_type mask_t = Scene::mask_type((g_scene->GetMaskType() + 1) % 3);
+
+  g_scene->Reconfigure(g_scene->GetRttSize(), g_scene->GetMaskSize(), mask_t);
+
+  std::cout << "mask type now " << (mask_t == Scene::SMOOTH ? "Smooth" : (mask_t == Scene::EDGE ? "Edge" : "Peak at center")) << "\n";
+}
+
+void changeLightPower(float dPower)
+{
+  float prevPower = g_scene->GetLightPower();
+  float newPower = prevPower + dPower;
+  if (newPower >= 0.f)
+  {
+    g_scene->SetLightPower(newPower);
+    std::cout << "light power is " << newPower << "\n";
+  }  
+}
+
+void cycle_blur_mode()
+{
+  static const char* names[Scene::BLUR_MODE_COUNT] = {"Simple 7-tap", "Separable gaussian", "Pyramid (dual Kawase)", "Compute box"};
+
+  Scene::blur_mode mode = Scene::blur_mode((g_scene->GetBlurMode() + 1) % Scene::BLUR_MODE_COUNT);
+  g_scene->SetBlurMode(mode);
+
+  std::cout << "blur mode now " << names[mode];
+  if (mode == Scene::BLUR_COMPUTE && !g_scene->GetComputeBlur())
+    std::cout << " (no compute shaders, separable)";
+  std::cout << "\n";
+}
+
+void changeBlurRadius(int dRadius)
+{
+  g_scene->SetBlurRadius(g_scene->GetBlurRadius() + dRadius);
+  std::cout << "blur radius is " << g_scene->GetBlurRadius() << "\n";
+}
+
+void print_state_counters()
+{
+  const gl::StateCache::counters& c = g_scene->GetStateCounters();
+  std::cout << "GL binds last frame: " << c._issued << " issued, " << c._skipped << " skipped as redundant\n";
+}
+
+void print_program_cache()
+{
+  const gl::ProgramCache::stats& st = g_scene->GetProgramCacheStats();
+  std::cout << "programs: " << st._hits << " from the binary cache (" << st._loadSeconds * 1000. << " ms), "
+            << st._misses << " compiled (" << st._compileSeconds * 1000. << " ms), " << st._rejected << " rejected, "
+            << st._pruned << " stale dropped, " << st._savedSeconds * 1000. << " ms saved\n";
+}
+
+void print_texture_stats()
+{
+  const Scene::texture_stats& st = g_scene->GetTextureStats();
+  std::cout << "textures: load " << st._loadSeconds * 1000. << " ms, upload " << st._uploadSeconds * 1000. << " ms, "
+            << st._bytes / 1024 << " KB\n";
+}
+
+void toggle_culling()
+{
+  static bool enable = true;
+  enable = !enable;
+  g_scene->SetCulling(enable);
+  std::cout << "frustum culling " << (enable ? "on" : "off") << "\n";
+}
+
+void print_cull_stats()
+{
+  const Scene::cull_stats& st = g_scene->GetCullStats();
+  std::cout << "culling last frame: " << st._visible << " of " << st._tested << " objects drawn, "
+            << st._seconds * 1000. << " ms, " << g_scene->GetDrawCalls() << " draw calls, "
+            << g_scene->GetTriangles() << " triangles\n";
+}
+
+void toggle_mask_tiles()
+{
+  g_scene->SetMaskTiles(!g_scene->GetMaskTiles());
+  std::cout << "mask tiles (simple blur) " << (g_scene->GetMaskTiles() ? "on" : "off") << "\n";
+}
+
+void print_tile_stats()
+{
+  const Scene::tile_stats& st = g_scene->GetTileStats();
+  const size_t pixels = st._pixels[mask::TILE_NONE] + st._pixels[mask::TILE_FULL] + st._pixels[mask::TILE_PARTIAL];
+  if (pixels == 0)
+    return;
+
+  std::cout << "mask tiles: " << st._pixels[mask::TILE_NONE] * 100 / pixels << "% copy, "
+            << st._pixels[mask::TILE_FULL] * 100 / pixels << "% blur only, "
+            << st._pixels[mask::TILE_PARTIAL] * 100 / pixels << "% blended in " << st._quads << " quads, "
+            << (st._fullFetches - st._fetches) * 100 / st._fullFetches << "% texture fetches saved\n";
+}
+
+void cycle_lod_threshold()
+{
+  static const float thresholds[3] = {1.f, 4.f, 0.f};
+  static unsigned int ind = 0;
+
+  ind = (ind + 1) % 3;
+  g_scene->SetLodThreshold(thresholds[ind]);
+
+  if (thresholds[ind] > 0.f)
+    std::cout << "LOD error threshold now " << thresholds[ind] << " px\n";
+  else
+    std::cout << "LOD off, full meshes\n";
+}
+
+void print_profile()
+{
+  g_scene->GetProfiler().print(std::cout);
+}
+
+void export_profile()
+{
+  const profiler::Profiler& p = g_scene->GetProfiler();
+  if (p.writeCSV("profile.csv") && p.writeJSON("profile.json"))
+    std::cout << "frame timing written to profile.csv and profile.json\n";
+}
+
+// runs at the start of a frame, key_callback only queues
+void handle_key(int key)
+{
+  switch (key)
+  {
+  case GLFW_KEY_SPACE:
+    toggle_light();
+    break;
+  case GLFW_KEY_ENTER:
+    cycle_rtt_size();
+    break;
+  case GLFW_KEY_BACKSPACE:
+    cycle_mask_type();
+    break;
+  case GLFW_KEY_TAB:
+    cycle_fps();
+    break;
+  case GLFW_KEY_UP:
+    changeLightPower(1.f);
+    break;
+  case GLFW_KEY_DOWN:
+    changeLightPower(-1.f);
+    break;
+  case GLFW_KEY_B:
+    cycle_blur_mode();
+    break;
+  case GLFW_KEY_RIGHT:
+    changeBlurRadius(4);
+    break;
+  case GLFW_KEY_LEFT:
+    changeBlurRadius(-4);
+    break;
+  case GLFW_KEY_S:
+    print_state_counters();
+    print_program_cache();
+    print_cull_stats();
+    print_tile_stats();
+    break;
+  case GLFW_KEY_C:
+    toggle_culling();
+    break;
+  case GLFW_KEY_L:
+    cycle_lod_threshold();
+    break;
+  case GLFW_KEY_T:
+    toggle_mask_tiles();
+    break;
+  case GLFW_KEY_P:
+    print_profile();
+    break;
+  case GLFW_KEY_E:
+    export_profile();
+    break;
+  case GLFW_KEY_M:
+    cycle_frame_mode();
+    break;
+  case GLFW_KEY_F:
+    print_frame_pacing();
+    break;
+  default:
+    break;
+  }
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+  if (action == GLFW_PRESS)
+    g_scheduler->post(key);
+}
+
+inline void rotate(float dt)
+{
+  angle() = std::fmod(angle() + (2.f * PI) * g_rotationSpeed * dt, 2.f * PI);
+  g_scene->SetAngle(angle());
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1 && std::string(argv[1]) == "-bench")
+    return bench::run(argc - 2, argv + 2);
+
+  if (argc > 1 && std::string(argv[1]) == "-headless")
+    return headless::run(argc - 2, argv + 2);
+
+  if (argc > 1 && std::string(argv[1]) == "-batch")
+    return batch::run(argc - 2, argv + 2);
+
+  const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+  if(glfwInit() != GL_TRUE)
+  {
+    std::cerr << "glfwInit failed";
+    return -1;
+  }
+  
+  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+  GLFWwindow* window = glfwCreateWindow(screen_size[0], screen_size[1], "Blurred", NULL, NULL);
+  glfwMakeContextCurrent(window);
+  
+  GLenum init_result = glewInit();
+  if(init_result != GLEW_OK)
+  {
+    std::cerr << "glew init error : " << glewGetErrorString(init_result);
+    return -1;
+  }
+  
+  gl::setDefaults();
+
+  Scene::Size rtt_size (screen_size[0], screen_size[1]);
+  Scene::Size mask_size = rtt_size;
+  Scene::mask_type mask_t = Scene::SMOOTH;
+
+  g_scene = std::make_shared<Scene>();
+  
+  std::cout << "Loading scene..\n";
+  g_scene->Load(rtt_size, mask_size, mask_t);
+  std::cout << "loaded in " << g_scene->GetLoadTime() * 1000. << " ms\n";
+  print_program_cache();
+  print_texture_stats();
+  g_scene->SetSize(Scene::Size(screen_size[0], screen_size[1]));
+  g_scene->SetLightOn(true);
+
+  g_scheduler = std::make_shared<scheduler::FrameScheduler>(window);
+  g_scheduler->setMode(scheduler::FIXED);
+  glfwSetKeyCallback(window, key_callback);
+
+  std::cout << 
+    "Scene is ready! \n\n\
+    Feel free to change the settings: \n\n\
+    - TAB to change FPS, M to switch frame pacing (fixed FPS, vsync, uncapped) \n\
+    - BACKSPACE to change blur mask type \n\
+    - ENTER to change RTT resolution \n\
+    - SPACE to turn lights On/Off \n\
+    - UP/DOWN ARROWS to change light power (when light is ON) \n\
+    - B to change blur mode, T to toggle mask tiles of the simple blur \n\
+    - LEFT/RIGHT ARROWS to change blur radius (all but the simple blur) \n\
+    - S to print GL state, program cache, culling and mask tile counters \n\
+    - L to change the level of detail error threshold \n\
+    - P to print frame timing percentiles, E to export them (profile.csv, profile.json) \n\
+    - F to print frame pacing: interval, jitter, key latency, CPU use \n\n\
+    ENJOY!\n\n";
+
+  do 
+  {
+    // sleeps in the event wait until the frame is due, keys pressed meanwhile bring it forward
+    const float delta = g_scheduler->wait();
+    if (glfwWindowShouldClose(window))
+      break;
+
+    g_scheduler->dispatch(handle_key);
+
+    rotate(delta);
+    
+    g_scene->Frame();
+    
+    glfwSwapBuffers(window);
+    g_scheduler->presented();
+
+    static bool first_frame = true;
+    if (first_frame)
+    {
+      glFinish();
+      std::cout << "time to first frame: "
+                << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() * 1000. << " ms\n";
+      first_frame = false;
+    }
+  }
+  while(!glfwWindowShouldClose(window));
+
+  g_scheduler.reset();
+  g_scene.reset();
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
 }
\ No newline at end of file
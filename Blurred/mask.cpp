@@ -0,0 +1,301 @@
+#include "mask.h"
+#include "utils.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MASK_SSE2
+#endif
+
+namespace mask
+{
+  namespace
+  {
+    const size_t rows_per_job = 64;
+
+    // value(x) is the unclamped mask value of column x, same float operations as the reference loop;
+    // conversion to unsigned char truncates
+    template<type T> struct generator;
+
+    template<> struct generator<SMOOTH>
+    {
+      explicit generator(size_t w): _last(float(std::max<size_t>(w, 2) - 1)) {} // single column: 0
+
+      float value(float x) const {return UCHAR_MAX * x / _last;}
+#ifdef MASK_SSE2
+      __m128 value(__m128 x) const {return _mm_div_ps(_mm_mul_ps(_mm_set1_ps(float(UCHAR_MAX)), x), _mm_set1_ps(_last));}
+#endif
+      float _last;
+    };
+
+    template<> struct generator<EDGE>
+    {
+      explicit generator(size_t w): _half(float(w / 2)) {}
+
+      float value(float x) const {return x < _half ? 0.f : float(UCHAR_MAX);}
+#ifdef MASK_SSE2
+      __m128 value(__m128 x) const {return _mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(_half)), _mm_set1_ps(float(UCHAR_MAX)));}
+#endif
+      float _half;
+    };
+
+    template<> struct generator<PEAK_AT_CENTER>
+    {
+      explicit generator(size_t w): _center(float(w / 2)), _halfWidth(w / 2.f) {}
+
+      float value(float x) const {return (1.f - std::abs(_center - x) / _halfWidth) * UCHAR_MAX;}
+#ifdef MASK_SSE2
+      __m128 value(__m128 x) const
+      {
+        const __m128 dist = _mm_andnot_ps(_mm_set1_ps(-0.f), _mm_sub_ps(_mm_set1_ps(_center), x));
+        return _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.f), _mm_div_ps(dist, _mm_set1_ps(_halfWidth))), _mm_set1_ps(float(UCHAR_MAX)));
+      }
+#endif
+      float _center, _halfWidth;
+    };
+
+    template<type T>
+    void row(size_t width, unsigned char *out, bool simd)
+    {
+      const generator<T> g(width);
+      size_t x = 0;
+
+#ifdef MASK_SSE2
+      if (simd)
+      {
+        const __m128i step = _mm_set_epi32(3, 2, 1, 0);
+        for (; x + 16 <= width; x += 16)
+        {
+          __m128i v[4];
+          for (int i = 0; i < 4; i++)
+          {
+            const __m128 xs = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(int(x) + 4 * i), step));
+            v[i] = _mm_cvttps_epi32(g.value(xs));
+          }
+          const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+          _mm_storeu_si128((__m128i*)(out + x), bytes);
+        }
+      }
+#else
+      (void)simd;
+#endif
+
+      for (; x < width; x++)
+        out[x] = (unsigned char)(g.value(float(x)));
+    }
+  }
+
+  void buildRow(type t, size_t width, unsigned char *out, bool simd)
+  {
+    switch (t)
+    {
+    case SMOOTH:         row<SMOOTH>        (width, out, simd); break;
+    case EDGE:           row<EDGE>          (width, out, simd); break;
+    case PEAK_AT_CENTER: row<PEAK_AT_CENTER>(width, out, simd); break;
+    default:
+      assert(false && "unknown mask type");
+    }
+  }
+
+  void build(type t, size_t width, size_t height, unsigned char *out, bool replicate, bool simd)
+  {
+    if (width == 0 || height == 0)
+      return;
+
+    if (replicate)
+      buildRow(t, width, out, simd);
+
+    const size_t jobs = (height + rows_per_job - 1) / rows_per_job;
+    utils::parallel_for(jobs, [&](size_t job)
+    {
+      const size_t end = std::min(height, (job + 1) * rows_per_job);
+      for (size_t y = std::max<size_t>(job * rows_per_job, replicate ? 1 : 0); y < end; y++)
+        if (replicate)
+          memcpy(out + y * width, out, width);
+        else
+          buildRow(t, width, out + y * width, simd);
+    });
+  }
+
+  void buildReference(type t, size_t width, size_t height, unsigned char *image)
+  {
+    const size_t center = width / 2;
+
+    for  (unsigned int y = 0; y < height; y++)
+      for(unsigned int x = 0; x < width; x++)
+      {
+        unsigned char value = 0;
+
+        switch (t)
+        {
+        case SMOOTH:
+          value = width > 1 ? (unsigned char)(UCHAR_MAX * float(x) / (width - 1)) : 0;
+          break;
+        case EDGE:
+          value = (x < width / 2) ? 0 : UCHAR_MAX;
+          break;
+        case PEAK_AT_CENTER:
+          value = (unsigned char)((1.f - std::abs(float(center) - x) / (width / 2.f)) * UCHAR_MAX);
+          break;
+        default:
+          assert(false && "unknown mask type");
+        }
+        image[width * y + x] = value;
+      }
+  }
+
+  void classify(const unsigned char *mask, size_t width, size_t height,
+    size_t screenWidth, size_t screenHeight, size_t tile, tiles& out)
+  {
+    out = tiles();
+    if (width == 0 || height == 0 || screenWidth == 0 || screenHeight == 0 || tile == 0)
+      return;
+
+    // texels per screen pixel; minified, the mip level and the one after it reach further than bilinear
+    const float  scaleX = float(width) / screenWidth, scaleY = float(height) / screenHeight;
+    const float  scale  = std::max(scaleX, scaleY);
+    const size_t margin = scale > 1.f ? 4 * size_t(std::ceil(scale)) : 1;
+
+    // texels sampled by pixels [from, to): the bilinear pair around each pixel center, widened by the margin;
+    // past the ends they come from the other side, the mask texture repeats
+    auto texels = [margin](size_t from, size_t to, float texelsPerPixel, size_t size, ptrdiff_t& first, ptrdiff_t& last)
+    {
+      first = ptrdiff_t(std::floor((from + 0.5f) * texelsPerPixel - 0.5f)) - ptrdiff_t(margin - 1);
+      last  = ptrdiff_t(std::floor((to   - 0.5f) * texelsPerPixel - 0.5f)) + ptrdiff_t(margin);
+      last  = std::min(last, first + ptrdiff_t(size) - 1);
+    };
+    auto wrap = [](ptrdiff_t i, size_t size)
+    {
+      return size_t((i % ptrdiff_t(size) + ptrdiff_t(size)) % ptrdiff_t(size));
+    };
+
+    const size_t cols = (screenWidth + tile - 1) / tile, rows = (screenHeight + tile - 1) / tile;
+    std::vector<tile_class> classes(cols * rows);
+
+    utils::parallel_for(rows, [&](size_t ty)
+    {
+      const size_t y0 = ty * tile, y1 = std::min(y0 + tile, screenHeight);
+      ptrdiff_t firstRow, lastRow;
+      texels(y0, y1, scaleY, height, firstRow, lastRow);
+
+      for (size_t tx = 0; tx < cols; tx++)
+      {
+        const size_t x0 = tx * tile, x1 = std::min(x0 + tile, screenWidth);
+        ptrdiff_t first, last;
+        texels(x0, x1, scaleX, width, first, last);
+
+        unsigned char lo = UCHAR_MAX, hi = 0;
+        for (ptrdiff_t y = firstRow; y <= lastRow && (lo == UCHAR_MAX || hi == 0); y++) // until both ends are seen
+        {
+          const unsigned char *row = mask + wrap(y, height) * width;
+          for (ptrdiff_t x = first; x <= last; x++)
+          {
+            lo = std::min(lo, row[wrap(x, width)]);
+            hi = std::max(hi, row[wrap(x, width)]);
+          }
+        }
+
+        classes[ty * cols + tx] = hi == 0 ? TILE_NONE : lo == UCHAR_MAX ? TILE_FULL : TILE_PARTIAL;
+      }
+    });
+
+    // runs of one class along each tile row, merged with the same run of the row below
+    std::vector<size_t> below[TILE_CLASS_COUNT], current[TILE_CLASS_COUNT]; // runs ending at this row
+    for (size_t ty = 0; ty < rows; ty++)
+    {
+      const size_t y0 = ty * tile, h = std::min(tile, screenHeight - y0);
+      for (size_t tx = 0; tx < cols; )
+      {
+        const tile_class c = classes[ty * cols + tx];
+        size_t end = tx + 1;
+        while (end < cols && classes[ty * cols + end] == c)
+          end++;
+
+        const tile_run run = {tx * tile, y0, std::min(end * tile, screenWidth) - tx * tile, h};
+        out._pixels[c] += run._width * run._height;
+        tx = end;
+
+        std::vector<tile_run>& runs = out._runs[c];
+        auto same = std::find_if(below[c].begin(), below[c].end(), [&](size_t r)
+        {
+          return runs[r]._x == run._x && runs[r]._width == run._width;
+        });
+        if (same != below[c].end())
+        {
+          runs[*same]._height += h;
+          current[c].push_back(*same);
+        }
+        else
+        {
+          current[c].push_back(runs.size());
+          runs.push_back(run);
+        }
+      }
+
+      for (int c = 0; c < TILE_CLASS_COUNT; c++)
+      {
+        below[c].swap(current[c]);
+        current[c].clear();
+      }
+    }
+  }
+
+  const size_t Cache::max_entries;
+
+  template<typename K, typename T>
+  void Cache::evict(std::map<K, entry<T>>& entries)
+  {
+    while (entries.size() > max_entries)
+      entries.erase(std::min_element(entries.begin(), entries.end(),
+        [](const std::pair<const K, entry<T>>& a, const std::pair<const K, entry<T>>& b) {return a.second._used < b.second._used;}));
+  }
+
+  Cache::image Cache::get(type t, size_t width, size_t height)
+  {
+    entry<image>& cached = _masks[key(t, width, height)];
+    cached._used = ++_uses;
+    if (cached._value)
+    {
+      _hits++;
+      return cached._value;
+    }
+
+    _misses++;
+    std::shared_ptr<std::vector<unsigned char>> built = std::make_shared<std::vector<unsigned char>>(width * height);
+    build(t, width, height, built->data());
+    cached._value = built;
+    evict(_masks);
+    return built;
+  }
+
+  Cache::tile_set Cache::getTiles(type t, size_t width, size_t height, size_t screenWidth, size_t screenHeight, size_t tile)
+  {
+    const tiles_key k(t, width, height, screenWidth, screenHeight, tile);
+    auto found = _tiles.find(k);
+    if (found != _tiles.end())
+    {
+      found->second._used = ++_uses;
+      return found->second._value;
+    }
+
+    std::shared_ptr<mask::tiles> built = std::make_shared<mask::tiles>();
+    const image source = get(t, width, height);
+    classify(source->data(), width, height, screenWidth, screenHeight, tile, *built);
+
+    entry<tile_set>& cached = _tiles[k];
+    cached._value = built;
+    cached._used  = ++_uses;
+    evict(_tiles);
+    return built;
+  }
+
+  void Cache::clear()
+  {
+    _masks.clear();
+    _tiles.clear();
+  }
+}
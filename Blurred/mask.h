@@ -0,0 +1,98 @@
+#ifndef MASK_H
+#define MASK_H
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <cstddef>
+
+// one-channel blur masks, 0 (sharp) .. 255 (full blur); all types only vary horizontally
+
+namespace mask
+{
+  // same values and order as Scene::mask_type
+  enum type
+  {
+    SMOOTH, EDGE, PEAK_AT_CENTER, TYPE_COUNT
+  };
+
+  // one row, generator specialized per type, SSE2 when available; both paths give identical bytes
+  void buildRow(type t, size_t width, unsigned char *row, bool simd = true);
+
+  // width x height, rows in parallel; replicate: build one row and copy it, otherwise every row is generated
+  void build(type t, size_t width, size_t height, unsigned char *out, bool replicate = true, bool simd = true);
+
+  // old per-pixel loop with the type switch inside, kept as a reference for benchmarks
+  void buildReference(type t, size_t width, size_t height, unsigned char *out);
+
+  // what the blur pass has to do in a screen tile, by the mask values it can sample there
+  enum tile_class
+  {
+    TILE_NONE,    // all 0: the unblurred image
+    TILE_FULL,    // all 255: the blur alone
+    TILE_PARTIAL, // blur blended by the mask
+    TILE_CLASS_COUNT
+  };
+
+  // texture fetches per pixel of each class in the BLUR_SIMPLE composite:
+  // 2D.frag, 2D_blur_only.frag, 2D_blur.frag (7 taps + mask + base)
+  const size_t tile_fetches[TILE_CLASS_COUNT] = {1, 7, 9};
+
+  struct tile_run // neighbour tiles of one class in a tile row, screen pixels from the bottom left
+  {
+    size_t _x, _y, _width, _height;
+  };
+
+  struct tiles
+  {
+    std::vector<tile_run> _runs[TILE_CLASS_COUNT];
+    size_t                _pixels[TILE_CLASS_COUNT] = {};
+  };
+
+  // screen of screenWidth x screenHeight in tile x tile squares (smaller at the right and top edges), classified by
+  // the texels of the width x height mask stretched over it; conservative for bilinear and mipmapped sampling
+  void classify(const unsigned char *mask, size_t width, size_t height,
+    size_t screenWidth, size_t screenHeight, size_t tile, tiles& out);
+
+  // generated masks by (type, size) and their tiles by (type, size, screen size); the least recently used
+  // entries go once there are more than max_entries of either, so resizing the window does not grow it
+  class Cache
+  {
+  public:
+    typedef std::shared_ptr<const std::vector<unsigned char>> image;
+    typedef std::shared_ptr<const mask::tiles>                tile_set;
+
+    static const size_t max_entries = 6; // every type at two sizes
+
+    image    get(type t, size_t width, size_t height); // builds on a miss
+    tile_set getTiles(type t, size_t width, size_t height, size_t screenWidth, size_t screenHeight, size_t tile);
+    void clear();
+
+    size_t hits()   const {return _hits;}
+    size_t misses() const {return _misses;}
+
+  private:
+    typedef std::tuple<int, size_t, size_t> key;
+
+    typedef std::tuple<int, size_t, size_t, size_t, size_t, size_t> tiles_key;
+
+    template<typename T>
+    struct entry
+    {
+      T      _value;
+      size_t _used = 0; // _uses when it was last returned
+    };
+
+    template<typename K, typename T>
+    static void evict(std::map<K, entry<T>>& entries);
+
+    std::map<key, entry<image>>          _masks;
+    std::map<tiles_key, entry<tile_set>> _tiles;
+    size_t _uses   = 0;
+    size_t _hits   = 0;
+    size_t _misses = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include "maskedblur.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MASKEDBLUR_SSE2
+#endif
+
+// MSVC compiles AVX2 intrinsics without /arch:AVX2, the CPU is checked at run time;
+// other compilers need -mavx2 and then assume it
+#if defined(__AVX2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+#define MASKEDBLUR_AVX2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace blur
+{
+  namespace
+  {
+    const size_t band_bytes = 256 * 1024; // source + destination rows of one job, about an L2
+    const float  inv_255    = 1.f / 255.f;
+
+    // every path does the same float operations in the same order, in 0..255 units:
+    // acc = sum(texel * weight), result = acc * p + (1 - p) * base, rounded half up
+    inline void pixel(const unsigned char *row, size_t w, size_t x, const unsigned char *mask, unsigned char *out)
+    {
+      float acc[4] = {0.f, 0.f, 0.f, 0.f};
+      for (int i = 0; i < simple_taps; i++)
+      {
+        const ptrdiff_t xi = std::min(std::max(ptrdiff_t(x) + i - simple_taps / 2, ptrdiff_t(0)), ptrdiff_t(w) - 1);
+        const unsigned char *px = row + 4 * xi;
+        for (int c = 0; c < 4; c++)
+          acc[c] = acc[c] + float(px[c]) * simple_weights[i];
+      }
+
+      const unsigned char *base = row + 4 * x;
+      const float p = float(mask[x]) * inv_255;
+      const float q = 1.f - p;
+      for (int c = 0; c < 4; c++)
+      {
+        const float b = c < 3 ? float(base[c]) : 255.f;
+        out[4 * x + c] = (unsigned char)(int(acc[c] * p + q * b + 0.5f));
+      }
+    }
+
+#ifdef MASKEDBLUR_SSE2
+    inline void unpack(__m128i v, __m128 px[4])
+    {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+      px[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+      px[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+      px[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+      px[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+    }
+
+    inline __m128i roundHalfUp(__m128 v)
+    {
+      return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+    }
+
+    // pixels [x, x + 4), taps stay inside the row: x >= 3, x + 7 <= w
+    inline void quadSSE2(const unsigned char *row, size_t x, const unsigned char *mask, unsigned char *out)
+    {
+      __m128 acc[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+      __m128 base[4];
+      for (int i = 0; i < simple_taps; i++)
+      {
+        __m128 px[4];
+        unpack(_mm_loadu_si128((const __m128i*)(row + 4 * (x + i - simple_taps / 2))), px);
+
+        const __m128 weight = _mm_set1_ps(simple_weights[i]);
+        for (int k = 0; k < 4; k++)
+          acc[k] = _mm_add_ps(acc[k], _mm_mul_ps(px[k], weight));
+
+        if (i == simple_taps / 2)
+          std::copy(px, px + 4, base);
+      }
+
+      const __m128 rgb   = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+      const __m128 alpha = _mm_setr_ps(0.f, 0.f, 0.f, 255.f);
+      __m128i result[4];
+      for (int k = 0; k < 4; k++)
+      {
+        const __m128 b = _mm_or_ps(_mm_and_ps(base[k], rgb), alpha);
+        const __m128 p = _mm_set1_ps(float(mask[x + k]) * inv_255);
+        const __m128 q = _mm_sub_ps(_mm_set1_ps(1.f), p);
+        result[k] = roundHalfUp(_mm_add_ps(_mm_mul_ps(acc[k], p), _mm_mul_ps(q, b)));
+      }
+
+      const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(result[0], result[1]), _mm_packs_epi32(result[2], result[3]));
+      _mm_storeu_si128((__m128i*)(out + 4 * x), bytes);
+    }
+#endif
+
+#ifdef MASKEDBLUR_AVX2
+    // pixels [x, x + 8), two per register: x >= 3, x + 11 <= w
+    inline void octAVX2(const unsigned char *row, size_t x, const unsigned char *mask, unsigned char *out)
+    {
+      __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+      __m256 base[4];
+      for (int i = 0; i < simple_taps; i++)
+      {
+        const __m256 weight = _mm256_set1_ps(simple_weights[i]);
+        const unsigned char *src = row + 4 * (x + i - simple_taps / 2);
+        for (int k = 0; k < 4; k++)
+        {
+          const __m256 px = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + 8 * k))));
+          acc[k] = _mm256_add_ps(acc[k], _mm256_mul_ps(px, weight));
+          if (i == simple_taps / 2)
+            base[k] = px;
+        }
+      }
+
+      const __m256 rgb   = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+      const __m256 alpha = _mm256_setr_ps(0.f, 0.f, 0.f, 255.f, 0.f, 0.f, 0.f, 255.f);
+      __m128i result[8];
+      for (int k = 0; k < 4; k++)
+      {
+        const float p0 = float(mask[x + 2 * k]) * inv_255, p1 = float(mask[x + 2 * k + 1]) * inv_255;
+        const __m256 b = _mm256_or_ps(_mm256_and_ps(base[k], rgb), alpha);
+        const __m256 p = _mm256_setr_ps(p0, p0, p0, p0, p1, p1, p1, p1);
+        const __m256 q = _mm256_sub_ps(_mm256_set1_ps(1.f), p);
+        const __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(acc[k], p), _mm256_mul_ps(q, b)), _mm256_set1_ps(0.5f));
+        const __m256i r = _mm256_cvttps_epi32(v);
+        result[2 * k]     = _mm256_castsi256_si128(r);
+        result[2 * k + 1] = _mm256_extracti128_si256(r, 1);
+      }
+
+      for (int half = 0; half < 2; half++)
+      {
+        const __m128i *r = result + 4 * half;
+        const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3]));
+        _mm_storeu_si128((__m128i*)(out + 4 * (x + 4 * half)), bytes);
+      }
+    }
+#endif
+
+    void blurRow(MaskedBlur::isa set, const unsigned char *row, size_t w, const unsigned char *mask, unsigned char *out)
+    {
+      const size_t edge = simple_taps / 2;
+      size_t x = 0;
+      for (; x < std::min(edge, w); x++)
+        pixel(row, w, x, mask, out);
+
+#ifdef MASKEDBLUR_AVX2
+      if (set == MaskedBlur::AVX2)
+        for (; x + 8 + edge <= w; x += 8)
+          octAVX2(row, x, mask, out);
+#endif
+#ifdef MASKEDBLUR_SSE2
+      if (set >= MaskedBlur::SSE2)
+        for (; x + 4 + edge <= w; x += 4)
+          quadSSE2(row, x, mask, out);
+#endif
+      (void)set;
+
+      for (; x < w; x++)
+        pixel(row, w, x, mask, out);
+    }
+
+    bool cpuHasAVX2()
+    {
+#if defined(MASKEDBLUR_AVX2) && defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 0);
+      if (info[0] < 7)
+        return false;
+
+      __cpuid(info, 1);
+      const bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+      if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // OS saves ymm registers
+        return false;
+
+      __cpuidex(info, 7, 0);
+      return (info[1] & (1 << 5)) != 0;
+#elif defined(MASKEDBLUR_AVX2)
+      return true;
+#else
+      return false;
+#endif
+    }
+  }
+
+  MaskedBlur::isa MaskedBlur::supported()
+  {
+    static const isa best = cpuHasAVX2() ? AVX2 :
+#ifdef MASKEDBLUR_SSE2
+      SSE2;
+#else
+      SCALAR;
+#endif
+    return best;
+  }
+
+  MaskedBlur::MaskedBlur(isa best, size_t threads): _isa(std::min(best, supported())),
+    _threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency()))
+  {
+  }
+
+  void MaskedBlur::apply(const unsigned char *src, size_t w, size_t h, const unsigned char *mask, unsigned char *dst) const
+  {
+    if (w == 0 || h == 0)
+      return;
+
+    const size_t rows = std::max<size_t>(1, band_bytes / (8 * w));
+    const size_t jobs = (h + rows - 1) / rows;
+    const isa set = _isa;
+    utils::parallel_for(jobs, [&](size_t job)
+    {
+      const size_t end = std::min(h, (job + 1) * rows);
+      for (size_t y = job * rows; y < end; y++)
+        blurRow(set, src + 4 * w * y, w, mask + w * y, dst + 4 * w * y);
+    }, _threads);
+  }
+
+  void maskedBlurReference(const unsigned char *src, size_t w, size_t h, const unsigned char *mask, unsigned char *dst)
+  {
+    for (size_t y = 0; y < h; y++)
+      for (size_t x = 0; x < w; x++)
+      {
+        const float blur_power = mask[w * y + x] / 255.f;
+
+        float color_base[4], color_blur[4] = {0.f, 0.f, 0.f, 0.f};
+        for (int c = 0; c < 4; c++)
+          color_base[c] = c < 3 ? src[4 * (w * y + x) + c] / 255.f : 1.f;
+
+        for (int i = 0; i < simple_taps; i++)
+        {
+          const ptrdiff_t xi = std::min(std::max(ptrdiff_t(x) - 3 + i, ptrdiff_t(0)), ptrdiff_t(w) - 1);
+          for (int c = 0; c < 4; c++)
+            color_blur[c] += src[4 * (w * y + xi) + c] / 255.f * simple_weights[i];
+        }
+
+        for (int c = 0; c < 4; c++)
+        {
+          const float color = color_blur[c] * blur_power + (1.f - blur_power) * color_base[c];
+          dst[4 * (w * y + x) + c] = (unsigned char)(std::floor(std::min(std::max(color, 0.f), 1.f) * 255.f + 0.5f));
+        }
+      }
+  }
+}
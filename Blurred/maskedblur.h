@@ -0,0 +1,42 @@
+#ifndef MASKEDBLUR_H
+#define MASKEDBLUR_H
+
+#include <cstddef>
+
+// CPU implementation of the BLUR_SIMPLE composite (2D_blur.frag): 7-tap horizontal blur,
+// clamped at the row ends, mixed with the unblurred pixel by a one-channel mask
+
+namespace blur
+{
+  const int   simple_taps = 7;
+  const float simple_weights[simple_taps] = {0.12f, 0.14f, 0.15f, 0.18f, 0.15f, 0.14f, 0.12f}; // must match 2D_blur.frag
+
+  class MaskedBlur
+  {
+  public:
+    enum isa { SCALAR, SSE2, AVX2 };
+
+    static isa supported(); // best instruction set of this build and CPU
+
+    // best is lowered to supported(); threads 0: hardware_concurrency
+    explicit MaskedBlur(isa best = AVX2, size_t threads = 0);
+
+    isa    GetIsa()     const {return _isa;}
+    size_t GetThreads() const {return _threads;}
+
+    // src, dst: w x h 8-bit RGBA (any channel order, the 4th is alpha), no row padding, must not overlap;
+    // mask: w x h, 0 keeps src, 255 is fully blurred. Output alpha is like the shader's: base alpha is 1.
+    // Bands of rows run in parallel; every instruction set gives identical bytes
+    void apply(const unsigned char *src, size_t w, size_t h, const unsigned char *mask, unsigned char *dst) const;
+
+  private:
+    isa    _isa;
+    size_t _threads;
+  };
+
+  // 2D_blur.frag transcribed literally: normalized float colors, rounded to 8 bits at the end;
+  // apply() is within 1 of it per channel
+  void maskedBlurReference(const unsigned char *src, size_t w, size_t h, const unsigned char *mask, unsigned char *dst);
+}
+
+#endif
@@ -0,0 +1,1183 @@
+#include "mesh.h"
+#include "utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESH_SSE2
+#endif
+
+namespace mesh
+{
+  namespace
+  {
+    const size_t forsyth_cache_size  = 32;
+    const float  forsyth_last_tri    = 0.75f;
+    const float  forsyth_decay_power = 1.5f;
+    const float  forsyth_valence_boost_scale = 2.f;
+    const float  forsyth_valence_boost_power = 0.5f;
+
+    float forsythScore(int cachePos, unsigned int live)
+    {
+      if (live == 0)
+        return -1.f; // no triangles left, never a candidate
+
+      float score = 0.f;
+      if (cachePos >= 0)
+      {
+        if (cachePos < 3)
+          score = forsyth_last_tri; // vertices of the last triangle get a fixed score, so strips are not favoured
+        else
+        {
+          const float scaler = 1.f / (forsyth_cache_size - 3);
+          score = std::pow(1.f - (cachePos - 3) * scaler, forsyth_decay_power);
+        }
+      }
+
+      // boost vertices with few triangles left, so lonely triangles get finished early
+      score += forsyth_valence_boost_scale * std::pow(float(live), -forsyth_valence_boost_power);
+      return score;
+    }
+  }
+
+  namespace
+  {
+    inline uint32_t floatBits(float f) {uint32_t u; memcpy(&u, &f, 4); return u;}
+    inline float    bitsFloat(uint32_t u) {float f; memcpy(&f, &u, 4); return f;}
+
+    const uint32_t half_f32_infty    = 255u << 23;
+    const uint32_t half_f16_max      = (127u + 16u) << 23;               // first float too big for a half
+    const uint32_t half_denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    const uint32_t half_min_normal   = 113u << 23;                       // smallest float that is a normal half
+
+    inline uint32_t packSnorm10(float x)
+    {
+      x = std::min(std::max(x, -1.f), 1.f);
+      return uint32_t(int(std::lrint(x * 511.f))) & 0x3FF;
+    }
+
+    void packScalar(const vertex *in, size_t count, packed_vertex *out)
+    {
+      for (size_t i = 0; i < count; i++)
+      {
+        memcpy(out[i]._pos, in[i]._pos, sizeof(out[i]._pos));
+        out[i]._uv[0] = floatToHalf(in[i]._uv[0]);
+        out[i]._uv[1] = floatToHalf(in[i]._uv[1]);
+        out[i]._n = packSnorm10(in[i]._n[0]) | (packSnorm10(in[i]._n[1]) << 10) | (packSnorm10(in[i]._n[2]) << 20);
+      }
+    }
+
+#ifdef MESH_SSE2
+    inline __m128i select(__m128i mask, __m128i a, __m128i b)
+    {
+      return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    // same steps as floatToHalf, four lanes at once; results are in the low 16 bits
+    inline __m128i floatToHalf4(__m128 x)
+    {
+      __m128i f    = _mm_castps_si128(x);
+      __m128i sign = _mm_and_si128(f, _mm_set1_epi32(int(0x80000000u)));
+      f = _mm_xor_si128(f, sign);
+
+      __m128i isInfNan = _mm_cmpgt_epi32(f, _mm_set1_epi32(int(half_f16_max - 1)));
+      __m128i isNan    = _mm_cmpgt_epi32(f, _mm_set1_epi32(int(half_f32_infty)));
+      __m128i infNan   = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(isNan, _mm_set1_epi32(0x200)));
+
+      __m128i isDenorm = _mm_cmpgt_epi32(_mm_set1_epi32(int(half_min_normal)), f);
+      __m128i magic    = _mm_set1_epi32(int(half_denorm_magic));
+      __m128i denorm   = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(f), _mm_castsi128_ps(magic))), magic);
+
+      __m128i mantOdd  = _mm_and_si128(_mm_srli_epi32(f, 13), _mm_set1_epi32(1));
+      __m128i normal   = _mm_add_epi32(f, _mm_set1_epi32(int((uint32_t(15 - 127) << 23) + 0xFFF)));
+      normal = _mm_srli_epi32(_mm_add_epi32(normal, mantOdd), 13);
+
+      __m128i h = select(isInfNan, infNan, select(isDenorm, denorm, normal));
+      return _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+    }
+
+    inline __m128i packSnorm10x4(__m128 x)
+    {
+      x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.f)), _mm_set1_ps(1.f));
+      return _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(511.f))), _mm_set1_epi32(0x3FF));
+    }
+
+    void packSSE2(const vertex *in, size_t count, packed_vertex *out)
+    {
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4)
+      {
+        const vertex *v = in + i;
+
+        // uvs of four vertices -> u0 v0 u1 v1 | u2 v2 u3 v3
+        __m128 uv01 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)v[0]._uv), (const __m64*)v[1]._uv);
+        __m128 uv23 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)v[2]._uv), (const __m64*)v[3]._uv);
+        __m128i h01 = floatToHalf4(uv01), h23 = floatToHalf4(uv23);
+
+        // halves fit 16 bits, bias them into the signed range so packs_epi32 does not saturate
+        const __m128i bias = _mm_set1_epi32(0x8000);
+        __m128i uvs = _mm_packs_epi32(_mm_sub_epi32(h01, bias), _mm_sub_epi32(h23, bias));
+        uvs = _mm_xor_si128(uvs, _mm_set1_epi16(short(0x8000)));
+
+        // normals, transposed to nx, ny, nz
+        __m128 n0 = _mm_loadh_pi(_mm_load_ss(&v[0]._n[2]), (const __m64*)v[0]._n);
+        __m128 n1 = _mm_loadh_pi(_mm_load_ss(&v[1]._n[2]), (const __m64*)v[1]._n);
+        __m128 n2 = _mm_loadh_pi(_mm_load_ss(&v[2]._n[2]), (const __m64*)v[2]._n);
+        __m128 n3 = _mm_loadh_pi(_mm_load_ss(&v[3]._n[2]), (const __m64*)v[3]._n);
+        _MM_TRANSPOSE4_PS(n0, n1, n2, n3); // n0: z, n1: 0, n2: x, n3: y
+
+        __m128i n = _mm_or_si128(packSnorm10x4(n2),
+                    _mm_or_si128(_mm_slli_epi32(packSnorm10x4(n3), 10), _mm_slli_epi32(packSnorm10x4(n0), 20)));
+
+        uint32_t uvBits[4], nBits[4];
+        _mm_storeu_si128((__m128i*)uvBits, uvs);
+        _mm_storeu_si128((__m128i*)nBits,  n);
+
+        for (int k = 0; k < 4; k++)
+        {
+          memcpy(out[i + k]._pos, v[k]._pos, sizeof(out[i + k]._pos));
+          memcpy(out[i + k]._uv, &uvBits[k], sizeof(uint32_t));
+          out[i + k]._n = nBits[k];
+        }
+      }
+
+      packScalar(in + i, count - i, out + i);
+    }
+#endif
+  }
+
+  uint16_t floatToHalf(float value)
+  {
+    uint32_t f = floatBits(value);
+    const uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint32_t h;
+    if (f >= half_f16_max)
+      h = f > half_f32_infty ? 0x7E00 : 0x7C00; // nan stays nan, too big becomes inf
+    else if (f < half_min_normal)
+      h = floatBits(bitsFloat(f) + bitsFloat(half_denorm_magic)) - half_denorm_magic; // fpu does the denormal rounding
+    else
+    {
+      const uint32_t mantOdd = (f >> 13) & 1;
+      f += (uint32_t(15 - 127) << 23) + 0xFFF;
+      f += mantOdd;
+      h = f >> 13;
+    }
+    return uint16_t(h | (sign >> 16));
+  }
+
+  float halfToFloat(uint16_t h)
+  {
+    const uint32_t sign = uint32_t(h & 0x8000) << 16;
+    const uint32_t exp  = (h >> 10) & 0x1F;
+    const uint32_t mant = h & 0x3FF;
+
+    if (exp == 0)
+    {
+      const float f = mant / 16777216.f; // mant * 2^-24
+      return sign ? -f : f;
+    }
+    if (exp == 31)
+      return bitsFloat(sign | 0x7F800000u | (mant << 13));
+
+    return bitsFloat(sign | ((exp + 127 - 15) << 23) | (mant << 13));
+  }
+
+  void pack(const vertex *in, size_t count, packed_vertex *out, bool simd)
+  {
+#ifdef MESH_SSE2
+    if (simd)
+    {
+      packSSE2(in, count, out);
+      return;
+    }
+#endif
+    packScalar(in, count, out);
+  }
+
+  cache_stats simulateCache(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize, bool fifo)
+  {
+    cache_stats stats = {0.f, 0.f};
+    if (indices.empty() || vertexCount == 0)
+      return stats;
+
+    size_t misses = 0, unique = 0;
+    std::vector<bool> seen(vertexCount, false);
+
+    if (fifo)
+    {
+      // a vertex is still cached while fewer than cacheSize misses happened after its own,
+      // the same model as optimizeOverdraw's
+      std::vector<size_t> insertedAt(vertexCount, 0);
+      for (unsigned int v : indices)
+      {
+        if (!seen[v] || misses - insertedAt[v] >= cacheSize)
+        {
+          insertedAt[v] = ++misses;
+          unique += seen[v] ? 0 : 1;
+          seen[v] = true;
+        }
+      }
+    }
+    else
+    {
+      std::vector<unsigned int> cache;
+      cache.reserve(cacheSize + 1);
+      for (unsigned int v : indices)
+      {
+        auto it = std::find(cache.begin(), cache.end(), v);
+        if (it != cache.end())
+          cache.erase(it);
+        else
+        {
+          misses++;
+          unique += seen[v] ? 0 : 1;
+          seen[v] = true;
+          if (cache.size() == cacheSize)
+            cache.pop_back();
+        }
+        cache.insert(cache.begin(), v);
+      }
+    }
+
+    stats._acmr = float(misses) / (indices.size() / 3);
+    stats._atvr = float(misses) / unique;
+    return stats;
+  }
+
+  void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+  {
+    const size_t triCount = indices.size() / 3;
+    if (triCount == 0)
+      return;
+
+    // vertex -> triangles adjacency, live part of each list is [offset, offset + live)
+    std::vector<unsigned int> live(vertexCount, 0);
+    for (unsigned int v : indices)
+      live[v]++;
+
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+      offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    {
+      std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<int>   cachePos   (vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+      vertexScore[v] = forsythScore(-1, live[v]);
+
+    std::vector<float> triScore(triCount);
+    std::vector<bool>  emitted (triCount, false);
+    for (size_t t = 0; t < triCount; t++)
+      triScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    std::vector<unsigned int> cache, newCache;
+    cache   .reserve(forsyth_cache_size + 3);
+    newCache.reserve(forsyth_cache_size + 3);
+
+    size_t best = std::max_element(triScore.begin(), triScore.end()) - triScore.begin();
+    size_t scan = 0; // every triangle before it is emitted
+
+    while (best < triCount)
+    {
+      const unsigned int *tri = &indices[best * 3];
+      result.insert(result.end(), tri, tri + 3);
+      emitted[best] = true;
+
+      // emitted triangle goes to the front of the cache, the rest keeps its order
+      newCache.assign(tri, tri + 3);
+      for (unsigned int v : cache)
+        if (v != tri[0] && v != tri[1] && v != tri[2])
+          newCache.push_back(v);
+
+      for (int i = 0; i < 3; i++)
+      {
+        const unsigned int v = tri[i];
+        unsigned int *list = &adjacency[offsets[v]];
+        std::swap(*std::find(list, list + live[v], (unsigned int)best), list[live[v] - 1]);
+        live[v]--;
+      }
+
+      best = triCount;
+      float bestScore = -1.f;
+
+      for (size_t i = 0; i < newCache.size(); i++)
+      {
+        const unsigned int v = newCache[i];
+        cachePos[v] = i < forsyth_cache_size ? int(i) : -1;
+
+        const float score = forsythScore(cachePos[v], live[v]);
+        const float delta = score - vertexScore[v];
+        vertexScore[v] = score;
+
+        const unsigned int *list = &adjacency[offsets[v]];
+        for (unsigned int j = 0; j < live[v]; j++)
+        {
+          const unsigned int t = list[j];
+          triScore[t] += delta;
+          if (i < forsyth_cache_size && triScore[t] > bestScore)
+          {
+            bestScore = triScore[t];
+            best = t;
+          }
+        }
+      }
+
+      if (newCache.size() > forsyth_cache_size)
+        newCache.resize(forsyth_cache_size);
+      cache.swap(newCache);
+
+      if (best == triCount) // nothing left around the cache, continue with the next unused triangle
+      {
+        while (scan < triCount && emitted[scan])
+          scan++;
+        best = scan;
+      }
+    }
+
+    indices.swap(result);
+  }
+
+  void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& vs, float threshold)
+  {
+    const size_t triCount = indices.size() / 3;
+    if (triCount == 0)
+      return;
+
+    // fifo cache like simulateCache's, restarted at every cluster
+    const size_t cache_size = 32;
+    std::vector<size_t> insertedAt(vs.size() / 3, 0);
+    size_t misses = 0, stamp = 0; // stamp: misses before the restart, older entries are gone
+    auto restart = [&]() {stamp = misses += cache_size;};
+    auto missesOf = [&](size_t t)
+    {
+      size_t m = 0;
+      for (int k = 0; k < 3; k++)
+      {
+        const unsigned int v = indices[t * 3 + k];
+        if (insertedAt[v] < stamp || misses - insertedAt[v] >= cache_size)
+        {
+          insertedAt[v] = ++misses;
+          m++;
+        }
+      }
+      return m;
+    };
+
+    // hard boundaries: triangles where all 3 vertices miss, the cache order restarted there anyway
+    std::vector<size_t> hard;
+    restart();
+    for (size_t t = 0; t < triCount; t++)
+      if (missesOf(t) == 3)
+        hard.push_back(t);
+    hard.push_back(triCount);
+
+    // soft boundaries: a cluster ends as soon as its ACMR from a cold cache is within threshold of the hard cluster's
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++)
+    {
+      const size_t first = hard[h], end = hard[h + 1];
+      restart();
+      size_t total = 0;
+      for (size_t t = first; t < end; t++)
+        total += missesOf(t);
+      const float limit = threshold * float(total) / (end - first);
+
+      restart();
+      size_t start = first, clusterMisses = 0;
+      clusters.push_back(first);
+      for (size_t t = first; t + 1 < end; t++)
+      {
+        clusterMisses += missesOf(t);
+        if (float(clusterMisses) / (t + 1 - start) <= limit)
+        {
+          start = t + 1;
+          clusterMisses = 0;
+          clusters.push_back(start);
+          restart();
+        }
+      }
+    }
+    clusters.push_back(triCount);
+
+    // area weighted centroid and normal of every cluster
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<float> centroids(clusterCount * 3, 0.f), normals(clusterCount * 3, 0.f), areas(clusterCount, 0.f);
+    float center[3] = {0.f, 0.f, 0.f}, totalArea = 0.f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+      for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+      {
+        const float *p0 = &vs[indices[t * 3] * 3], *p1 = &vs[indices[t * 3 + 1] * 3], *p2 = &vs[indices[t * 3 + 2] * 3];
+        const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        const float n[3]  = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        const float area  = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        for (int k = 0; k < 3; k++)
+        {
+          centroids[c * 3 + k] += (p0[k] + p1[k] + p2[k]) / 3.f * area;
+          normals  [c * 3 + k] += n[k];
+        }
+        areas[c] += area;
+      }
+
+      for (int k = 0; k < 3; k++)
+      {
+        center[k] += centroids[c * 3 + k];
+        centroids[c * 3 + k] /= std::max(areas[c], FLT_MIN);
+      }
+      totalArea += areas[c];
+    }
+    for (int k = 0; k < 3; k++)
+      center[k] /= std::max(totalArea, FLT_MIN);
+
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+      const float *n = &normals[c * 3], *p = &centroids[c * 3];
+      const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      sortKey[c] = length > 0.f ? ((p[0] - center[0]) * n[0] + (p[1] - center[1]) * n[1] + (p[2] - center[2]) * n[2]) / length : 0.f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+      order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {return sortKey[a] > sortKey[b];});
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+      result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    indices.swap(result);
+  }
+
+  float analyzeOverdraw(const std::vector<unsigned int>& indices, const std::vector<float>& vs, size_t size)
+  {
+    const size_t vertexCount = vs.size() / 3;
+    if (indices.empty() || vertexCount == 0 || size == 0)
+      return 0.f;
+
+    float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (size_t v = 0; v < vertexCount; v++)
+      for (int k = 0; k < 3; k++)
+      {
+        lo[k] = std::min(lo[k], vs[v * 3 + k]);
+        hi[k] = std::max(hi[k], vs[v * 3 + k]);
+      }
+    const float extent = std::max(std::max(hi[0] - lo[0], hi[1] - lo[1]), std::max(hi[2] - lo[2], FLT_MIN));
+    const float scale  = (size - 1) / extent;
+
+    std::vector<float> screen(vertexCount * 3), depth(size * size);
+    size_t shaded = 0, covered = 0;
+
+    for (int view = 0; view < 6; view++)
+    {
+      // looking down -axis (view even) or +axis (view odd); the two other axes keep a right-handed screen
+      const int axis = view / 2, u = (axis + 1) % 3, w = (axis + 2) % 3;
+      const float sign = view % 2 == 0 ? 1.f : -1.f;
+      for (size_t v = 0; v < vertexCount; v++)
+      {
+        const float *p = &vs[v * 3];
+        screen[v * 3]     = (sign > 0.f ? p[u] - lo[u] : hi[u] - p[u]) * scale;
+        screen[v * 3 + 1] = (p[w] - lo[w]) * scale;
+        screen[v * 3 + 2] = -sign * p[axis]; // smaller is closer
+      }
+      std::fill(depth.begin(), depth.end(), FLT_MAX);
+
+      for (size_t i = 0; i + 2 < indices.size(); i += 3)
+      {
+        const float *a = &screen[indices[i] * 3], *b = &screen[indices[i + 1] * 3], *c = &screen[indices[i + 2] * 3];
+        const float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+        if (area <= 0.f)
+          continue; // back facing or degenerate
+
+        const int x0 = std::max(int(std::ceil (std::min(std::min(a[0], b[0]), c[0]) - 0.5f)), 0);
+        const int x1 = std::min(int(std::floor(std::max(std::max(a[0], b[0]), c[0]) - 0.5f)), int(size) - 1);
+        const int y0 = std::max(int(std::ceil (std::min(std::min(a[1], b[1]), c[1]) - 0.5f)), 0);
+        const int y1 = std::min(int(std::floor(std::max(std::max(a[1], b[1]), c[1]) - 0.5f)), int(size) - 1);
+
+        for (int y = y0; y <= y1; y++)
+          for (int x = x0; x <= x1; x++)
+          {
+            const float px = x + 0.5f, py = y + 0.5f;
+            const float ea = (c[0] - b[0]) * (py - b[1]) - (c[1] - b[1]) * (px - b[0]);
+            const float eb = (a[0] - c[0]) * (py - c[1]) - (a[1] - c[1]) * (px - c[0]);
+            const float ec = (b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0]);
+            if (ea < 0.f || eb < 0.f || ec < 0.f)
+              continue;
+
+            const float z = (ea * a[2] + eb * b[2] + ec * c[2]) / area;
+            float& d = depth[y * size + x];
+            if (z < d)
+            {
+              d = z;
+              shaded++;
+            }
+          }
+      }
+
+      for (float d : depth)
+        covered += d < FLT_MAX ? 1 : 0;
+    }
+
+    return covered > 0 ? float(shaded) / covered : 0.f;
+  }
+
+  void optimizeVertexFetch(std::vector<unsigned int>& indices, std::vector<float>& vs, std::vector<float>& uvs, std::vector<float>& ns)
+  {
+    const size_t vertexCount = vs.size() / 3;
+    const unsigned int none = ~0u;
+
+    std::vector<unsigned int> remap(vertexCount, none);
+    unsigned int next = 0;
+
+    std::vector<float> newVs(vs.size()), newUvs(uvs.size()), newNs(ns.size());
+    for (unsigned int& ind : indices)
+    {
+      if (remap[ind] == none)
+      {
+        const unsigned int v = ind, nv = remap[v] = next++;
+        std::copy(&vs[v * 3], &vs[v * 3] + 3, &newVs[nv * 3]);
+        if (!uvs.empty())
+          std::copy(&uvs[v * 2], &uvs[v * 2] + 2, &newUvs[nv * 2]);
+        if (!ns.empty())
+          std::copy(&ns[v * 3], &ns[v * 3] + 3, &newNs[nv * 3]);
+      }
+      ind = remap[ind];
+    }
+
+    // unreferenced vertices are dropped
+    newVs .resize(next * 3);
+    newUvs.resize(uvs.empty() ? 0 : next * 2);
+    newNs .resize(ns .empty() ? 0 : next * 3);
+
+    vs .swap(newVs);
+    uvs.swap(newUvs);
+    ns .swap(newNs);
+  }
+
+  void makeSphere(size_t rings, size_t segments, std::vector<float>& vs, std::vector<float>& uvs, std::vector<float>& ns, std::vector<unsigned int>& indices)
+  {
+    assert(rings >= 2 && segments >= 3);
+    const float pi = 3.14159265f;
+    const unsigned int base = (unsigned int)(vs.size() / 3);
+
+    // seam column is duplicated so uvs can wrap
+    for (size_t r = 0; r <= rings; r++)
+    {
+      const float theta = pi * r / rings;
+      for (size_t s = 0; s <= segments; s++)
+      {
+        const float phi = 2.f * pi * s / segments;
+        const float n[3] = {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+
+        vs .insert(vs.end(), n, n + 3);
+        ns .insert(ns.end(), n, n + 3);
+        uvs.push_back(float(s) / segments);
+        uvs.push_back(1.f - float(r) / rings);
+      }
+    }
+
+    const unsigned int row = (unsigned int)(segments + 1);
+    for (unsigned int r = 0; r < rings; r++)
+      for (unsigned int s = 0; s < segments; s++)
+      {
+        const unsigned int a = base + r * row + s, b = a + row;
+        if (r > 0) // pole rows are single triangles
+        {
+          indices.push_back(a);
+          indices.push_back(a + 1);
+          indices.push_back(b);
+        }
+        if (r + 1 < rings)
+        {
+          indices.push_back(a + 1);
+          indices.push_back(b + 1);
+          indices.push_back(b);
+        }
+      }
+  }
+
+  namespace
+  {
+    // sum of squared distances to a set of planes, symmetric 4x4 as its upper triangle
+    struct quadric
+    {
+      double _a[10] = {}; // xx xy xz xw yy yz yw zz zw ww
+
+      void addPlane(double a, double b, double c, double d)
+      {
+        const double p[4] = {a, b, c, d};
+        for (int i = 0, k = 0; i < 4; i++)
+          for (int j = i; j < 4; j++)
+            _a[k++] += p[i] * p[j];
+      }
+
+      quadric& operator+=(const quadric& q)
+      {
+        for (int k = 0; k < 10; k++)
+          _a[k] += q._a[k];
+        return *this;
+      }
+
+      double eval(const float *v) const
+      {
+        const double x = v[0], y = v[1], z = v[2];
+        return _a[0] * x * x + 2. * _a[1] * x * y + 2. * _a[2] * x * z + 2. * _a[3] * x
+                             +      _a[4] * y * y + 2. * _a[5] * y * z + 2. * _a[6] * y
+                                                  +      _a[7] * z * z + 2. * _a[8] * z
+                                                                       +      _a[9];
+      }
+    };
+
+    struct collapse
+    {
+      double       _cost;
+      unsigned int _from, _to;
+
+      bool operator<(const collapse& other) const {return _cost < other._cost;}
+    };
+
+    inline void sub3(const float *a, const float *b, float *out)
+    {
+      out[0] = a[0] - b[0];
+      out[1] = a[1] - b[1];
+      out[2] = a[2] - b[2];
+    }
+
+    inline void cross3(const float *a, const float *b, float *out)
+    {
+      out[0] = a[1] * b[2] - a[2] * b[1];
+      out[1] = a[2] * b[0] - a[0] * b[2];
+      out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    inline void triangleNormal(const float *a, const float *b, const float *c, float *out) // not normalized
+    {
+      float ab[3], ac[3];
+      sub3(b, a, ab);
+      sub3(c, a, ac);
+      cross3(ab, ac, out);
+    }
+  }
+
+  lod simplify(const std::vector<unsigned int>& indices, const std::vector<float>& vs, const std::vector<float>& uvs,
+    const std::vector<float>& ns, size_t targetIndexCount, size_t threads)
+  {
+    lod result;
+    result._indices = indices;
+
+    const size_t vertexCount = vs.size() / 3;
+    if (indices.size() <= targetIndexCount || vertexCount == 0)
+      return result;
+
+    // welded positions: vertices with the same xyz (uv seams, hard normals) collapse together;
+    // the vertices of position p are posVertices[posFirst[p] .. posFirst[p + 1])
+    std::vector<unsigned int> position(vertexCount), posFirst, posVertices(vertexCount);
+    {
+      for (size_t v = 0; v < vertexCount; v++)
+        posVertices[v] = (unsigned int)v;
+      std::sort(posVertices.begin(), posVertices.end(), [&](unsigned int a, unsigned int b)
+      {
+        const int c = memcmp(&vs[a * 3], &vs[b * 3], sizeof(float) * 3);
+        return c != 0 ? c < 0 : a < b;
+      });
+
+      for (size_t i = 0; i < vertexCount; i++)
+      {
+        if (i == 0 || memcmp(&vs[posVertices[i - 1] * 3], &vs[posVertices[i] * 3], sizeof(float) * 3) != 0)
+          posFirst.push_back((unsigned int)i);
+        position[posVertices[i]] = (unsigned int)(posFirst.size() - 1);
+      }
+      posFirst.push_back((unsigned int)vertexCount);
+    }
+    const size_t positionCount = posFirst.size() - 1;
+    auto pos = [&](unsigned int p) {return &vs[posVertices[posFirst[p]] * 3];};
+
+    // open borders and non-manifold edges stay where they are
+    std::vector<bool> locked(positionCount, false);
+    {
+      std::vector<uint64_t> edges; // smaller position first
+      edges.reserve(indices.size());
+      for (size_t i = 0; i < indices.size(); i += 3)
+        for (int e = 0; e < 3; e++)
+        {
+          const uint64_t a = position[indices[i + e]], b = position[indices[i + (e + 1) % 3]];
+          edges.push_back(a < b ? (a << 32 | b) : (b << 32 | a));
+        }
+      std::sort(edges.begin(), edges.end());
+
+      for (size_t i = 0; i < edges.size(); )
+      {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j] == edges[i])
+          j++;
+        if (j - i != 2)
+          locked[size_t(edges[i] >> 32)] = locked[size_t(edges[i] & 0xFFFFFFFFu)] = true;
+        i = j;
+      }
+    }
+
+    // plane quadrics of the full mesh per position; collapses merge them
+    std::vector<quadric> quadrics(positionCount);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      const float *a = &vs[indices[i] * 3], *b = &vs[indices[i + 1] * 3], *c = &vs[indices[i + 2] * 3];
+      float n[3];
+      triangleNormal(a, b, c, n);
+      const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (len <= 0.f)
+        continue;
+
+      n[0] /= len; n[1] /= len; n[2] /= len;
+      quadric q;
+      q.addPlane(n[0], n[1], n[2], -(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]));
+      for (int k = 0; k < 3; k++)
+        quadrics[position[indices[i + k]]] += q;
+    }
+
+    // a vertex of p moves onto the vertex of q with the closest uv and normal; a collapse that tears
+    // the texture (a seam vertex pulled off the seam) costs as much as an error of the mesh's diagonal
+    auto uvDistance = [&](unsigned int a, unsigned int b)
+    {
+      if (uvs.empty())
+        return 0.f;
+      const float du = uvs[a * 2] - uvs[b * 2], dv = uvs[a * 2 + 1] - uvs[b * 2 + 1];
+      return du * du + dv * dv;
+    };
+    auto attributeDistance = [&](unsigned int a, unsigned int b)
+    {
+      float d = uvDistance(a, b);
+      if (!ns.empty())
+        for (int k = 0; k < 3; k++)
+          d += (ns[a * 3 + k] - ns[b * 3 + k]) * (ns[a * 3 + k] - ns[b * 3 + k]);
+      return d;
+    };
+    auto nearest = [&](unsigned int v, unsigned int q)
+    {
+      unsigned int best = posVertices[posFirst[q]];
+      for (unsigned int i = posFirst[q] + 1; i < posFirst[q + 1]; i++)
+        if (attributeDistance(v, posVertices[i]) < attributeDistance(v, best))
+          best = posVertices[i];
+      return best;
+    };
+    auto uvTear = [&](unsigned int p, unsigned int q)
+    {
+      float worst = 0.f;
+      for (unsigned int i = posFirst[p]; i < posFirst[p + 1]; i++)
+      {
+        const unsigned int v = posVertices[i];
+        worst = std::max(worst, uvDistance(v, nearest(v, q)));
+      }
+      return worst;
+    };
+
+    double diagonal2 = 0.;
+    {
+      float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+      for (size_t v = 0; v < vertexCount; v++)
+        for (int c = 0; c < 3; c++)
+        {
+          lo[c] = std::min(lo[c], vs[v * 3 + c]);
+          hi[c] = std::max(hi[c], vs[v * 3 + c]);
+        }
+      for (int c = 0; c < 3; c++)
+        diagonal2 += double(hi[c] - lo[c]) * (hi[c] - lo[c]);
+    }
+
+    const unsigned int none = ~0u;
+    std::vector<double>       bestCost(positionCount), bestError(positionCount);
+    std::vector<unsigned int> bestTarget(positionCount);
+    std::vector<unsigned int> offsets(positionCount + 1), adjacency;
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<bool>         touched(positionCount);
+    std::vector<collapse>     candidates;
+    double maxError = 0.;
+
+    std::vector<unsigned int>& current = result._indices;
+    while (current.size() > targetIndexCount)
+    {
+      // position -> triangles of the current index list
+      std::fill(offsets.begin(), offsets.end(), 0);
+      for (unsigned int v : current)
+        offsets[position[v] + 1]++;
+      for (size_t p = 0; p < positionCount; p++)
+        offsets[p + 1] += offsets[p];
+      adjacency.resize(current.size());
+      {
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < current.size(); i++)
+          adjacency[fill[position[current[i]]]++] = (unsigned int)(i / 3);
+      }
+
+      // cheapest edge out of every position that may move, positions in blocks on parallel_for threads
+      const size_t block = 1024;
+      utils::parallel_for((positionCount + block - 1) / block, [&](size_t job)
+      {
+        for (size_t p = job * block; p < std::min(positionCount, (job + 1) * block); p++)
+        {
+          bestCost  [p] = DBL_MAX;
+          bestTarget[p] = none;
+          if (locked[p])
+            continue;
+
+          for (unsigned int j = offsets[p]; j < offsets[p + 1]; j++)
+            for (int k = 0; k < 3; k++)
+            {
+              const unsigned int q = position[current[adjacency[j] * 3 + k]];
+              if (q == p)
+                continue;
+
+              quadric sum = quadrics[p];
+              sum += quadrics[q];
+              const double error = std::max(sum.eval(pos(q)), 0.);
+              const double cost  = error + diagonal2 * uvTear((unsigned int)p, q);
+              if (cost < bestCost[p])
+              {
+                bestCost  [p] = cost;
+                bestError [p] = error;
+                bestTarget[p] = q;
+              }
+            }
+        }
+      }, threads);
+
+      candidates.clear();
+      for (size_t p = 0; p < positionCount; p++)
+        if (bestTarget[p] != none)
+          candidates.push_back({bestCost[p], (unsigned int)p, bestTarget[p]});
+      if (candidates.empty())
+        break;
+      std::sort(candidates.begin(), candidates.end());
+
+      // cheapest first; a collapse removes about two triangles, and no triangle sees two collapses per pass
+      const size_t wanted = (current.size() - targetIndexCount) / 6 + 1;
+      size_t done = 0;
+      for (size_t v = 0; v < vertexCount; v++)
+        remap[v] = (unsigned int)v;
+      std::fill(touched.begin(), touched.end(), false);
+
+      for (const collapse& c : candidates)
+      {
+        if (done >= wanted)
+          break;
+        if (touched[c._from] || touched[c._to])
+          continue;
+
+        // triangles that stay must keep facing the same way
+        bool flips = false;
+        for (unsigned int j = offsets[c._from]; j < offsets[c._from + 1] && !flips; j++)
+        {
+          const unsigned int *tri = &current[adjacency[j] * 3];
+          unsigned int p[3] = {position[tri[0]], position[tri[1]], position[tri[2]]};
+          if (p[0] == c._to || p[1] == c._to || p[2] == c._to)
+            continue; // degenerates
+
+          float before[3], after[3];
+          triangleNormal(pos(p[0]), pos(p[1]), pos(p[2]), before);
+          for (int k = 0; k < 3; k++)
+            if (p[k] == c._from)
+              p[k] = c._to;
+          triangleNormal(pos(p[0]), pos(p[1]), pos(p[2]), after);
+          flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.f;
+        }
+        if (flips)
+          continue;
+
+        for (unsigned int i = posFirst[c._from]; i < posFirst[c._from + 1]; i++)
+          remap[posVertices[i]] = nearest(posVertices[i], c._to);
+        quadrics[c._to] += quadrics[c._from];
+        maxError = std::max(maxError, bestError[c._from]);
+        done++;
+
+        for (unsigned int j = offsets[c._from]; j < offsets[c._from + 1]; j++)
+        {
+          const unsigned int *tri = &current[adjacency[j] * 3];
+          touched[position[tri[0]]] = touched[position[tri[1]]] = touched[position[tri[2]]] = true;
+        }
+      }
+      if (done == 0)
+        break;
+
+      size_t kept = 0;
+      for (size_t i = 0; i < current.size(); i += 3)
+      {
+        const unsigned int a = remap[current[i]], b = remap[current[i + 1]], c = remap[current[i + 2]];
+        if (position[a] == position[b] || position[b] == position[c] || position[a] == position[c])
+          continue;
+        current[kept++] = a;
+        current[kept++] = b;
+        current[kept++] = c;
+      }
+      current.resize(kept);
+    }
+
+    result._error = float(std::sqrt(maxError));
+    return result;
+  }
+
+  void buildLods(const std::vector<unsigned int>& indices, const std::vector<float>& vs, const std::vector<float>& uvs,
+    const std::vector<float>& ns, bool optimize, std::vector<lod>& out, size_t threads)
+  {
+    // each level simplifies the one before, its error adds to the error of that level
+    out.clear();
+    out.reserve(max_lods - 1); // previous points into it
+    const std::vector<unsigned int> *previous = &indices;
+    float previousError = 0.f;
+    for (size_t l = 1; l < max_lods; l++)
+    {
+      lod level = simplify(*previous, vs, uvs, ns, (previous->size() / 6) * 3, threads);
+      if (level._indices.empty() || level._indices.size() > previous->size() * 3 / 4)
+        break;
+
+      level._error += previousError;
+      previousError = level._error;
+      out.push_back(std::move(level));
+      previous = &out.back()._indices;
+    }
+
+    if (optimize)
+      utils::parallel_for(out.size(), [&](size_t l)
+      {
+        optimizeVertexCache(out[l]._indices, vs.size() / 3);
+        optimizeOverdraw(out[l]._indices, vs);
+      }, threads);
+  }
+
+  void serialize(const std::vector<float>& vs, const std::vector<float>& uvs, const std::vector<float>& ns, const std::vector<unsigned int>& indices, uint64_t sourceHash, uint64_t sourceSize, uint64_t sourceTime, bool packed, std::vector<char>& out, const std::vector<lod>& lods)
+  {
+    const size_t vertexCount = vs.size() / 3;
+    const size_t vertexSize  = packed ? sizeof(packed_vertex) : sizeof(vertex);
+    const uint32_t indexSize = vertexCount <= 65536 ? 2 : 4;
+    assert(lods.size() < max_lods && "too many levels of detail");
+
+    file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header._magic, file_magic, sizeof(file_magic));
+    header._version     = file_version;
+    header._sourceHash  = sourceHash;
+    header._sourceSize  = sourceSize;
+    header._sourceTime  = sourceTime;
+    header._vertexCount = uint32_t(vertexCount);
+    header._vertexSize  = uint32_t(vertexSize);
+    header._indexSize   = indexSize;
+
+    // full mesh first, the levels after it
+    header._lods        = uint32_t(1 + lods.size());
+    header._lodCount[0] = uint32_t(indices.size());
+    for (size_t l = 1; l < header._lods; l++)
+    {
+      header._lodFirst[l] = header._lodFirst[l - 1] + header._lodCount[l - 1];
+      header._lodCount[l] = uint32_t(lods[l - 1]._indices.size());
+      header._lodError[l] = lods[l - 1]._error;
+    }
+    header._indexCount = header._lodFirst[header._lods - 1] + header._lodCount[header._lods - 1];
+
+    for (int c = 0; c < 3; c++)
+    {
+      header._min[c] =  FLT_MAX;
+      header._max[c] = -FLT_MAX;
+    }
+
+    out.resize(sizeof(file_header) + vertexCount * vertexSize + size_t(header._indexCount) * indexSize);
+
+    std::vector<vertex> full(packed ? vertexCount : 0); // packed files: built here, packed into out below
+    vertex *vertices = packed ? full.data() : (vertex*)(&out[0] + sizeof(file_header));
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+      vertex& dst = vertices[v];
+      memcpy(dst._pos, &vs[v * 3], sizeof(dst._pos));
+      memcpy(dst._uv,  &uvs[v * 2], sizeof(dst._uv));
+      memcpy(dst._n,   &ns[v * 3], sizeof(dst._n));
+
+      for (int c = 0; c < 3; c++)
+      {
+        header._min[c] = std::min(header._min[c], dst._pos[c]);
+        header._max[c] = std::max(header._max[c], dst._pos[c]);
+      }
+    }
+
+    if (packed && vertexCount > 0)
+      pack(vertices, vertexCount, (packed_vertex*)(&out[0] + sizeof(file_header)));
+
+    for (size_t l = 0; l < header._lods; l++)
+    {
+      const std::vector<unsigned int>& level = l == 0 ? indices : lods[l - 1]._indices;
+      char *ind = &out[0] + sizeof(file_header) + vertexCount * vertexSize + size_t(header._lodFirst[l]) * indexSize;
+      if (indexSize == 2)
+        for (size_t i = 0; i < level.size(); i++)
+        {
+          const uint16_t i16 = uint16_t(level[i]);
+          memcpy(ind + i * 2, &i16, 2);
+        }
+      else if (!level.empty())
+        memcpy(ind, level.data(), level.size() * 4);
+    }
+
+    memcpy(&out[0], &header, sizeof(header));
+  }
+
+  MeshFile::MeshFile(const char *path)
+    : _mapped(new utils::MappedFile(path))
+  {
+    if (_mapped->valid())
+      check(_mapped->data(), _mapped->size());
+  }
+
+  MeshFile::MeshFile(std::vector<char>& bytes)
+  {
+    _bytes.swap(bytes);
+    if (!_bytes.empty())
+      check(_bytes.data(), _bytes.size());
+  }
+
+  MeshFile::~MeshFile()
+  {
+  }
+
+  void MeshFile::check(const char *data, size_t size)
+  {
+    if (size < sizeof(file_header))
+      return;
+
+    const file_header *header = (const file_header*)data;
+    if (memcmp(header->_magic, file_magic, sizeof(file_magic)) != 0 ||
+        header->_version    != file_version ||
+        (header->_vertexSize != sizeof(vertex) && header->_vertexSize != sizeof(packed_vertex)) ||
+        (header->_indexSize != 2 && header->_indexSize != 4))
+      return;
+
+    const uint64_t expected = sizeof(file_header) + uint64_t(header->_vertexCount) * header->_vertexSize + uint64_t(header->_indexCount) * header->_indexSize;
+    if (expected != size || header->_lods == 0 || header->_lods > max_lods)
+      return;
+
+    for (size_t l = 0; l < header->_lods; l++)
+      if (uint64_t(header->_lodFirst[l]) + header->_lodCount[l] > header->_indexCount)
+        return;
+
+    // a corrupt index would be an out of bounds read on the GPU
+    const char *indices = data + sizeof(file_header) + size_t(header->_vertexCount) * header->_vertexSize;
+    uint32_t maxIndex = 0;
+    if (header->_indexSize == 2)
+      for (size_t i = 0; i < header->_indexCount; i++)
+      {
+        uint16_t i16;
+        memcpy(&i16, indices + i * 2, 2);
+        maxIndex = std::max(maxIndex, uint32_t(i16));
+      }
+    else
+      for (size_t i = 0; i < header->_indexCount; i++)
+      {
+        uint32_t i32;
+        memcpy(&i32, indices + i * 4, 4);
+        maxIndex = std::max(maxIndex, i32);
+      }
+    if (header->_indexCount > 0 && maxIndex >= header->_vertexCount)
+      return;
+
+    _header = header;
+    _size   = size;
+  }
+
+  bool MeshFile::write(const char *path) const
+  {
+    if (!valid())
+      return false;
+
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write((const char*)_header, _size);
+    if (!out)
+    {
+      std::cerr << "unable to write mesh file " << path << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  std::shared_ptr<MeshFile> load(const char *obj_path, const char *mesh_path, bool optimize, bool packed)
+  {
+    uint64_t source_hash = 0, source_size = 0, source_time = 0;
+    const bool shipped = utils::fileStamp(obj_path, source_size, source_time) && source_size > 0;
+
+    // mesh file is used as is if it was built from the same source (or the source is not shipped)
+    auto cached = std::make_shared<MeshFile>(mesh_path);
+    const bool usable = cached->valid() && cached->packed() == packed; // other vertex formats are rebuilt
+    if (usable && (!shipped || (cached->header()._sourceSize == source_size &&
+                                cached->header()._sourceTime == source_time)))
+      return cached;
+
+    {
+      utils::MappedFile source(obj_path);
+      if (source.valid())
+        source_hash = utils::hash64(source.data(), source.size());
+    }
+
+    const bool same = usable && cached->header()._sourceHash == source_hash && cached->header()._sourceSize == source_size;
+    cached.reset(); // unmapped, so the file can be rewritten
+
+    // touched but not changed: only the stamp is updated, so the next start skips the hash again
+    if (same)
+    {
+      {
+        std::fstream file(mesh_path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offsetof(file_header, _sourceTime));
+        file.write((const char*)&source_time, sizeof(source_time));
+      }
+      cached = std::make_shared<MeshFile>(mesh_path);
+      if (cached->valid())
+        return cached;
+    }
+
+    std::vector<float> vs, uvs, ns;
+    std::vector<unsigned int> indices;
+    if (utils::loadOBJ(obj_path, vs, uvs, ns, indices) == 0)
+      return nullptr;
+
+    if (optimize)
+    {
+      const size_t cache_size = 32;
+      cache_stats before = simulateCache(indices, vs.size() / 3, cache_size);
+
+      optimizeVertexCache(indices, vs.size() / 3);
+      optimizeOverdraw(indices, vs);
+      optimizeVertexFetch(indices, vs, uvs, ns);
+
+      cache_stats after = simulateCache(indices, vs.size() / 3, cache_size);
+      std::cout << obj_path << ": ACMR " << before._acmr << " -> " << after._acmr << ", ATVR " << before._atvr << " -> " << after._atvr << "\n";
+    }
+
+    std::vector<lod> lods;
+    buildLods(indices, vs, uvs, ns, optimize, lods);
+    std::cout << obj_path << ": " << indices.size() / 3;
+    for (const lod& level : lods)
+      std::cout << " -> " << level._indices.size() / 3;
+    std::cout << " triangles in " << 1 + lods.size() << " levels of detail\n";
+
+    std::vector<char> bytes;
+    serialize(vs, uvs, ns, indices, source_hash, source_size, source_time, packed, bytes, lods);
+
+    auto built = std::make_shared<MeshFile>(bytes);
+    if (built->write(mesh_path))
+      std::cout << mesh_path << " rebuilt from " << obj_path << "\n";
+
+    return built;
+  }
+}
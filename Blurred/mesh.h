@@ -0,0 +1,167 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// CPU-side processing of indexed triangle meshes (positions xyz, uvs uv, normals xyz)
+
+namespace utils
+{
+  class MappedFile;
+}
+
+namespace mesh
+{
+  // interleaved vertex as stored in mesh files and vertex buffers
+  struct vertex
+  {
+    float _pos[3];
+    float _uv [2];
+    float _n  [3];
+  };
+
+  // compact vertex for upload: half float uvs, snorm 2_10_10_10 normal (w unused), 20 bytes instead of 32
+  struct packed_vertex
+  {
+    float    _pos[3];
+    uint16_t _uv [2];
+    uint32_t _n;
+  };
+
+  // vertex -> packed_vertex, SSE2 when available; both paths give identical bits
+  void pack(const vertex *in, size_t count, packed_vertex *out, bool simd = true);
+
+  uint16_t floatToHalf(float f); // round to nearest even
+  float    halfToFloat(uint16_t h);
+
+  const size_t max_lods = 6; // full mesh included
+
+  // binary mesh file: header, vertices, indices (uint16 or uint32, ready for upload) of every level of detail
+  struct file_header
+  {
+    char     _magic[4];
+    uint32_t _version;
+    uint64_t _sourceHash;   // utils::hash64 of the file the mesh was built from
+    uint64_t _sourceSize;
+    uint64_t _sourceTime;   // utils::fileStamp of that file, the hash is only checked when it changed
+    uint32_t _vertexCount;
+    uint32_t _indexCount;
+    uint32_t _vertexSize;   // sizeof(vertex), or sizeof(packed_vertex) for packed files
+    uint32_t _indexSize;    // 2 or 4
+    float    _min[3], _max[3];
+    uint32_t _lods;                 // levels of detail, 1: the full mesh only
+    uint32_t _lodFirst[max_lods];   // first index of each level, level 0 is the full mesh
+    uint32_t _lodCount[max_lods];   // index count of each level
+    float    _lodError[max_lods];   // object space distance from the full mesh, 0 for level 0
+  };
+
+  const char     file_magic[4] = {'B', 'M', 'S', 'H'};
+  const uint32_t file_version  = 5;
+
+  // simplified index list over the same vertices
+  struct lod
+  {
+    std::vector<unsigned int> _indices;
+    float _error = 0.f; // object space distance from the full mesh, upper bound
+  };
+
+  void serialize(const std::vector<float>& vs,
+    const std::vector<float>& uvs,
+    const std::vector<float>& ns,
+    const std::vector<unsigned int>& indices,
+    uint64_t sourceHash, uint64_t sourceSize, uint64_t sourceTime,
+    bool packed, // vertices stored as packed_vertex, uploaded as they are
+    std::vector<char>& out,
+    const std::vector<lod>& lods = std::vector<lod>()); // levels 1.., stored after the full mesh's indices
+
+  // read-only view of a serialized mesh, either mapped from disk or owning its bytes
+  class MeshFile
+  {
+  public:
+    explicit MeshFile(const char *path);
+    explicit MeshFile(std::vector<char>& bytes); // takes over the buffer
+    ~MeshFile();
+
+    bool valid() const {return _header != nullptr;}
+
+    const file_header& header()   const {return *_header;}
+    bool               packed()   const {return _header->_vertexSize == sizeof(packed_vertex);}
+    const void*        vertices() const {return _header + 1;} // vertex or packed_vertex
+    const void*        indices()  const {return (const char*)vertices() + size_t(_header->_vertexSize) * _header->_vertexCount;}
+
+    bool write(const char *path) const;
+
+  private:
+    MeshFile(const MeshFile&);
+    MeshFile& operator=(const MeshFile&);
+
+    void check(const char *data, size_t size); // header, sizes and every index below the vertex count
+
+    std::unique_ptr<utils::MappedFile> _mapped;
+    std::vector<char>  _bytes;
+    const file_header *_header = nullptr;
+    size_t             _size   = 0;
+  };
+
+  struct cache_stats
+  {
+    float _acmr; // transformed vertices per triangle, 0.5 is ideal for big regular meshes
+    float _atvr; // transformed vertices per unique vertex, 1.0 is ideal
+  };
+
+  // post-transform vertex cache simulation, fifo or lru replacement
+  cache_stats simulateCache(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize, bool fifo = true);
+
+  // Forsyth's linear-speed triangle reordering for the post-transform cache
+  void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+  // Sander et al.'s overdraw pass on cache-ordered indices: cuts them into clusters where the cache restarts
+  // or the cluster's own ACMR stays within threshold of its hard cluster, then draws the clusters that face
+  // away from the mesh center first, as they tend to occlude the rest
+  void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& vs, float threshold = 1.05f);
+
+  // shaded fragments per covered pixel of the mesh drawn in index order with a depth test and back faces culled
+  // (counter-clockwise front), from the 6 axis directions in size x size orthographic views; 1.0 is ideal
+  float analyzeOverdraw(const std::vector<unsigned int>& indices, const std::vector<float>& vs, size_t size = 256);
+
+  // renumbers vertices in order of first use so vertex fetches go forward through memory
+  void optimizeVertexFetch(std::vector<unsigned int>& indices,
+    std::vector<float>& vs,
+    std::vector<float>& uvs,
+    std::vector<float>& ns);
+
+  // quadric error edge collapses (Garland-Heckbert) until at most targetIndexCount indices are left or no
+  // collapse keeps every triangle facing the same way. Vertices at one position collapse together onto a
+  // neighbour position, each to the vertex there with the closest uv and normal, so the result indexes the
+  // same vertex arrays; open borders stay, collapses that tear uv seams come last.
+  // Collapse costs are searched on `threads` threads (0: all cores)
+  lod simplify(const std::vector<unsigned int>& indices,
+    const std::vector<float>& vs,
+    const std::vector<float>& uvs,
+    const std::vector<float>& ns,
+    size_t targetIndexCount, size_t threads = 0);
+
+  // levels 1.. of a chain, each simplified from the one before to about half its triangles, on `threads`
+  // threads (0: all cores); stops early when a level would not be much smaller than the previous
+  void buildLods(const std::vector<unsigned int>& indices,
+    const std::vector<float>& vs,
+    const std::vector<float>& uvs,
+    const std::vector<float>& ns,
+    bool optimize, std::vector<lod>& out, size_t threads = 0);
+
+  // mesh file for an .obj: mesh_path if it was built from the same source (same size and write time, or else
+  // the same hash) with the same vertex format, otherwise the .obj is
+  // parsed (and optimized for vertex cache/fetch), its LOD chain is built and mesh_path is rewritten
+  std::shared_ptr<MeshFile> load(const char *obj_path, const char *mesh_path, bool optimize, bool packed);
+
+  // uv sphere with shared vertices, rings * segments quads
+  void makeSphere(size_t rings, size_t segments,
+    std::vector<float>& vs,
+    std::vector<float>& uvs,
+    std::vector<float>& ns,
+    std::vector<unsigned int>& indices);
+}
+
+#endif
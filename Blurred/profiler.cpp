@@ -0,0 +1,252 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace profiler
+{
+  const char* passName(pass p)
+  {
+    static const char* names[PASS_COUNT] = {"background", "object", "blur"};
+    return p < PASS_COUNT ? names[p] : "unknown";
+  }
+
+  void Histogram::add(double ms)
+  {
+    _samples[_next] = ms;
+    _next = (_next + 1) % _samples.size();
+    _count = std::min(_count + 1, _samples.size());
+  }
+
+  summary Histogram::summarize() const
+  {
+    summary s;
+    s._count = _count;
+    if (_count == 0)
+      return s;
+
+    std::vector<double> sorted(_samples.begin(), _samples.begin() + _count);
+    std::sort(sorted.begin(), sorted.end());
+
+    // nearest rank
+    auto percentile = [&sorted](double p) {
+      const size_t rank = size_t(std::ceil(p * sorted.size()));
+      return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+    };
+
+    double sum = 0.;
+    for (double v : sorted)
+      sum += v;
+
+    s._mean = sum / sorted.size();
+    s._p50  = percentile(0.50);
+    s._p95  = percentile(0.95);
+    s._p99  = percentile(0.99);
+    s._max  = sorted.back();
+    return s;
+  }
+
+  Profiler::Profiler(size_t queryFrames): _ringSize(std::max(queryFrames, size_t(1)))
+  {
+  }
+
+  void Profiler::release()
+  {
+    for (query& q : _queries)
+      if (q._id != 0)
+        glDeleteQueries(1, &q._id);
+
+    _queries.clear();
+    _gpuTimers = false;
+  }
+
+  void Profiler::reset()
+  {
+    for (size_t p = 0; p < PASS_COUNT; p++)
+    {
+      _cpu[p].clear();
+      _gpu[p].clear();
+    }
+    _frame.clear();
+    _hasFrame = false;
+    _dropped  = 0;
+
+    // results still in flight were measured before the reset; the next begin() on
+    // their query discards them, so they are neither collected nor counted as dropped
+    for (query& q : _queries)
+      q._pending = false;
+  }
+
+  void Profiler::collect()
+  {
+    for (size_t i = 0; i < _queries.size(); i++)
+    {
+      query& q = _queries[i];
+      if (!q._pending)
+        continue;
+
+      GLint available = 0;
+      glGetQueryObjectiv(q._id, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        continue;
+
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(q._id, GL_QUERY_RESULT, &ns);
+      _gpu[i % PASS_COUNT].add(double(ns) * 1e-6);
+      q._pending = false;
+    }
+  }
+
+  void Profiler::beginFrame()
+  {
+    if (!_enabled)
+      return;
+
+    const clock::time_point now = clock::now();
+    if (_hasFrame)
+      _frame.add(std::chrono::duration<double, std::milli>(now - _lastFrame).count());
+    _lastFrame = now;
+    _hasFrame  = true;
+
+    if (!_gpuTimers && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query))
+    {
+      _queries.resize(_ringSize * PASS_COUNT);
+      for (query& q : _queries)
+        glGenQueries(1, &q._id);
+      _gpuTimers = true;
+    }
+
+    if (_gpuTimers)
+    {
+      collect();
+      _slot = (_slot + 1) % _ringSize;
+    }
+  }
+
+  void Profiler::begin(pass p)
+  {
+    if (!_enabled)
+      return;
+
+    _passStart[p] = clock::now();
+
+    if (_gpuTimers)
+    {
+      query& q = _queries[_slot * PASS_COUNT + p];
+      if (q._pending)
+        _dropped++; // the GPU is more than _ringSize frames behind, this sample is lost
+
+      glBeginQuery(GL_TIME_ELAPSED, q._id);
+      q._pending = false;
+    }
+  }
+
+  void Profiler::end(pass p)
+  {
+    if (!_enabled)
+      return;
+
+    if (_gpuTimers)
+    {
+      glEndQuery(GL_TIME_ELAPSED);
+      _queries[_slot * PASS_COUNT + p]._pending = true;
+    }
+
+    _cpu[p].add(std::chrono::duration<double, std::milli>(clock::now() - _passStart[p]).count());
+  }
+
+  namespace
+  {
+    void printSummary(std::ostream& out, const char *name, const char *clk, const summary& s)
+    {
+      out << "  " << std::left << std::setw(11) << name << std::setw(4) << clk << std::right
+          << std::setw(8) << s._mean << std::setw(8) << s._p50 << std::setw(8) << s._p95
+          << std::setw(8) << s._p99  << std::setw(8) << s._max << "  (" << s._count << ")\n";
+    }
+
+    void csvRow(std::ostream& out, const char *name, const char *clk, const summary& s)
+    {
+      out << name << "," << clk << "," << s._count << "," << s._mean << "," << s._p50 << ","
+          << s._p95 << "," << s._p99 << "," << s._max << "\n";
+    }
+
+    void jsonSummary(std::ostream& out, const summary& s)
+    {
+      out << "{\"samples\": " << s._count << ", \"mean\": " << s._mean << ", \"p50\": " << s._p50
+          << ", \"p95\": " << s._p95 << ", \"p99\": " << s._p99 << ", \"max\": " << s._max << "}";
+    }
+  }
+
+  void Profiler::print(std::ostream& out) const
+  {
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+
+    out << "frame timing, ms              mean     p50     p95     p99     max\n";
+    printSummary(out, "frame", "cpu", frame());
+    for (size_t p = 0; p < PASS_COUNT; p++)
+    {
+      printSummary(out, passName(pass(p)), "cpu", cpu(pass(p)));
+      if (_gpuTimers)
+        printSummary(out, passName(pass(p)), "gpu", gpu(pass(p)));
+    }
+    if (!_gpuTimers)
+      out << "  no GL timer queries, CPU times only\n";
+    if (_dropped > 0)
+      out << "  " << _dropped << " GPU samples dropped\n";
+
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+  bool Profiler::writeCSV(const std::string& path) const
+  {
+    std::ofstream out(path);
+    if (!out)
+    {
+      std::cerr << path.c_str() << ": unable to write profile\n";
+      return false;
+    }
+
+    out << "pass,clock,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    csvRow(out, "frame", "cpu", frame());
+    for (size_t p = 0; p < PASS_COUNT; p++)
+    {
+      csvRow(out, passName(pass(p)), "cpu", cpu(pass(p)));
+      if (_gpuTimers)
+        csvRow(out, passName(pass(p)), "gpu", gpu(pass(p)));
+    }
+    return bool(out);
+  }
+
+  bool Profiler::writeJSON(const std::string& path) const
+  {
+    std::ofstream out(path);
+    if (!out)
+    {
+      std::cerr << path.c_str() << ": unable to write profile\n";
+      return false;
+    }
+
+    out << "{\n  \"unit\": \"ms\",\n  \"dropped\": " << _dropped << ",\n  \"frame\": ";
+    jsonSummary(out, frame());
+    out << ",\n  \"passes\": [";
+    for (size_t p = 0; p < PASS_COUNT; p++)
+    {
+      out << (p > 0 ? "," : "") << "\n    {\"name\": \"" << passName(pass(p)) << "\", \"cpu\": ";
+      jsonSummary(out, cpu(pass(p)));
+      if (_gpuTimers)
+      {
+        out << ", \"gpu\": ";
+        jsonSummary(out, gpu(pass(p)));
+      }
+      out << "}";
+    }
+    out << "\n  ]\n}\n";
+    return bool(out);
+  }
+}
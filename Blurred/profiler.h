@@ -0,0 +1,109 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// per-pass frame timing: wall clock (steady_clock) around the command submission and
+// GL_TIME_ELAPSED queries for the GPU side; queries sit in a ring and are read back
+// frames later, only once available, so the profiler never waits for the GPU
+
+namespace profiler
+{
+  enum pass
+  {
+    BACKGROUND, // RTT clear + background quad
+    OBJECT,     // 3D object into the RTT
+    BLUR,       // blur/composite passes of the current blur mode into the target
+    PASS_COUNT
+  };
+
+  const char* passName(pass p);
+
+  struct summary
+  {
+    size_t _count = 0;  // samples in the window
+    double _mean  = 0.; // milliseconds
+    double _p50   = 0.;
+    double _p95   = 0.;
+    double _p99   = 0.;
+    double _max   = 0.;
+  };
+
+  // the last `capacity` samples, percentiles over those
+  class Histogram
+  {
+  public:
+    explicit Histogram(size_t capacity = 1024): _samples(capacity) {}
+
+    void add(double ms);
+    void clear() {_next = 0; _count = 0;}
+
+    summary summarize() const;
+
+  private:
+    std::vector<double> _samples;
+    size_t              _next  = 0;
+    size_t              _count = 0;
+  };
+
+  class Profiler
+  {
+  public:
+    // queryFrames: how many frames a GPU result may lag behind before its query is reused
+    explicit Profiler(size_t queryFrames = 4);
+
+    void SetEnabled(bool enable) {_enabled = enable;}
+    bool GetEnabled() const      {return _enabled;}
+
+    // render thread, GL context current; passes must not nest (one GL_TIME_ELAPSED query at a time)
+    void beginFrame();
+    void begin(pass p);
+    void end(pass p);
+
+    void collect(); // reads every available GPU result, never blocks; beginFrame() does it too
+    void release(); // GL queries, while the context is still current
+    void reset();   // drops every sample, GPU results still in flight included
+
+    summary cpu(pass p) const {return _cpu[p].summarize();}
+    summary gpu(pass p) const {return _gpu[p].summarize();}
+    summary frame()     const {return _frame.summarize();} // beginFrame() to beginFrame()
+    size_t  dropped()   const {return _dropped;} // GPU results overwritten before they were available
+
+    void print(std::ostream& out) const;
+    bool writeCSV (const std::string& path) const;
+    bool writeJSON(const std::string& path) const;
+
+  private:
+    Profiler(const Profiler&);
+    Profiler& operator=(const Profiler&);
+
+    typedef std::chrono::steady_clock clock;
+
+    struct query
+    {
+      GLuint _id      = 0;
+      bool   _pending = false; // issued, result not read yet
+    };
+
+    bool                      _enabled = true;
+    bool                      _gpuTimers = false; // queries created
+    size_t                    _ringSize;
+    size_t                    _slot = 0;   // ring slot of the current frame
+    std::vector<query>        _queries;    // _ringSize x PASS_COUNT
+    clock::time_point         _passStart[PASS_COUNT];
+    clock::time_point         _lastFrame;
+    bool                      _hasFrame = false;
+
+    Histogram                 _cpu[PASS_COUNT];
+    Histogram                 _gpu[PASS_COUNT];
+    Histogram                 _frame;
+    size_t                    _dropped = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include "programcache.h"
+#include "utils.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gl
+{
+  namespace
+  {
+    const char     cache_magic[4] = {'B', 'P', 'R', 'G'};
+    const uint32_t cache_version  = 2; // 2: compile seconds are GL thread time only
+
+    struct file_header
+    {
+      char     _magic[4];
+      uint32_t _version;
+      uint32_t _count;
+    };
+
+    struct entry_header
+    {
+      uint64_t _key;
+      uint32_t _format;
+      uint32_t _size;
+      float    _compileSeconds;
+    };
+
+    typedef std::chrono::steady_clock cache_clock;
+
+    double seconds(cache_clock::time_point from)
+    {
+      return std::chrono::duration<double>(cache_clock::now() - from).count();
+    }
+
+    std::string glString(GLenum name)
+    {
+      const GLubyte *s = glGetString(name);
+      return s ? (const char*)s : "";
+    }
+  }
+
+  ProgramCache::ProgramCache(const std::string& path)
+    : _path(path)
+  {
+  }
+
+  bool ProgramCache::enabled()
+  {
+    if (_enabled < 0)
+    {
+      GLint formats = 0;
+      if (GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+      _enabled = formats > 0 ? 1 : 0;
+      if (_enabled)
+      {
+        _driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+        read();
+      }
+    }
+    return _enabled == 1;
+  }
+
+  uint64_t ProgramCache::key(const std::string& vertexSource, const std::string& fragmentSource)
+  {
+    const std::string all = _driver + '\0' + vertexSource + '\0' + fragmentSource;
+    return utils::hash64(all.data(), all.size());
+  }
+
+  GLuint ProgramCache::load(uint64_t key)
+  {
+    if (!enabled())
+      return 0;
+
+    auto found = _entries.find(key);
+    if (found == _entries.end())
+      return 0;
+
+    const cache_clock::time_point start = cache_clock::now();
+    entry& e = found->second;
+
+    GLuint id = glCreateProgram();
+    glProgramBinary(id, e._format, e._binary.data(), GLsizei(e._binary.size()));
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+      // driver update or a different GPU with colliding strings: recompile and replace
+      glDeleteProgram(id);
+      _entries.erase(found);
+      _dirty = true;
+      _stats._rejected++;
+      return 0;
+    }
+
+    const double t = seconds(start);
+    e._used = true;
+    _stats._hits++;
+    _stats._loadSeconds  += t;
+    _stats._savedSeconds += e._compileSeconds - t;
+    return id;
+  }
+
+  void ProgramCache::store(uint64_t key, GLuint program, double compileSeconds)
+  {
+    _stats._misses++;
+    _stats._compileSeconds += compileSeconds;
+
+    if (!enabled())
+      return;
+
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+      return;
+
+    entry e;
+    e._binary.resize(size_t(size));
+    e._compileSeconds = float(compileSeconds);
+
+    GLsizei written = 0;
+    glGetProgramBinary(program, size, &written, &e._format, e._binary.data());
+    if (written <= 0)
+      return;
+
+    e._binary.resize(size_t(written));
+    e._used = true;
+    _entries[key] = std::move(e);
+    _dirty = true;
+  }
+
+  void ProgramCache::read()
+  {
+    std::string bytes;
+    std::ifstream test(_path.c_str(), std::ios::binary);
+    if (!test)
+      return; // first run
+    test.close();
+
+    if (!utils::readFile(_path.c_str(), bytes))
+      return;
+
+    const char *p = bytes.data(), *end = p + bytes.size();
+
+    file_header header;
+    if (bytes.size() < sizeof(header))
+      return;
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+
+    if (memcmp(header._magic, cache_magic, sizeof(cache_magic)) != 0 || header._version != cache_version)
+    {
+      std::cerr << _path << ": unknown program cache format, ignored\n";
+      return;
+    }
+
+    for (uint32_t i = 0; i < header._count; i++)
+    {
+      entry_header eh;
+      if (size_t(end - p) < sizeof(eh))
+        break;
+      memcpy(&eh, p, sizeof(eh));
+      p += sizeof(eh);
+
+      if (size_t(end - p) < eh._size)
+        break;
+
+      entry& e = _entries[eh._key];
+      e._format = eh._format;
+      e._compileSeconds = eh._compileSeconds;
+      e._binary.assign(p, p + eh._size);
+      p += eh._size;
+    }
+  }
+
+  bool ProgramCache::save()
+  {
+    // sources or driver changed since these were stored, their keys will not come back
+    for (auto it = _entries.begin(); it != _entries.end();)
+      if (!it->second._used)
+      {
+        it = _entries.erase(it);
+        _stats._pruned++;
+        _dirty = true;
+      }
+      else
+        ++it;
+
+    if (!_dirty)
+      return true;
+
+    std::ofstream out(_path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+      std::cerr << "unable to write program cache " << _path;
+      return false;
+    }
+
+    file_header header;
+    memcpy(header._magic, cache_magic, sizeof(cache_magic));
+    header._version = cache_version;
+    header._count   = uint32_t(_entries.size());
+    out.write((const char*)&header, sizeof(header));
+
+    for (const auto& kv : _entries)
+    {
+      entry_header eh;
+      eh._key    = kv.first;
+      eh._format = kv.second._format;
+      eh._size   = uint32_t(kv.second._binary.size());
+      eh._compileSeconds = kv.second._compileSeconds;
+
+      out.write((const char*)&eh, sizeof(eh));
+      out.write(kv.second._binary.data(), kv.second._binary.size());
+    }
+
+    _dirty = !out.good();
+    return !_dirty;
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gl
+{
+  // linked program binaries (glGetProgramBinary) in one file, keyed by a hash of both shader sources
+  // and the GL vendor/renderer/version strings; a binary the driver rejects is dropped and recompiled
+  class ProgramCache
+  {
+  public:
+    struct stats
+    {
+      size_t _hits     = 0;
+      size_t _misses   = 0;  // compiled from source, includes rejected
+      size_t _rejected = 0;  // binary refused by the driver
+      double _loadSeconds    = 0.; // glProgramBinary of hits
+      double _compileSeconds = 0.; // compile + link of misses, GL thread time only (see gl::program_build)
+      double _savedSeconds   = 0.; // compile time recorded with the hits, minus _loadSeconds
+      size_t _pruned   = 0;  // entries not used by this run, dropped when the file was written
+    };
+
+    explicit ProgramCache(const std::string& path);
+
+    // false without GL_ARB_get_program_binary or binary formats, the cache then does nothing
+    bool enabled();
+
+    uint64_t key(const std::string& vertexSource, const std::string& fragmentSource);
+
+    // linked program from the binary stored for key, 0 on a miss or rejection
+    GLuint load(uint64_t key);
+
+    // program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    void store(uint64_t key, GLuint program, double compileSeconds);
+
+    bool save(); // writes the file if anything changed, without the entries no load() or store() used in this run
+
+    const stats& GetStats() const {return _stats;}
+
+  private:
+    struct entry
+    {
+      GLenum            _format = 0;
+      float             _compileSeconds = 0.f;
+      std::vector<char> _binary;
+      bool              _used = false; // loaded or stored in this run
+    };
+
+    void read();
+
+    std::string               _path;
+    std::string               _driver;  // vendor/renderer/version, part of every key
+    std::map<uint64_t, entry> _entries;
+    int                       _enabled = -1; // unknown until a context exists
+    bool                      _dirty   = false;
+    stats                     _stats;
+  };
+}
+
+#endif
@@ -0,0 +1,37 @@
+#version 330 core
+
+in vec2 UV;
+layout(location = 0) out vec4 color;
+uniform sampler2D currTex;    // this level: the unblurred RTT (level 0) or a downsample level, at target resolution
+uniform sampler2D maskTex;
+uniform sampler2D pyramidTex; // the next coarser level, already upsampled up to it, linear filtering
+uniform float maxLevel;       // pyramid level used where the mask is 1
+uniform float level;          // level of currTex
+
+// dual Kawase upsample of the coarser level to the current pixel
+vec4 upsample(sampler2D tex)
+{
+	vec2 halfpixel = 0.5 / vec2(textureSize(tex, 0));
+	vec4 sum = texture(tex, UV + vec2(-halfpixel.x * 2.0, 0.0));
+	sum += texture(tex, UV + vec2(-halfpixel.x, halfpixel.y)) * 2.0;
+	sum += texture(tex, UV + vec2(0.0, halfpixel.y * 2.0));
+	sum += texture(tex, UV + vec2(halfpixel.x, halfpixel.y)) * 2.0;
+	sum += texture(tex, UV + vec2(halfpixel.x * 2.0, 0.0));
+	sum += texture(tex, UV + vec2(halfpixel.x, -halfpixel.y)) * 2.0;
+	sum += texture(tex, UV + vec2(0.0, -halfpixel.y * 2.0));
+	sum += texture(tex, UV + vec2(-halfpixel.x, -halfpixel.y)) * 2.0;
+	return sum / 12.0;
+}
+
+void main()
+{
+	// where the mask asks for more blur than this level has, the coarser levels take over; between
+	// level and level + 1 the two are blended, above it only the upsampled coarser result is left
+	float w = clamp(texture(maskTex, UV).r * maxLevel - level, 0.0, 1.0);
+
+	vec4 color_blur = vec4(texture(currTex, UV).rgb, 1.0);
+	if (w > 0.0)
+		color_blur = mix(color_blur, upsample(pyramidTex), w);
+
+	color = vec4(color_blur.rgb, 1.0);
+}
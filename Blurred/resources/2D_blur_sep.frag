@@ -0,0 +1,34 @@
+#version 330 core
+
+in vec2 UV;
+layout(location = 0) out vec4 color;
+uniform sampler2D currTex; // pass input, sampled with linear filtering
+uniform sampler2D maskTex;
+uniform sampler2D baseTex; // unblurred image, used by the last pass
+
+uniform vec2  blurStep;    // one texel along the blur direction
+uniform int   tapCount;
+uniform float tapOffsets[33]; // blur::max_lin_taps; [0] is the center tap
+uniform float tapWeights[33];
+uniform float composite;   // 1.0: blend the result over baseTex by the mask
+
+void main()
+{
+	vec4 color_blur = texture(currTex, UV) * tapWeights[0];
+
+	// every tap is a bilinear fetch between two texels, weighted for both of them
+	for(int i = 1; i < tapCount; i++)
+	{
+	  vec2 shift = blurStep * tapOffsets[i];
+	  color_blur += (texture(currTex, UV + shift) + texture(currTex, UV - shift)) * tapWeights[i];
+	}
+
+	if (composite > 0.5)
+	{
+	  float blur_power = texture(maskTex, UV).r;
+	  vec4 color_base = vec4(texture(baseTex, UV).rgb, 1.0);
+	  color = color_blur * blur_power + (1.0 - blur_power) * color_base;
+	}
+	else
+	  color = color_blur;
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+in vec2 UV;
+layout(location = 0) out vec4 color;
+uniform sampler2D currTex; // previous pyramid level, sampled with linear filtering
+uniform vec2 halfpixel;    // half a texel of currTex
+
+void main()
+{
+	// dual Kawase downsample: center plus four diagonal bilinear taps
+	vec4 sum = texture(currTex, UV) * 4.0;
+	sum += texture(currTex, UV - halfpixel);
+	sum += texture(currTex, UV + halfpixel);
+	sum += texture(currTex, UV + vec2(halfpixel.x, -halfpixel.y));
+	sum += texture(currTex, UV - vec2(halfpixel.x, -halfpixel.y));
+	color = sum / 8.0;
+}
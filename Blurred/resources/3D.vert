@@ -1,29 +1,37 @@
-#version 330 core
-
-layout(location = 0) in vec4 vertexPosition_modelspace;
-layout(location = 1) in vec2 vertexUV;
-layout(location = 2) in vec3 vertexNormal_modelspace;
-
-out vec2 UV;
-out vec3 Position_worldspace;
-out vec3 Normal_cameraspace;
-out vec3 EyeDirection_cameraspace;	
-out vec3 LightDirection_cameraspace;
-
-uniform mat4 MVP;
-uniform mat4 V;
-uniform mat4 M;
-uniform vec3 LightPosition_worldspace;
-
-void main()
-{
-	gl_Position = MVP * vertexPosition_modelspace;
-	Position_worldspace = (M * vertexPosition_modelspace).xyz;
-	vec3 vertexPosition_cameraspace = (V * M * vertexPosition_modelspace).xyz;
-	EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_cameraspace;
-	vec3 LightPosition_cameraspace = (V * vec4(LightPosition_worldspace, 1)).xyz;
-	LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;
-	Normal_cameraspace = (V * M * vec4(vertexNormal_modelspace, 0)).xyz;
-	UV = vertexUV;
-}
-
+#version 330 core
+
+layout(location = 0) in vec4 vertexPosition_modelspace;
+layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in vec3 vertexNormal_modelspace;
+layout(location = 3) in mat4 instanceM;    // locations 3..6, one per instance
+layout(location = 7) in vec4 instanceTint;
+
+out vec2 UV;
+out vec3 Position_worldspace;
+out vec3 Normal_cameraspace;
+out vec3 EyeDirection_cameraspace;	
+out vec3 LightDirection_cameraspace;
+out vec4 Tint;
+
+uniform mat4 MVP;
+uniform mat4 V;
+uniform mat4 M;
+uniform mat4 VP;
+uniform int Instanced;      // 1: model matrix and tint come from the instance attributes
+uniform vec4 MaterialTint;
+uniform vec3 LightPosition_worldspace;
+
+void main()
+{
+	mat4 Model = Instanced != 0 ? instanceM : M;
+	gl_Position = Instanced != 0 ? VP * Model * vertexPosition_modelspace : MVP * vertexPosition_modelspace;
+	Position_worldspace = (Model * vertexPosition_modelspace).xyz;
+	vec3 vertexPosition_cameraspace = (V * Model * vertexPosition_modelspace).xyz;
+	EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_cameraspace;
+	vec3 LightPosition_cameraspace = (V * vec4(LightPosition_worldspace, 1)).xyz;
+	LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;
+	Normal_cameraspace = (V * Model * vec4(vertexNormal_modelspace, 0)).xyz;
+	UV = vertexUV;
+	Tint = Instanced != 0 ? instanceTint : MaterialTint;
+}
+
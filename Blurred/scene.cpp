@@ -1,397 +1,1179 @@
-#include "scene.h"
-#include "utils.h"
-
-Scene::~Scene()
-{
-  cleanup();
-}
-
-void Scene::SetLightOn   (bool lightOn)    {_lightOn = lightOn;  }
-void Scene::SetSize      (const Size& size){_sizes[SCENE] = size;}
-void Scene::SetAngle     (float angle)     {_angle = angle;      }
-void Scene::SetLightPower(float power)     {_lightPower = power; }
-
-void Scene::loadVertex(GLvoid *vvp, size_t vvSize, GLvoid *uvp, size_t uvSize, GLvoid *ivp, size_t ivSize, GLvoid *nvp, size_t nvSize, size_t count, const std::string& obj_name)
-{
-  if(_vboMap.count(obj_name) > 0)
-  {
-    std::cerr << obj_name.c_str() << " VBO already exists with ids=" << _vboMap[obj_name]._t << ", " << _vboMap[obj_name]._v << ", " << _vboMap[obj_name]._n;
-    return;
-  }
-
-  GLuint bufInd[4] = {0, 0, 0, 0};
-
-  if(vvSize > 0)
-  {
-    glGenBuffers(1, &bufInd[VERTEX]);
-    glBindBuffer(GL_ARRAY_BUFFER, bufInd[VERTEX]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vvSize, vvp, GL_STATIC_DRAW);
-  }
-
-  if(uvSize > 0)
-  {
-    glGenBuffers(1, &bufInd[UV]);
-    glBindBuffer(GL_ARRAY_BUFFER, bufInd[UV]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * uvSize, uvp, GL_STATIC_DRAW);
-  }
-
-  if(ivSize > 0)
-  {
-    glGenBuffers(1, &bufInd[INDEX]);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufInd[INDEX]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLubyte) * ivSize, ivp, GL_STATIC_DRAW);
-  }
-
-  if(nvSize > 0)
-  {
-    glGenBuffers(1, &bufInd[NORMAL]);
-    glBindBuffer(GL_ARRAY_BUFFER, bufInd[NORMAL]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * nvSize, nvp, GL_STATIC_DRAW);
-  }
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-  _vboMap[obj_name] = VBO(bufInd[VERTEX], 
-                          bufInd[UV], 
-                          bufInd[NORMAL],
-                          bufInd[INDEX], 
-                          count);
-}
-
-void Scene::draw(GLuint tInd, VBO& vbo)
-{
-  draw(tInd, vbo._v, 
-             vbo._t, 
-             vbo._n, 
-             vbo._i, 
-             vbo._count);
-}
-
-void Scene::draw(GLuint tInd, GLuint vBuf, GLuint tBuf, GLuint nBuf, GLuint iBuf, size_t vCount)
-{
-  glBindTexture(GL_TEXTURE_2D, tInd);
-
-  glEnableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, vBuf);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-  glEnableVertexAttribArray(1);
-  glBindBuffer(GL_ARRAY_BUFFER, tBuf);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-  if(nBuf > 0) // normals provided
-  {
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, nBuf);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-  }
-  else
-    glDisableVertexAttribArray(2);
-
-  if (iBuf > 0)
-  {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBuf);
-    glDrawElements(GL_TRIANGLES, vCount, GL_UNSIGNED_BYTE, (GLvoid*)0);
-  }
-  else
-    glDrawArrays(GL_TRIANGLES, 0, vCount); // no index data available
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
-
-void Scene::delVBO(VBO &vbo)
-{
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  glDeleteBuffers(1, &vbo._t);
-  glDeleteBuffers(1, &vbo._v);
-
-  if(vbo._n > 0)
-    glDeleteBuffers(1, &vbo._n);
-
-  if(vbo._i > 0)
-  {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glDeleteBuffers(1, &vbo._i);
-  }
-}
-
-void Scene::cleanup()
-{
-  if (!_ready)
-    std::cerr << "warning: trying to cleanup empty scene";
-
-  for(auto& vbo : _vboMap)
-    delVBO(vbo.second);
-
-  for(auto& tex : _textureMap)
-    glDeleteTextures(1, &tex.second);
-
-  _vboMap    .clear();
-  _textureMap.clear();
-
-  glDeleteProgram(_program_2D);
-  glDeleteProgram(_program_3D);
-  glDeleteProgram(_program_2D_blur);
-
-  _program_2D      = 0;
-  _program_3D      = 0;
-  _program_2D_blur = 0;
-
-  glDeleteFramebuffers (1, &_framebufferInd);
-  glDeleteRenderbuffers(1, &_depthrenderbuffer);
-  glDeleteTextures     (1, &_renderedTexture);
-  glDeleteTextures     (1, &_blurMaskTex);
-
-  _framebufferInd    = 0;
-  _depthrenderbuffer = 0;
-  _renderedTexture   = 0;
-  _blurMaskTex       = 0;
-
-  _angle = 0.f;
-  _ready = false;
-}
-
-void Scene::prepareTexture(const std::string& obj_name, const std::string& filename)
-{
-  if (_textureMap.count(obj_name) > 0)
-    std::cerr << "error, trying to reload texture for existing object " << obj_name.c_str();
-  else
-  {
-    _textureMap[obj_name] = 0;
-    bool loaded = utils::loadTexture(filename, _textureMap[obj_name]);
-    if (!loaded)
-    {
-      std::cerr << filename.c_str() << ": unable to load texture.";
-      assert(false);
-    }    
-    glGenerateTextureMipmap(_textureMap[obj_name]);
-  }
-}
-
-void Scene::Load(const Size& rtt_size, const Size& mask_size, mask_type mask_t)
-{
-  if (_ready)
-  {
-    std::cout << "----\n"; // 'new scene' separator in logs
-    cleanup();
-  }
-
-  _sizes[RTT]   = rtt_size;
-  _sizes[MASK]  = mask_size;
-
-  _mask_type = mask_t;
-
-  prepareTexture("background", _bg_filename);
-  prepareTexture("object",     _obj_tex_filename);
-  
-  {//load 3D object
-   bool exist_in_cache = _objCache.count(_obj_filename) > 0;
-   obj_data& obj = _objCache[_obj_filename];
-
-   if (!exist_in_cache)
-   {     
-     obj._count = utils::loadOBJ(_obj_filename.c_str(), obj._vs, obj._uvs, obj._ns);
-     assert(obj._count > 0 && "unable to load object");
-   }
-
-   loadVertex(obj. _vs.data(), 
-              obj. _vs.size(), 
-              obj._uvs.data(), 
-              obj._uvs.size(), (GLvoid*)0, 0, 
-              obj. _ns.data(), 
-              obj. _ns.size(), obj._count, "object");
-  }
-  {
-    //load background geometry
-
-    static GLfloat bg_vertices[4][3] =
-    {
-      {-1.f, -1.f, 0.f},
-      { 1.f, -1.f, 0.f},
-      { 1.f,  1.f, 0.f},
-      {-1.f,  1.f, 0.f}
-    };
-
-    static GLfloat bg_uvs[4][2] =
-    {
-      {0.f, 0.f},
-      {1.f, 0.f},
-      {1.f, 1.f},
-      {0.f, 1.f}
-    };
-
-    static GLubyte bg_indices[] =
-    {
-      0, 1, 2,
-      0, 2, 3
-    };
-
-    loadVertex(bg_vertices, 4 * 3, bg_uvs, 4 * 2, bg_indices, 6, nullptr, 0, 6, "background");
-  } 
-
-  bool shaders_loaded_2D   = utils::loadShaders("2D.vert",      "2D.frag",      _program_2D);
-  bool shaders_loaded_3D   = utils::loadShaders("3D.vert",      "3D.frag",      _program_3D);
-  bool shaders_loaded_2D_b = utils::loadShaders("2D_blur.vert", "2D_blur.frag", _program_2D_blur);
-
-  assert(shaders_loaded_2D   && 
-         shaders_loaded_3D   && 
-         shaders_loaded_2D_b && 
-         "failed to load shaders");
-
-  prepareRTT();
-  buildBlurMask();
-
-  _ready = true;
-}
-
-void Scene::buildBlurMask()
-{
-  glGenTextures(1, &_blurMaskTex);
-  glBindTexture(GL_TEXTURE_2D, _blurMaskTex);
-
-  unsigned char *image = new unsigned char [_sizes[MASK]._x * _sizes[MASK]._y];
-  
-  const size_t center = _sizes[MASK]._x / 2;
-
-  for  (unsigned int y = 0; y < _sizes[MASK]._y; y++)
-    for(unsigned int x = 0; x < _sizes[MASK]._x; x++)
-    {
-      unsigned char value = 0;
-
-      switch (_mask_type)
-      {
-      case SMOOTH:
-        value = unsigned char(UCHAR_MAX * float(x) / (_sizes[MASK]._x - 1));
-        break;
-      case EDGE:
-        value = (x < _sizes[MASK]._x / 2) ? 0 : UCHAR_MAX;
-        break;
-      case PEAK_AT_CENTER:
-        value = unsigned char((1.f - abs(float(center) - x) / (_sizes[MASK]._x / 2.f)) * UCHAR_MAX);
-        break;
-      default:
-        assert(false && "unknown mask type");
-      }
-      image[_sizes[MASK]._x * y + x] = value;
-    }
-
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // mask is one-channel texture
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, _sizes[MASK]._x, _sizes[MASK]._y, 0, GL_RED, GL_UNSIGNED_BYTE, image);
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-
-  glGenerateTextureMipmap(_blurMaskTex);
-
-  delete[] image;
-}
-
-void Scene::prepareRTT()
-{
-  glGenFramebuffers(1, &_framebufferInd);
-  glBindFramebuffer(GL_FRAMEBUFFER, _framebufferInd);
-  
-  glGenTextures(1, &_renderedTexture);
-  glBindTexture(GL_TEXTURE_2D, _renderedTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _sizes[RTT]._x, _sizes[RTT]._y, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-  glGenRenderbuffers(1, &_depthrenderbuffer);
-  glBindRenderbuffer   (GL_RENDERBUFFER, _depthrenderbuffer);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, _sizes[RTT]._x, _sizes[RTT]._y);
-
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depthrenderbuffer);
-
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _renderedTexture, 0);
-  
-  GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
-  glDrawBuffers(1, &drawBuffer);
-  auto st = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-  if(st != GL_FRAMEBUFFER_COMPLETE)
-  {
-    std::cerr << "glDrawBuffers error: " << st;
-    assert(false && "glDrawBuffers");
-  }
-}
-
-void Scene::draw3DObject()
-{
-  glUseProgram(_program_3D);
-
-  GLuint      light_id = glGetUniformLocation(_program_3D, "LightPosition_worldspace");
-  GLuint lightPower_id = glGetUniformLocation(_program_3D, "LightPower");
-  GLuint    lightOn_id = glGetUniformLocation(_program_3D, "Light_On");
-
-  glm::mat4 camRotM = glm::rotate(glm::mat4(), _angle, glm::vec3(0.0, 1.0, 0.0));
-  glm::vec3 camPositionCurr = utils::xyz(camRotM * glm::vec4(0.0, _objDistance, _objDistance, 0.f));
-  glm::mat4 viewMatrix  = glm::lookAt(camPositionCurr, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-  
-  glm::mat4 projectionMatrix = glm::perspective(45.f, 1.f, 0.1f, 20.f);
-  glm::mat4 modelMatrix = glm::mat4(1.0);
-
-  glm::mat4 MVP = projectionMatrix * viewMatrix * modelMatrix;
-
-  GLuint      matrix_id = glGetUniformLocation(_program_3D, "MVP");
-  GLuint  viewMatrix_id = glGetUniformLocation(_program_3D, "V");
-  GLuint modelMatrix_id = glGetUniformLocation(_program_3D, "M");
-
-  glUniformMatrix4fv(     matrix_id, 1, GL_FALSE, &MVP        [0][0]);
-  glUniformMatrix4fv(modelMatrix_id, 1, GL_FALSE, &modelMatrix[0][0]);
-  glUniformMatrix4fv( viewMatrix_id, 1, GL_FALSE, &viewMatrix [0][0]);
-
-  glUniform3f(     light_id, camPositionCurr.x, camPositionCurr.y, camPositionCurr.z);
-  glUniform1f(lightPower_id, _lightPower);
-  glUniform1f(   lightOn_id, _lightOn ? 1.f : 0.f);
-
-  draw(_textureMap["object"], _vboMap["object"]);
-}
-
-void Scene::Frame()
-{
-  glBindFramebuffer(GL_FRAMEBUFFER, _framebufferInd);
-  glViewport(0, 0, _sizes[RTT]._x, _sizes[RTT]._x);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-  glm::mat4 viewM_2D, bgModelM_2D, projM_2D, mvpM_2D;
-  {
-    projM_2D = glm::ortho<float>(-1.f, 1.f, -1.f, 1.f, -1.f, 1.f);
-    mvpM_2D = projM_2D * viewM_2D * bgModelM_2D;
-  }
-  {
-    // background (RTT)
-    glDepthMask(GL_FALSE); // avoid writing depth here
-    glUseProgram(_program_2D);
-    GLuint matrix_id = glGetUniformLocation(_program_2D, "MVP");
-    glUniformMatrix4fv(matrix_id, 1, GL_FALSE, &mvpM_2D[0][0]);
-    draw(_textureMap["background"], _vboMap["background"]);
-    glDepthMask(GL_TRUE);
-  }
-
-  draw3DObject(); // object RTT
-
-  //RTT finished, now rendering to main scene
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glViewport(0, 0, _sizes[SCENE]._x, _sizes[SCENE]._y);
-
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  {
-    glUseProgram(_program_2D_blur);
-    GLuint matrix_id = glGetUniformLocation(_program_2D_blur, "MVP");
-    glUniformMatrix4fv(matrix_id, 1, GL_FALSE, &mvpM_2D[0][0]);
-
-    glActiveTexture(GL_TEXTURE0 + 1); // fragment shader will use two textures, second one for one-channel blur mask 0..1
-    glBindTexture(GL_TEXTURE_2D, _blurMaskTex);
-    glActiveTexture(GL_TEXTURE0);
-
-    GLuint texture_id     = glGetUniformLocation(_program_2D_blur, "currTex");
-    GLuint textureMask_id = glGetUniformLocation(_program_2D_blur, "maskTex");
-
-    glUniform1i(    texture_id, 0);
-    glUniform1i(textureMask_id, 1);
-
-    draw(_renderedTexture, _vboMap["background"]);
-  }
-}
\ No newline at end of file
+#include "scene.h"
+#include "utils.h"
+#include "mesh.h"
+#include "glstate.h"
+#include "blur.h"
+#include "mask.h"
+#include "texture.h"
+#include <algorithm>
+#include <cstddef>
+#include <cfloat>
+#include <cmath>
+#include <iterator>
+#include <chrono>
+#include <future>
+#include <thread>
+
+namespace
+{
+  // longest axis of m's upper 3x3
+  float maxScale(const glm::mat4& m)
+  {
+    return std::sqrt(std::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                     std::max(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])), glm::dot(glm::vec3(m[2]), glm::vec3(m[2])))));
+  }
+
+  // distance from p to the nearest point of box, 0 inside
+  float distance(const glm::vec3& p, const cull::aabb& box)
+  {
+    return glm::length(glm::max(glm::max(box._min - p, p - box._max), glm::vec3(0.f)));
+  }
+
+  const float z_near = 0.1f; // of the object pass projection
+
+  const size_t mask_tile = 32; // screen pixels, BLUR_SIMPLE tiles
+}
+
+Scene::~Scene()
+{
+  cleanup();
+}
+
+void Scene::SetSize(const Size& size)
+{
+  if (size == _sizes[SCENE])
+    return;
+
+  _sizes[SCENE] = size;
+  if (_blurMaskTex != 0) // otherwise buildBlurMask() makes them in Load
+    prepareTiles();
+}
+
+void Scene::SetLightOn   (bool lightOn)    {_lightOn = lightOn;  }
+void Scene::SetAngle     (float angle)     {_angle = angle;      }
+void Scene::SetLightPower(float power)     {_lightPower = power; }
+void Scene::SetMeshOptimization(bool optimize) {_optimizeMesh = optimize;}
+void Scene::SetVertexPacking   (bool pack)     {_packVertices = pack;    }
+void Scene::SetTextureCompression(bool bc1)    {_compressTextures = bc1; }
+void Scene::SetBlurMode        (blur_mode mode){_blur_mode = mode;       }
+void Scene::SetTarget          (GLuint framebuffer){_targetFramebuffer = framebuffer;}
+void Scene::SetCapture(const std::shared_ptr<capture::FrameCapture>& c){_capture = c;}
+
+void Scene::SetBlurRadius(int radius)
+{
+  _blurRadius = std::min(std::max(radius, 1), blur::max_radius);
+  _blurTapsDirty = true;
+}
+
+void Scene::SetObjectMesh(const std::shared_ptr<mesh::MeshFile>& m)
+{
+  assert((!m || m->valid()) && "invalid object mesh");
+  _objectMesh = m;
+
+  if (!_ready)
+    return; // Load() picks it up
+
+  const std::shared_ptr<mesh::MeshFile>& obj = _objectMesh ? _objectMesh : _objCache[_obj_filename];
+  if (!obj)
+  {
+    std::cerr << "object mesh was never loaded\n";
+    return;
+  }
+
+  delVBO(_vboMap["object"]);
+  _vboMap.erase("object");
+  uploadObject(*obj);
+  _objectVBO = &_vboMap["object"];
+  _state.invalidate();
+}
+
+void Scene::SetInstancing(bool instanced) {_instancing = instanced;}
+void Scene::SetCulling   (bool cull)      {_culling = cull;          }
+void Scene::SetLodThreshold(float pixels)  {_lodThreshold = std::max(pixels, 0.f);}
+void Scene::SetMaskTiles   (bool tiles)   {_maskTiles = tiles;       }
+
+void Scene::AddInstances(const std::shared_ptr<mesh::MeshFile>& m, const std::vector<instance>& instances)
+{
+  assert(_ready && m && m->valid() && "instances need a loaded scene and a valid mesh");
+
+  instance_group group;
+  group._name      = "instances" + std::to_string(_instanceGroups.size());
+  group._instances = instances;
+  group._first     = _instanceBoxes.size();
+
+  const mesh::file_header& header = m->header();
+  group._meshBox._min = glm::vec3(header._min[0], header._min[1], header._min[2]);
+  group._meshBox._max = glm::vec3(header._max[0], header._max[1], header._max[2]);
+  for (size_t i = 0; i < instances.size(); i++)
+  {
+    _instanceBoxes.push_back(cull::transform(group._meshBox, instances[i]._model));
+    group._drawn.push_back(uint32_t(group._first + i));
+    group._maxScale = std::max(group._maxScale, maxScale(instances[i]._model));
+  }
+  _instanceBVH.build(_instanceBoxes);
+
+  loadMesh(*m, group._name);
+
+  glGenBuffers(1, &group._buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, group._buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(instance) * instances.size(), instances.data(), GL_DYNAMIC_DRAW); // visible ones with culling
+
+  // model matrix columns at 3..6 and the tint at 7, advancing once per instance
+  glBindVertexArray(_vboMap[group._name]._vao);
+  for (GLuint column = 0; column < 4; column++)
+  {
+    glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)(offsetof(instance, _model) + sizeof(glm::vec4) * column));
+    glVertexAttribDivisor(3 + column, 1);
+    glEnableVertexAttribArray(3 + column);
+  }
+  glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)offsetof(instance, _tint));
+  glVertexAttribDivisor(7, 1);
+  glEnableVertexAttribArray(7);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  _state.invalidate();
+
+  _instanceGroups.push_back(group);
+}
+
+void Scene::ClearInstances()
+{
+  for (instance_group& group : _instanceGroups)
+  {
+    delVBO(_vboMap[group._name]);
+    _vboMap.erase(group._name);
+    glDeleteBuffers(1, &group._buffer);
+  }
+  _instanceGroups.clear();
+  _instanceBoxes.clear();
+  _instanceBVH.build(_instanceBoxes);
+  _state.invalidate();
+}
+
+void Scene::UpdateInstances(size_t g, const std::vector<instance>& instances)
+{
+  assert(g < _instanceGroups.size() && instances.size() == _instanceGroups[g]._instances.size() && "UpdateInstances changes positions only");
+
+  instance_group& group = _instanceGroups[g];
+  group._instances = instances;
+  group._maxScale  = 0.f;
+  for (size_t i = 0; i < instances.size(); i++)
+  {
+    _instanceBoxes[group._first + i] = cull::transform(group._meshBox, instances[i]._model);
+    group._maxScale = std::max(group._maxScale, maxScale(instances[i]._model));
+  }
+  _instanceBVH.refit(_instanceBoxes);
+
+  group._drawn.clear(); // the buffer is stale, next frame uploads
+}
+
+namespace
+{
+  size_t indexSize(GLenum type)
+  {
+    switch (type)
+    {
+    case GL_UNSIGNED_BYTE:  return sizeof(GLubyte);
+    case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+    case GL_UNSIGNED_INT:   return sizeof(GLuint);
+    default:
+      assert(false && "unknown index type");
+      return 0;
+    }
+  }
+
+  // side of pyramid level k (0-based, first level is half of the RTT)
+  GLsizei pyramidSize(size_t rttSide, int level)
+  {
+    return GLsizei(std::max<size_t>(rttSide >> (level + 1), 1));
+  }
+}
+
+void Scene::loadVertex(const void *vp, size_t vCount, const GLvoid *ivp, size_t ivSize, GLenum ivType, bool packed, const std::string& obj_name)
+{
+  if(_vboMap.count(obj_name) > 0)
+  {
+    std::cerr << obj_name.c_str() << " VBO already exists with id=" << _vboMap[obj_name]._v;
+    return;
+  }
+
+  GLuint vao = 0;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  GLuint bufInd[2] = {0, 0};
+  glGenBuffers(2, bufInd);
+
+  glBindBuffer(GL_ARRAY_BUFFER, bufInd[0]);
+  if (packed)
+  {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh::packed_vertex) * vCount, vp, GL_STATIC_DRAW);
+
+    const GLsizei stride = sizeof(mesh::packed_vertex);
+    glVertexAttribPointer(0, 3, GL_FLOAT,              GL_FALSE, stride, (void*)offsetof(mesh::packed_vertex, _pos));
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT,         GL_FALSE, stride, (void*)offsetof(mesh::packed_vertex, _uv));
+    glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE,  stride, (void*)offsetof(mesh::packed_vertex, _n));
+  }
+  else
+  {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh::vertex) * vCount, vp, GL_STATIC_DRAW);
+
+    const GLsizei stride = sizeof(mesh::vertex);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(mesh::vertex, _pos));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(mesh::vertex, _uv));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(mesh::vertex, _n));
+  }
+
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufInd[1]); // element buffer binding is part of the VAO
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize(ivType) * ivSize, ivp, GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  _vboMap[obj_name] = VBO(vao, bufInd[0], bufInd[1], ivSize, ivType);
+}
+
+void Scene::loadMesh(const mesh::MeshFile& m, const std::string& obj_name)
+{
+  const mesh::file_header& header = m.header();
+  loadVertex(m.vertices(), header._vertexCount,
+             m.indices(),  header._indexCount, header._indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, m.packed(), obj_name);
+
+  VBO& vbo = _vboMap[obj_name];
+  vbo._lods.clear();
+  for (size_t l = 0; l < header._lods; l++)
+  {
+    const lod_range range = {header._lodFirst[l], header._lodCount[l], header._lodError[l]};
+    vbo._lods.push_back(range);
+  }
+}
+
+void Scene::uploadObject(const mesh::MeshFile& obj)
+{
+  const mesh::file_header& header = obj.header();
+  loadMesh(obj, "object");
+
+  _objectBox._min = glm::vec3(header._min[0], header._min[1], header._min[2]);
+  _objectBox._max = glm::vec3(header._max[0], header._max[1], header._max[2]);
+}
+
+void Scene::draw(GLuint tInd, const VBO& vbo, size_t lod)
+{
+  const GLuint first = lod < vbo._lods.size() ? vbo._lods[lod]._first : 0;
+  const GLuint count = lod < vbo._lods.size() ? vbo._lods[lod]._count : vbo._count;
+
+  _state.bindTexture(0, tInd);
+  _state.bindVertexArray(vbo._vao);
+  glDrawElements(GL_TRIANGLES, count, vbo._iType, (GLvoid*)(first * indexSize(vbo._iType)));
+  _drawCalls++;
+  _triangles += count / 3;
+}
+
+size_t Scene::selectLod(const VBO& vbo, float unitPixels) const
+{
+  if (_lodThreshold <= 0.f)
+    return 0;
+
+  for (size_t l = vbo._lods.size(); l-- > 1; )
+    if (vbo._lods[l]._error * unitPixels <= _lodThreshold)
+      return l;
+  return 0;
+}
+
+void Scene::delVBO(VBO &vbo)
+{
+  glBindVertexArray(0);
+  glDeleteVertexArrays(1, &vbo._vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &vbo._v);
+  glDeleteBuffers(1, &vbo._i);
+}
+
+void Scene::cleanup()
+{
+  if (!_ready)
+    std::cerr << "warning: trying to cleanup empty scene";
+
+  ClearInstances();
+
+  for(auto& vbo : _vboMap)
+    delVBO(vbo.second);
+
+  for(auto& tex : _textureMap)
+    glDeleteTextures(1, &tex.second);
+
+  _vboMap    .clear();
+  _textureMap.clear();
+
+  gl::deleteProgram(_program_2D);
+  gl::deleteProgram(_program_3D);
+  gl::deleteProgram(_program_2D_blur);
+  gl::deleteProgram(_program_2D_blur_sep);
+  gl::deleteProgram(_program_kawase_down);
+  gl::deleteProgram(_program_2D_blur_pyramid);
+  gl::deleteProgram(_program_blur_box);
+  gl::deleteProgram(_program_2D_blur_only);
+
+  _objectVBO     = nullptr;
+  _backgroundVBO = nullptr;
+  _objectTex     = 0;
+  _backgroundTex = 0;
+
+  releaseRTT();
+  releaseMask();
+
+  glDeleteSamplers(1, &_linearSampler);
+  _linearSampler = 0;
+
+  _profiler.release();
+
+  _angle = 0.f;
+  _ready = false;
+}
+
+void Scene::releaseRTT()
+{
+  glDeleteFramebuffers (1, &_framebufferInd);
+  glDeleteRenderbuffers(1, &_depthrenderbuffer);
+  glDeleteTextures     (1, &_renderedTexture);
+  glDeleteFramebuffers (1, &_blurFramebuffer);
+  glDeleteTextures     (1, &_blurTexture);
+  glDeleteFramebuffers (blur::pyramid_levels, _pyramidFramebuffers);
+  glDeleteTextures     (blur::pyramid_levels, _pyramidTextures);
+  glDeleteFramebuffers (blur::pyramid_levels - 1, _pyramidUpFramebuffers);
+  glDeleteTextures     (blur::pyramid_levels - 1, _pyramidUpTextures);
+
+  _framebufferInd    = 0;
+  _depthrenderbuffer = 0;
+  _renderedTexture   = 0;
+  _blurFramebuffer   = 0;
+  _blurTexture       = 0;
+  std::fill(std::begin(_pyramidFramebuffers), std::end(_pyramidFramebuffers), 0);
+  std::fill(std::begin(_pyramidTextures),     std::end(_pyramidTextures),     0);
+  std::fill(std::begin(_pyramidUpFramebuffers), std::end(_pyramidUpFramebuffers), 0);
+  std::fill(std::begin(_pyramidUpTextures),     std::end(_pyramidUpTextures),     0);
+}
+
+void Scene::releaseMask()
+{
+  glDeleteTextures(1, &_blurMaskTex);
+  _blurMaskTex = 0;
+}
+
+void Scene::prepareTexture(const std::string& obj_name, const texture::TextureFile& file)
+{
+  if (_textureMap.count(obj_name) > 0)
+    std::cerr << "error, trying to reload texture for existing object " << obj_name.c_str();
+  else
+  {
+    const load_clock::time_point start = load_clock::now();
+
+    _textureMap[obj_name] = 0;
+    _textureStats._bytes += texture::upload(file, _textureMap[obj_name]); // mips come with the file
+
+    _textureStats._uploadSeconds += std::chrono::duration<double>(load_clock::now() - start).count();
+  }
+}
+
+namespace
+{
+  template<typename T>
+  bool ready(const std::future<T>& f)
+  {
+    return f.valid() && f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  struct texture_job
+  {
+    std::shared_ptr<texture::TextureFile> _file;
+    double _seconds;
+  };
+
+  // maps the texture file, or decodes the image and builds it; _file is null when neither works
+  texture_job loadTexture(const std::string& filename, texture::format f)
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    texture_job job;
+    job._file = texture::load(filename.c_str(), texture::cachePath(filename).c_str(), f);
+    if (job._file && !job._file->valid())
+      job._file.reset();
+    if (!job._file)
+      std::cerr << filename.c_str() << ": unable to load texture, drawn without it\n";
+
+    job._seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return job;
+  }
+}
+
+void Scene::Load(const Size& rtt_size, const Size& mask_size, mask_type mask_t)
+{
+  if (_ready)
+  {
+    std::cout << "----\n"; // 'new scene' separator in logs
+    cleanup();
+  }
+
+  const load_clock::time_point start = load_clock::now();
+
+  _sizes[RTT]   = rtt_size;
+  _sizes[MASK]  = mask_size;
+
+  _mask_type = mask_t;
+
+  // texture files and mesh parsing run on worker threads, this (GL) thread only uploads
+  const texture::format texFormat = _compressTextures ? texture::BC1 : texture::BGRA8;
+  _textureStats = texture_stats();
+  std::future<texture_job> bgImage  = std::async(std::launch::async, loadTexture, _bg_filename,      texFormat);
+  std::future<texture_job> objImage = std::async(std::launch::async, loadTexture, _obj_tex_filename, texFormat);
+
+  std::future<std::shared_ptr<mesh::MeshFile>> objMesh;
+  if (!_objectMesh && !_objCache[_obj_filename])
+  {
+    const std::string obj_path = _obj_filename, mesh_path = _obj_mesh_filename;
+    const bool optimize = _optimizeMesh, packed = _packVertices;
+    objMesh = std::async(std::launch::async, [obj_path, mesh_path, optimize, packed]()
+    {
+      return mesh::load(obj_path.c_str(), mesh_path.c_str(), optimize, packed);
+    });
+  }
+
+  // programs compile in the driver meanwhile, with GL_ARB_parallel_shader_compile they don't block here
+  struct program_source
+  {
+    const char  *_vert, *_frag; // no _frag: _vert is a compute shader
+    gl::program *_program;
+  };
+  const program_source sources[] =
+  {
+    {"2D.vert",      "2D.frag",              &_program_2D},
+    {"3D.vert",      "3D.frag",              &_program_3D},
+    {"2D_blur.vert", "2D_blur.frag",         &_program_2D_blur},
+    {"2D_blur.vert", "2D_blur_only.frag",    &_program_2D_blur_only},
+    {"2D_blur.vert", "2D_blur_sep.frag",     &_program_2D_blur_sep},
+    {"2D_blur.vert", "2D_kawase_down.frag",  &_program_kawase_down},
+    {"2D_blur.vert", "2D_blur_pyramid.frag", &_program_2D_blur_pyramid},
+    {"2D_blur_box.comp", nullptr,            &_program_blur_box}
+  };
+  const size_t program_count = sizeof(sources) / sizeof(sources[0]);
+
+  // compute shaders and image load/store, BLUR_COMPUTE falls back to BLUR_SEPARABLE without them
+  const bool compute = GLEW_VERSION_4_3 != 0;
+  if (!compute)
+    std::cout << "no OpenGL 4.3, compute blur replaced by separable\n";
+
+  gl::enableParallelCompile();
+  std::vector<gl::program_build> builds(program_count);
+  std::vector<bool> building(program_count);
+
+  // a program that fails to build stays 0 with no active uniforms: its pass draws nothing, the rest still works
+  auto unbuilt = [&](size_t i)
+  {
+    gl::program& p = *sources[i]._program;
+    p._id = 0;
+    std::fill(std::begin(p._uniforms), std::end(p._uniforms), -1);
+    std::cerr << "program " << builds[i]._name << " not built, its pass is skipped\n";
+  };
+
+  for (size_t i = 0; i < program_count; i++)
+  {
+    if (!sources[i]._frag && !compute)
+      continue;
+
+    building[i] = sources[i]._frag ? gl::beginProgram(sources[i]._vert, sources[i]._frag, builds[i], &_programCache)
+                                   : gl::beginComputeProgram(sources[i]._vert, builds[i], &_programCache);
+    if (!building[i])
+      unbuilt(i);
+  }
+
+  {
+    //load background geometry
+
+    static const mesh::vertex bg_vertices[4] =
+    {
+      {{-1.f, -1.f, 0.f}, {0.f, 0.f}, {0.f, 0.f, 1.f}},
+      {{ 1.f, -1.f, 0.f}, {1.f, 0.f}, {0.f, 0.f, 1.f}},
+      {{ 1.f,  1.f, 0.f}, {1.f, 1.f}, {0.f, 0.f, 1.f}},
+      {{-1.f,  1.f, 0.f}, {0.f, 1.f}, {0.f, 0.f, 1.f}}
+    };
+
+    static GLubyte bg_indices[] =
+    {
+      0, 1, 2,
+      0, 2, 3
+    };
+
+    loadVertex(bg_vertices, 4, bg_indices, 6, GL_UNSIGNED_BYTE, false, "background");
+  }
+
+  glGenSamplers(1, &_linearSampler);
+  glSamplerParameteri(_linearSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glSamplerParameteri(_linearSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glSamplerParameteri(_linearSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glSamplerParameteri(_linearSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  prepareRTT();
+  buildBlurMask();
+
+  // upload whatever is ready, in any order
+  bool objectPending = true;
+  size_t programsPending = size_t(std::count(building.begin(), building.end(), true));
+  while (bgImage.valid() || objImage.valid() || objectPending || programsPending > 0)
+  {
+    bool progressed = false;
+
+    if (ready(bgImage))
+    {
+      const texture_job job = bgImage.get();
+      _textureStats._loadSeconds += job._seconds;
+      if (job._file)
+        prepareTexture("background", *job._file);
+      progressed = true;
+    }
+    if (ready(objImage))
+    {
+      const texture_job job = objImage.get();
+      _textureStats._loadSeconds += job._seconds;
+      if (job._file)
+        prepareTexture("object", *job._file);
+      progressed = true;
+    }
+    if (ready(objMesh))
+      _objCache[_obj_filename] = objMesh.get();
+
+    if (objectPending && !objMesh.valid())
+    {
+      const std::shared_ptr<mesh::MeshFile>& obj = _objectMesh ? _objectMesh : _objCache[_obj_filename];
+      if (obj && obj->valid())
+        uploadObject(*obj);
+      else
+        std::cerr << _obj_filename.c_str() << ": unable to load object, the scene has none\n";
+      objectPending = false;
+      progressed = true;
+    }
+
+    for (size_t i = 0; i < program_count; i++)
+      if (building[i] && gl::programReady(builds[i]))
+      {
+        if (!gl::finishProgram(builds[i], *sources[i]._program))
+          unbuilt(i);
+
+        building[i] = false;
+        programsPending--;
+        progressed = true;
+      }
+
+    if (!progressed)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  _programCache.save();
+
+  // samplers never change, blur pass reads the RTT from unit 0 and the one-channel mask from unit 1
+  glUseProgram(_program_2D_blur._id);
+  glUniform1i(_program_2D_blur[gl::U_CURR_TEX], 0);
+  glUniform1i(_program_2D_blur[gl::U_MASK_TEX], 1);
+
+  glUseProgram(_program_2D_blur_only._id);
+  glUniform1i(_program_2D_blur_only[gl::U_CURR_TEX], 0);
+
+  glUseProgram(_program_2D_blur_sep._id);
+  glUniform1i(_program_2D_blur_sep[gl::U_CURR_TEX], 0);
+  glUniform1i(_program_2D_blur_sep[gl::U_MASK_TEX], 1);
+  glUniform1i(_program_2D_blur_sep[gl::U_BASE_TEX], 2);
+  _blurTapsDirty = true;
+
+  glUseProgram(_program_kawase_down._id);
+  glUniform1i(_program_kawase_down[gl::U_CURR_TEX], 0);
+
+  glUseProgram(_program_2D_blur_pyramid._id);
+  glUniform1i(_program_2D_blur_pyramid[gl::U_CURR_TEX], 0);
+  glUniform1i(_program_2D_blur_pyramid[gl::U_MASK_TEX], 1);
+  glUniform1i(_program_2D_blur_pyramid[gl::U_PYRAMID_TEX], 2);
+
+  if (_program_blur_box._id)
+  {
+    glUseProgram(_program_blur_box._id);
+    glUniform1i(_program_blur_box[gl::U_CURR_TEX], 0);
+    glUniform1i(_program_blur_box[gl::U_MASK_TEX], 1);
+  }
+
+  _objectVBO     = &_vboMap["object"];
+  _backgroundVBO = &_vboMap["background"];
+  _objectTex     = _textureMap["object"];
+  _backgroundTex = _textureMap["background"];
+
+  _state.invalidate(); // loading bound things directly
+
+  _loadSeconds = std::chrono::duration<double>(load_clock::now() - start).count();
+  _ready = true;
+}
+
+void Scene::Reconfigure(const Size& rtt_size, const Size& mask_size, mask_type mask_t)
+{
+  if (!_ready)
+  {
+    Load(rtt_size, mask_size, mask_t);
+    return;
+  }
+
+  if (rtt_size != _sizes[RTT])
+  {
+    releaseRTT();
+    _sizes[RTT] = rtt_size;
+    prepareRTT();
+  }
+
+  if (mask_size != _sizes[MASK] || mask_t != _mask_type)
+  {
+    releaseMask();
+    _sizes[MASK] = mask_size;
+    _mask_type   = mask_t;
+    buildBlurMask();
+  }
+
+  _state.invalidate(); // deleted names may come back from glGen* bound elsewhere
+}
+
+void Scene::buildBlurMask()
+{
+  static_assert(int(SMOOTH) == mask::SMOOTH && int(EDGE) == mask::EDGE && int(PEAK_AT_CENTER) == mask::PEAK_AT_CENTER,
+                "mask_type must match mask::type");
+
+  const mask::Cache::image image = _maskCache.get(mask::type(_mask_type), _sizes[MASK]._x, _sizes[MASK]._y);
+
+  glGenTextures(1, &_blurMaskTex);
+  glBindTexture(GL_TEXTURE_2D, _blurMaskTex);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // mask is one-channel texture
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, _sizes[MASK]._x, _sizes[MASK]._y, 0, GL_RED, GL_UNSIGNED_BYTE, image->data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  glGenerateTextureMipmap(_blurMaskTex);
+
+  prepareTiles();
+}
+
+void Scene::prepareTiles()
+{
+  if (_sizes[SCENE]._x == 0 || _sizes[SCENE]._y == 0)
+    return; // SetSize() comes later
+
+  const mask::Cache::tile_set tiles = _maskCache.getTiles(mask::type(_mask_type), _sizes[MASK]._x, _sizes[MASK]._y,
+                                                          _sizes[SCENE]._x, _sizes[SCENE]._y, mask_tile);
+
+  // a quad per run, in the background's coordinates: -1..1 over the screen, uv 0..1
+  std::vector<mesh::vertex> vertices;
+  std::vector<GLuint>       indices;
+  _tileStats = tile_stats();
+  for (int c = 0; c < mask::TILE_CLASS_COUNT; c++)
+  {
+    _tileFirst[c] = GLuint(indices.size());
+    for (const mask::tile_run& run : tiles->_runs[c])
+    {
+      const float u0 = float(run._x) / _sizes[SCENE]._x, u1 = float(run._x + run._width)  / _sizes[SCENE]._x;
+      const float v0 = float(run._y) / _sizes[SCENE]._y, v1 = float(run._y + run._height) / _sizes[SCENE]._y;
+
+      const GLuint base = GLuint(vertices.size());
+      const mesh::vertex quad[4] =
+      {
+        {{2.f * u0 - 1.f, 2.f * v0 - 1.f, 0.f}, {u0, v0}, {0.f, 0.f, 1.f}},
+        {{2.f * u1 - 1.f, 2.f * v0 - 1.f, 0.f}, {u1, v0}, {0.f, 0.f, 1.f}},
+        {{2.f * u1 - 1.f, 2.f * v1 - 1.f, 0.f}, {u1, v1}, {0.f, 0.f, 1.f}},
+        {{2.f * u0 - 1.f, 2.f * v1 - 1.f, 0.f}, {u0, v1}, {0.f, 0.f, 1.f}}
+      };
+      vertices.insert(vertices.end(), quad, quad + 4);
+
+      const GLuint quadIndices[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+      indices.insert(indices.end(), quadIndices, quadIndices + 6);
+    }
+    _tileCount[c] = GLuint(indices.size()) - _tileFirst[c];
+
+    _tileStats._pixels[c]    = tiles->_pixels[c];
+    _tileStats._quads       += tiles->_runs[c].size();
+    _tileStats._fetches     += tiles->_pixels[c] * mask::tile_fetches[c];
+    _tileStats._fullFetches += tiles->_pixels[c] * mask::tile_fetches[mask::TILE_PARTIAL];
+  }
+
+  auto old = _vboMap.find("tiles");
+  if (old != _vboMap.end())
+  {
+    delVBO(old->second);
+    _vboMap.erase(old);
+  }
+  if (!vertices.empty())
+    loadVertex(vertices.data(), vertices.size(), indices.data(), indices.size(), GL_UNSIGNED_INT, false, "tiles");
+
+  _state.invalidate(); // loadVertex bound the new VAO directly
+}
+
+void Scene::prepareRTT()
+{
+  glGenFramebuffers(1, &_framebufferInd);
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebufferInd);
+  
+  glGenTextures(1, &_renderedTexture);
+  glBindTexture(GL_TEXTURE_2D, _renderedTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _sizes[RTT]._x, _sizes[RTT]._y, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0); // sized, BLUR_COMPUTE binds it as an image
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+  glGenRenderbuffers(1, &_depthrenderbuffer);
+  glBindRenderbuffer   (GL_RENDERBUFFER, _depthrenderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, _sizes[RTT]._x, _sizes[RTT]._y);
+
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depthrenderbuffer);
+
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _renderedTexture, 0);
+  
+  GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+  glDrawBuffers(1, &drawBuffer);
+  auto st = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if(st != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "glDrawBuffers error: " << st;
+    assert(false && "glDrawBuffers");
+  }
+
+  // target of the horizontal blur pass, no depth needed
+  glGenFramebuffers(1, &_blurFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, _blurFramebuffer);
+
+  glGenTextures(1, &_blurTexture);
+  glBindTexture(GL_TEXTURE_2D, _blurTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _sizes[RTT]._x, _sizes[RTT]._y, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0); // sized, BLUR_COMPUTE binds it as an image
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _blurTexture, 0);
+  glDrawBuffers(1, &drawBuffer);
+  st = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if(st != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "blur framebuffer error: " << st;
+    assert(false && "blur framebuffer");
+  }
+
+  // BLUR_PYRAMID downsample and upsample chains; sampled with bilinear filtering, sizes never below 1x1
+  glGenFramebuffers(blur::pyramid_levels, _pyramidFramebuffers);
+  glGenTextures    (blur::pyramid_levels, _pyramidTextures);
+  glGenFramebuffers(blur::pyramid_levels - 1, _pyramidUpFramebuffers);
+  glGenTextures    (blur::pyramid_levels - 1, _pyramidUpTextures);
+  for (int target = 0; target < 2 * blur::pyramid_levels - 1; target++)
+  {
+    const bool up = target >= blur::pyramid_levels;
+    const int level = up ? target - blur::pyramid_levels : target;
+    const GLuint tex = up ? _pyramidUpTextures[level] : _pyramidTextures[level];
+
+    glBindFramebuffer(GL_FRAMEBUFFER, up ? _pyramidUpFramebuffers[level] : _pyramidFramebuffers[level]);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pyramidSize(_sizes[RTT]._x, level), pyramidSize(_sizes[RTT]._y, level), 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex, 0);
+    glDrawBuffers(1, &drawBuffer);
+    st = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if(st != GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cerr << "pyramid framebuffer " << level << " error: " << st;
+      assert(false && "pyramid framebuffer");
+    }
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Scene::draw3DObject()
+{
+  _state.useProgram(_program_3D._id);
+
+  glm::mat4 camRotM = glm::rotate(glm::mat4(), _angle, glm::vec3(0.0, 1.0, 0.0));
+  glm::vec3 camPositionCurr = utils::xyz(camRotM * glm::vec4(0.0, _objDistance, _objDistance, 0.f));
+  glm::mat4 viewMatrix  = glm::lookAt(camPositionCurr, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+  
+  glm::mat4 projectionMatrix = glm::perspective(45.f, 1.f, z_near, 20.f);
+  glm::mat4 modelMatrix = glm::mat4(1.0);
+
+  glm::mat4 MVP = projectionMatrix * viewMatrix * modelMatrix;
+
+  glUniformMatrix4fv(_program_3D[gl::U_MVP], 1, GL_FALSE, &MVP        [0][0]);
+  glUniformMatrix4fv(_program_3D[gl::U_M],   1, GL_FALSE, &modelMatrix[0][0]);
+  glUniformMatrix4fv(_program_3D[gl::U_V],   1, GL_FALSE, &viewMatrix [0][0]);
+
+  glUniform3f(_program_3D[gl::U_LIGHT_POSITION], camPositionCurr.x, camPositionCurr.y, camPositionCurr.z);
+  glUniform1f(_program_3D[gl::U_LIGHT_POWER],    _lightPower);
+  glUniform1f(_program_3D[gl::U_LIGHT_ON],       _lightOn ? 1.f : 0.f);
+  glUniform1i(_program_3D[gl::U_INSTANCED],      0);
+  glUniform4f(_program_3D[gl::U_MATERIAL_TINT],  1.f, 1.f, 1.f, 1.f);
+
+  // RTT pixels per object space unit at distance 1
+  const float focalPixels = projectionMatrix[1][1] * 0.5f * _sizes[RTT]._y;
+
+  const glm::mat4 vp = projectionMatrix * viewMatrix;
+  if (cullObjects(vp))
+    draw(_objectTex, *_objectVBO, selectLod(*_objectVBO, focalPixels / std::max(distance(camPositionCurr, _objectBox), z_near)));
+
+  if (!_instanceGroups.empty())
+    drawInstances(vp, camPositionCurr, focalPixels);
+}
+
+bool Scene::cullObjects(const glm::mat4& vp)
+{
+  _cullStats = cull_stats();
+  if (!_culling)
+    return true;
+
+  const load_clock::time_point start = load_clock::now();
+
+  const cull::frustum f = cull::fromMatrix(vp);
+  const bool objectVisible = cull::test(f, _objectBox) != cull::OUTSIDE; // model matrix is identity
+
+  _instanceBVH.cull(f, _visibleInstances);
+
+  // ascending indices, so each group's visible instances are one run
+  size_t v = 0;
+  for (instance_group& group : _instanceGroups)
+  {
+    group._visible.clear();
+    const size_t end = group._first + group._instances.size();
+    for (; v < _visibleInstances.size() && _visibleInstances[v] < end; v++)
+      group._visible.push_back(_visibleInstances[v]);
+  }
+
+  _cullStats._tested  = 1 + _instanceBoxes.size();
+  _cullStats._visible = (objectVisible ? 1 : 0) + _visibleInstances.size();
+  _cullStats._seconds = std::chrono::duration<double>(load_clock::now() - start).count();
+  return objectVisible;
+}
+
+void Scene::drawInstances(const glm::mat4& vp, const glm::vec3& eye, float focalPixels)
+{
+  // _program_3D is current with the view and light uniforms of draw3DObject()
+  const gl::program& p = _program_3D;
+
+  if (_instancing)
+  {
+    glUniform1i(p[gl::U_INSTANCED], 1);
+    glUniformMatrix4fv(p[gl::U_VP], 1, GL_FALSE, &vp[0][0]);
+
+    _state.bindTexture(0, _objectTex);
+    for (instance_group& group : _instanceGroups)
+    {
+      // the instance buffer holds the visible instances only, rewritten when that set changes
+      const bool all = !_culling;
+      if (all ? group._drawn.size() != group._instances.size() : group._drawn != group._visible)
+      {
+        group._drawn.clear();
+        _instanceStaging.clear();
+        for (size_t i = 0; i < group._instances.size(); i++)
+          if (all || std::binary_search(group._visible.begin(), group._visible.end(), uint32_t(group._first + i)))
+          {
+            group._drawn.push_back(uint32_t(group._first + i));
+            _instanceStaging.push_back(group._instances[i]);
+          }
+
+        glBindBuffer(GL_ARRAY_BUFFER, group._buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(instance) * _instanceStaging.size(), _instanceStaging.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+      }
+      if (group._drawn.empty())
+        continue;
+
+      // one level for the whole draw, as fine as the nearest instance needs
+      const VBO& vbo = _vboMap[group._name];
+      size_t lod = 0;
+      if (vbo._lods.size() > 1 && _lodThreshold > 0.f)
+      {
+        float nearest = FLT_MAX;
+        for (uint32_t box : group._drawn)
+          nearest = std::min(nearest, distance(eye, _instanceBoxes[box]));
+        lod = selectLod(vbo, focalPixels * group._maxScale / std::max(nearest, z_near));
+      }
+
+      const GLuint first = lod < vbo._lods.size() ? vbo._lods[lod]._first : 0;
+      const GLuint count = lod < vbo._lods.size() ? vbo._lods[lod]._count : vbo._count;
+
+      _state.bindVertexArray(vbo._vao);
+      glDrawElementsInstanced(GL_TRIANGLES, count, vbo._iType, (GLvoid*)(first * indexSize(vbo._iType)), GLsizei(group._drawn.size()));
+      _drawCalls++;
+      _triangles += count / 3 * group._drawn.size();
+    }
+    return;
+  }
+
+  for (const instance_group& group : _instanceGroups)
+  {
+    const VBO& vbo = _vboMap[group._name];
+    for (size_t i = 0; i < group._instances.size(); i++)
+    {
+      if (_culling && !std::binary_search(group._visible.begin(), group._visible.end(), uint32_t(group._first + i)))
+        continue;
+
+      const instance& inst = group._instances[i];
+      const glm::mat4 mvp = vp * inst._model;
+      glUniformMatrix4fv(p[gl::U_MVP], 1, GL_FALSE, &mvp[0][0]);
+      glUniformMatrix4fv(p[gl::U_M],   1, GL_FALSE, &inst._model[0][0]);
+      glUniform4fv(p[gl::U_MATERIAL_TINT], 1, &inst._tint[0]);
+
+      const float unitPixels = focalPixels * maxScale(inst._model) / std::max(distance(eye, _instanceBoxes[group._first + i]), z_near);
+      draw(_objectTex, vbo, selectLod(vbo, unitPixels));
+    }
+  }
+}
+
+void Scene::Frame()
+{
+  _state.beginFrame();
+  _profiler.beginFrame();
+  _drawCalls = 0;
+  _triangles = 0;
+
+  _profiler.begin(profiler::BACKGROUND);
+  _state.bindFramebuffer(_framebufferInd);
+  glViewport(0, 0, _sizes[RTT]._x, _sizes[RTT]._y);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glm::mat4 viewM_2D, bgModelM_2D, projM_2D, mvpM_2D;
+  {
+    projM_2D = glm::ortho<float>(-1.f, 1.f, -1.f, 1.f, -1.f, 1.f);
+    mvpM_2D = projM_2D * viewM_2D * bgModelM_2D;
+  }
+  {
+    // background (RTT)
+    glDepthMask(GL_FALSE); // avoid writing depth here
+    _state.useProgram(_program_2D._id);
+    glUniformMatrix4fv(_program_2D[gl::U_MVP], 1, GL_FALSE, &mvpM_2D[0][0]);
+    draw(_backgroundTex, *_backgroundVBO);
+    glDepthMask(GL_TRUE);
+  }
+  _profiler.end(profiler::BACKGROUND);
+
+  _profiler.begin(profiler::OBJECT);
+  draw3DObject(); // object RTT
+  _profiler.end(profiler::OBJECT);
+
+  //RTT finished, now rendering to main scene
+  _profiler.begin(profiler::BLUR);
+  switch (_blur_mode)
+  {
+  case BLUR_SEPARABLE:
+    blurSeparable(mvpM_2D);
+    break;
+  case BLUR_PYRAMID:
+    blurPyramid(mvpM_2D);
+    break;
+  case BLUR_COMPUTE:
+    if (_program_blur_box._id)
+      blurCompute(mvpM_2D);
+    else
+      blurSeparable(mvpM_2D);
+    break;
+  default:
+    blurSimple(mvpM_2D);
+    break;
+  }
+  _profiler.end(profiler::BLUR);
+
+  if (_capture)
+    _capture->capture(_targetFramebuffer, _sizes[SCENE]._x, _sizes[SCENE]._y);
+}
+
+void Scene::blurSimple(const glm::mat4& mvp)
+{
+  _state.bindFramebuffer(_targetFramebuffer);
+  glViewport(0, 0, _sizes[SCENE]._x, _sizes[SCENE]._y);
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  if (!_maskTiles)
+  {
+    _state.useProgram(_program_2D_blur._id);
+    glUniformMatrix4fv(_program_2D_blur[gl::U_MVP], 1, GL_FALSE, &mvp[0][0]);
+
+    _state.bindTexture(1, _blurMaskTex); // fragment shader will use two textures, second one for one-channel blur mask 0..1
+    draw(_renderedTexture, *_backgroundVBO);
+    return;
+  }
+
+  auto tiles = _vboMap.find("tiles");
+  if (tiles == _vboMap.end())
+    return;
+
+  // same result as the blended shader everywhere: where the mask is 0 it gives the RTT, where it is 1 the blur
+  const gl::program *programs[mask::TILE_CLASS_COUNT] = {&_program_2D, &_program_2D_blur_only, &_program_2D_blur};
+
+  _state.bindTexture(0, _renderedTexture);
+  _state.bindTexture(1, _blurMaskTex);
+  _state.bindVertexArray(tiles->second._vao);
+  for (int c = 0; c < mask::TILE_CLASS_COUNT; c++)
+  {
+    if (_tileCount[c] == 0)
+      continue;
+
+    const gl::program& p = *programs[c];
+    _state.useProgram(p._id);
+    glUniformMatrix4fv(p[gl::U_MVP], 1, GL_FALSE, &mvp[0][0]);
+
+    glDrawElements(GL_TRIANGLES, _tileCount[c], GL_UNSIGNED_INT, (GLvoid*)(_tileFirst[c] * sizeof(GLuint)));
+    _drawCalls++;
+    _triangles += _tileCount[c] / 3;
+  }
+}
+
+void Scene::blurSeparable(const glm::mat4& mvp)
+{
+  const gl::program& p = _program_2D_blur_sep;
+  _state.useProgram(p._id);
+  glUniformMatrix4fv(p[gl::U_MVP], 1, GL_FALSE, &mvp[0][0]);
+
+  if (_blurTapsDirty)
+  {
+    std::vector<float> offsets, weights;
+    blur::linearTaps(blur::gaussianWeights(_blurRadius), offsets, weights);
+
+    glUniform1i (p[gl::U_TAP_COUNT],   GLint(offsets.size()));
+    glUniform1fv(p[gl::U_TAP_OFFSETS], GLsizei(offsets.size()), offsets.data());
+    glUniform1fv(p[gl::U_TAP_WEIGHTS], GLsizei(weights.size()), weights.data());
+    _blurTapsDirty = false;
+  }
+
+  glBindSampler(0, _linearSampler); // taps fall between texels
+
+  // horizontal, RTT -> _blurTexture; overwrite, no blending with stale content
+  _state.bindFramebuffer(_blurFramebuffer);
+  glViewport(0, 0, _sizes[RTT]._x, _sizes[RTT]._y);
+  glDisable(GL_BLEND);
+
+  glUniform2f(p[gl::U_BLUR_STEP], 1.f / _sizes[RTT]._x, 0.f);
+  glUniform1f(p[gl::U_COMPOSITE], 0.f);
+  draw(_renderedTexture, *_backgroundVBO);
+
+  glEnable(GL_BLEND);
+
+  // vertical, blended over the unblurred RTT by the mask, to the screen
+  _state.bindFramebuffer(_targetFramebuffer);
+  glViewport(0, 0, _sizes[SCENE]._x, _sizes[SCENE]._y);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  _state.bindTexture(1, _blurMaskTex);
+  _state.bindTexture(2, _renderedTexture);
+
+  glUniform2f(p[gl::U_BLUR_STEP], 0.f, 1.f / _sizes[RTT]._y);
+  glUniform1f(p[gl::U_COMPOSITE], 1.f);
+  draw(_blurTexture, *_backgroundVBO);
+
+  glBindSampler(0, 0);
+}
+
+void Scene::blurPyramid(const glm::mat4& mvp)
+{
+  const float maxLevel = blur::pyramidLevel(_blurRadius);
+  const int   levels   = int(std::ceil(maxLevel)); // deeper levels get zero weight
+
+  // downsample chain, RTT -> level 0 -> level 1 ..; each pass overwrites its whole target
+  _state.useProgram(_program_kawase_down._id);
+  glUniformMatrix4fv(_program_kawase_down[gl::U_MVP], 1, GL_FALSE, &mvp[0][0]);
+  glDisable(GL_BLEND);
+
+  GLuint src = _renderedTexture;
+  size_t srcX = _sizes[RTT]._x, srcY = _sizes[RTT]._y;
+  for (int level = 0; level < levels; level++)
+  {
+    const GLsizei dstX = pyramidSize(_sizes[RTT]._x, level), dstY = pyramidSize(_sizes[RTT]._y, level);
+
+    _state.bindFramebuffer(_pyramidFramebuffers[level]);
+    glViewport(0, 0, dstX, dstY);
+
+    glBindSampler(0, level == 0 ? _linearSampler : 0); // RTT itself is nearest-filtered, the levels are linear
+    glUniform2f(_program_kawase_down[gl::U_HALF_PIXEL], 0.5f / srcX, 0.5f / srcY);
+    draw(src, *_backgroundVBO);
+
+    src  = _pyramidTextures[level];
+    srcX = dstX;
+    srcY = dstY;
+  }
+  glBindSampler(0, 0);
+
+  // upsample one level at a time from the top: each step tent-filters the coarser result up and keeps
+  // its own level where the mask asks for less blur, so the mask still picks a blend of two levels per pixel
+  _state.useProgram(_program_2D_blur_pyramid._id);
+  glUniformMatrix4fv(_program_2D_blur_pyramid[gl::U_MVP], 1, GL_FALSE, &mvp[0][0]);
+  glUniform1f(_program_2D_blur_pyramid[gl::U_MAX_LEVEL], maxLevel);
+  _state.bindTexture(1, _blurMaskTex);
+
+  GLuint upper = _pyramidTextures[std::max(levels - 1, 0)]; // the top level is its own upsample
+  for (int level = levels - 2; level >= 0; level--)
+  {
+    _state.bindFramebuffer(_pyramidUpFramebuffers[level]);
+    glViewport(0, 0, pyramidSize(_sizes[RTT]._x, level), pyramidSize(_sizes[RTT]._y, level));
+
+    glUniform1f(_program_2D_blur_pyramid[gl::U_LEVEL], float(level + 1));
+    _state.bindTexture(2, upper);
+    draw(_pyramidTextures[level], *_backgroundVBO);
+
+    upper = _pyramidUpTextures[level];
+  }
+
+  glEnable(GL_BLEND);
+
+  // last step to the screen, level 0 is the unblurred RTT sampled nearest like in the other modes
+  _state.bindFramebuffer(_targetFramebuffer);
+  glViewport(0, 0, _sizes[SCENE]._x, _sizes[SCENE]._y);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glUniform1f(_program_2D_blur_pyramid[gl::U_LEVEL], 0.f);
+  _state.bindTexture(2, upper);
+  draw(_renderedTexture, *_backgroundVBO);
+}
+
+void Scene::blurCompute(const glm::mat4& mvp)
+{
+  const GLuint tile = 256; // output pixels per workgroup, as in 2D_blur_box.comp
+  const GLuint w = GLuint(_sizes[RTT]._x), h = GLuint(_sizes[RTT]._y);
+
+  const gl::program& p = _program_blur_box;
+  _state.useProgram(p._id);
+
+  int radii[blur::box_passes];
+  blur::boxRadii(_blurRadius, radii);
+  glUniform1iv(p[gl::U_BOX_RADII], blur::box_passes, radii);
+
+  // horizontal, RTT -> _blurTexture; one workgroup per row segment
+  _state.bindTexture(0, _renderedTexture);
+  glBindImageTexture(0, _blurTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+  glUniform2i(p[gl::U_BLUR_STEP], 1, 0);
+  glUniform1f(p[gl::U_COMPOSITE], 0.f);
+  glDispatchCompute((w + tile - 1) / tile, h, 1);
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+  // vertical, blended by the mask into the RTT in place: every pixel reads only its own unblurred value
+  _state.bindTexture(0, _blurTexture);
+  _state.bindTexture(1, _blurMaskTex);
+  glBindImageTexture(0, _renderedTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+  glUniform2i(p[gl::U_BLUR_STEP], 0, 1);
+  glUniform1f(p[gl::U_COMPOSITE], 1.f);
+  glDispatchCompute((h + tile - 1) / tile, w, 1);
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT); // read below, rendered to next frame
+
+  // compute can't write the window, the result is drawn there like the background
+  _state.bindFramebuffer(_targetFramebuffer);
+  glViewport(0, 0, _sizes[SCENE]._x, _sizes[SCENE]._y);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  _state.useProgram(_program_2D._id);
+  glUniformMatrix4fv(_program_2D[gl::U_MVP], 1, GL_FALSE, &mvp[0][0]);
+  draw(_renderedTexture, *_backgroundVBO);
+}
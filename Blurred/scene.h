@@ -1,122 +1,293 @@
-#ifndef SCENE_H
-#define SCENE_H
-
-#include <time.h>
-#include <GL/glew.h>
-#include <glm/gtc/matrix_transform.hpp>
-#include <map>
-#include <iostream>
-#include <vector>
-
-class Scene
-{
-public:
-  ~Scene();
-
-  struct Size
-  {
-    Size() :_x(0), _y(0) {}
-    Size(size_t x, size_t y): _x(x), _y(y) {}
-    size_t _x, _y;
-  };
-
-  enum mask_type
-  {
-    /* all three options are 'horizontal';
-    SMOOTH: power grows slowly from left to right,
-    EDGE:   power switching from min to max at the center
-    PEAK_AT_CENTER: grows slowly, max at center, then decreases back to 0
-    */
-
-    SMOOTH, EDGE, PEAK_AT_CENTER
-  };
-
-  void SetSize(const Size& size);
-  void Frame();
-  
-  void SetLightOn(bool lightOn);
-  void SetAngle(float angle);
-  void SetLightPower(float power);
-
-  float GetAngle()        const {return _angle;}
-  float GetLightPower()   const {return _lightPower;}
-  bool GetLightOn()       const {return _lightOn;}
-  Size GetRttSize()       const {return _sizes[RTT];}
-  Size GetMaskSize()      const {return _sizes[MASK];}
-  mask_type GetMaskType() const {return _mask_type;}
-
-  void Load(const Size& rtt_size, const Size& mask_size, mask_type mask);
-
-private:
-  enum buffers
-  {
-    VERTEX, UV, NORMAL, INDEX
-  };
-
-  struct VBO
-  {
-    VBO(GLuint v = 0, GLuint t = 0, GLuint n = 0, GLuint i = 0, GLuint count = 0): _v(v), _t(t), _n(n), _i(i), _count(count) {}
-    GLuint _v, _t, _n, _i, _count;
-  };
-
-  enum res_type { SCENE, RTT, MASK };
-
-  struct obj_data
-  {
-    std::vector<float> _vs, _ns, _uvs;
-    size_t _count;
-  };
-  
-  GLuint _program_2D;
-  GLuint _program_2D_blur;
-  GLuint _program_3D;
-  GLuint _framebufferInd;
-  GLuint _renderedTexture;
-  GLuint _blurMaskTex;
-  GLuint _depthrenderbuffer;
-
-  Size      _sizes[3];
-
-  float     _angle       = 0.f;
-  float     _objDistance = 3.f;
-  float     _lightPower  = 8.f;
-
-  bool      _ready   = false;
-  bool      _lightOn = true;
-  
-  mask_type _mask_type;
-
-  std::map<std::string, VBO>      _vboMap;
-  std::map<std::string, GLuint>   _textureMap;
-  std::map<std::string, obj_data> _objCache;
-
-  const std::string _obj_filename     = "obj.obj";
-  const std::string _bg_filename      = "background.png";
-  const std::string _obj_tex_filename = "object.png";
-
-
-  void prepareTexture(const std::string& obj_name, const std::string& filename);
-  inline void prepareRTT();
-  inline void buildBlurMask();
-
-  void loadVertex(GLvoid *vvp, size_t vvSize,
-    GLvoid *uvp, size_t uvSize,
-    GLvoid *ivp, size_t ivSize,
-    GLvoid *nvp, size_t nvSize, size_t count, const std::string& obj_name);
-
-  inline void draw3DObject();
-
-  void Scene::draw(GLuint tInd, VBO& vbo);
-
-  void draw(GLuint tInd, 
-            GLuint vBuf, 
-            GLuint tBuf, 
-            GLuint nBuf, 
-            GLuint iBuf, 
-            size_t vCount);
-
-  void cleanup();
-  void delVBO(VBO &vbo);  
-};
-
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <time.h>
+#include <GL/glew.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <map>
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "mesh.h"
+#include "glstate.h"
+#include "blur.h"
+#include "capture.h"
+#include "mask.h"
+#include "programcache.h"
+#include "profiler.h"
+#include "cull.h"
+
+namespace texture
+{
+  class TextureFile;
+}
+
+class Scene
+{
+public:
+  ~Scene();
+
+  struct Size
+  {
+    Size() :_x(0), _y(0) {}
+    Size(size_t x, size_t y): _x(x), _y(y) {}
+    bool operator==(const Size& other) const {return _x == other._x && _y == other._y;}
+    bool operator!=(const Size& other) const {return !(*this == other);}
+    size_t _x, _y;
+  };
+
+  enum mask_type
+  {
+    /* all three options are 'horizontal';
+    SMOOTH: power grows slowly from left to right,
+    EDGE:   power switching from min to max at the center
+    PEAK_AT_CENTER: grows slowly, max at center, then decreases back to 0
+    */
+
+    SMOOTH, EDGE, PEAK_AT_CENTER
+  };
+
+  enum blur_mode
+  {
+    /* BLUR_SIMPLE:    fixed 7-tap horizontal blur in one pass (2D_blur.frag), see SetMaskTiles()
+    BLUR_SEPARABLE: gaussian of GetBlurRadius(), horizontal pass to an offscreen target,
+                    then vertical pass blended by the mask (2D_blur_sep.frag)
+    BLUR_PYRAMID:   dual Kawase downsample chain of the RTT (2D_kawase_down.frag), then upsampled back one
+                    level at a time (2D_blur_pyramid.frag), each step keeping its own level where the mask
+                    asks for less blur; cost does not grow with the radius
+    BLUR_COMPUTE:   three box filters approximating the gaussian of GetBlurRadius(), horizontal then vertical
+                    compute pass with running sums in shared memory, the vertical one blends by the mask
+                    (2D_blur_box.comp); cost does not grow with the radius. Needs GL 4.3, BLUR_SEPARABLE without it
+    */
+
+    BLUR_SIMPLE, BLUR_SEPARABLE, BLUR_PYRAMID, BLUR_COMPUTE, BLUR_MODE_COUNT
+  };
+
+  void SetSize(const Size& size);
+  void Frame();
+  
+  void SetLightOn(bool lightOn);
+  void SetAngle(float angle);
+  void SetLightPower(float power);
+  void SetMeshOptimization(bool optimize); // vertex cache/overdraw/fetch reordering for meshes loaded after this call
+  void SetVertexPacking(bool pack);        // half/10-bit vertex attributes in mesh files loaded after this call
+  void SetTextureCompression(bool bc1);    // BC1 texture files for opaque textures loaded after this call
+  void SetBlurMode(blur_mode mode);
+  void SetTarget(GLuint framebuffer);      // where the blurred result goes, 0 (default) is the window
+  void SetCapture(const std::shared_ptr<capture::FrameCapture>& c); // every Frame() result is read back into c, null stops
+  void SetBlurRadius(int radius);          // 1..blur::max_radius, used by all modes but BLUR_SIMPLE
+  void SetObjectMesh(const std::shared_ptr<mesh::MeshFile>& m); // drawn instead of obj.obj, null: obj.obj again
+
+  // more copies of a mesh, drawn after the object with its texture and the same lighting
+  struct instance
+  {
+    glm::mat4 _model;
+    glm::vec4 _tint = glm::vec4(1.f); // multiplies the texture color
+  };
+  void AddInstances(const std::shared_ptr<mesh::MeshFile>& m, const std::vector<instance>& instances); // loaded scene, Load() drops them
+  void ClearInstances();
+  void UpdateInstances(size_t group, const std::vector<instance>& instances); // moved instances of the group-th AddInstances(), same count
+  void SetInstancing(bool instanced); // true (default): one glDrawElementsInstanced per AddInstances() call,
+                                      // false: a glDrawElements with its own uniforms per instance
+  void SetCulling(bool cull);         // frustum culling of the object and the instances (default on)
+  void SetLodThreshold(float pixels); // meshes are drawn at their coarsest level of detail whose error projects to at
+                                      // most this many RTT pixels (default 1), 0: always the full mesh
+  void SetMaskTiles(bool tiles);      // BLUR_SIMPLE: screen tiles where the mask is 0 or 1 get a plain copy or the blur
+                                      // alone, only the rest is blended (default on); false: blended everywhere
+
+  float GetAngle()        const {return _angle;}
+  float GetLightPower()   const {return _lightPower;}
+  bool GetLightOn()       const {return _lightOn;}
+  Size GetRttSize()       const {return _sizes[RTT];}
+  Size GetMaskSize()      const {return _sizes[MASK];}
+  mask_type GetMaskType() const {return _mask_type;}
+  blur_mode GetBlurMode() const {return _blur_mode;}
+  int GetBlurRadius()     const {return _blurRadius;}
+  double GetLoadTime()    const {return _loadSeconds;} // seconds spent in the last Load()
+  float GetLodThreshold() const {return _lodThreshold;}
+  bool GetComputeBlur()   const {return _program_blur_box._id != 0;} // BLUR_COMPUTE available, after Load()
+  bool GetMaskTiles()     const {return _maskTiles;}
+
+  struct texture_stats
+  {
+    double _loadSeconds   = 0.; // texture file map or decode + mip build, on worker threads
+    double _uploadSeconds = 0.;
+    size_t _bytes         = 0;  // all levels as uploaded, roughly the VRAM used
+  };
+  const texture_stats& GetTextureStats() const {return _textureStats;} // last Load()
+
+  const gl::StateCache::counters& GetStateCounters() const {return _state.lastFrame();} // binds issued/skipped last frame
+  size_t GetDrawCalls() const {return _drawCalls;} // last frame
+  size_t GetTriangles() const {return _triangles;} // submitted last frame, every instance counted
+
+  struct cull_stats
+  {
+    size_t _tested  = 0; // object + instances
+    size_t _visible = 0;
+    double _seconds = 0.; // frustum + BVH traversal + gathering the visible instances
+  };
+  const cull_stats& GetCullStats() const {return _cullStats;} // last frame, zero with culling off
+
+  struct tile_stats
+  {
+    size_t _pixels[mask::TILE_CLASS_COUNT] = {}; // screen pixels per mask::tile_class
+    size_t _quads       = 0; // drawn for all classes
+    size_t _fetches     = 0; // texture fetches of the BLUR_SIMPLE composite with tiles
+    size_t _fullFetches = 0; // with the blended shader on every pixel
+  };
+  const tile_stats& GetTileStats() const {return _tileStats;} // mask and screen size of the last tiled BLUR_SIMPLE frame
+  const gl::ProgramCache::stats& GetProgramCacheStats() const {return _programCache.GetStats();} // since construction
+  profiler::Profiler& GetProfiler() {return _profiler;} // per-pass timings of Frame()
+
+  void Load(const Size& rtt_size, const Size& mask_size, mask_type mask);
+
+  // like Load() on a loaded scene, but rebuilds only what depends on the changed settings:
+  // RTT size -> render targets, mask size or type -> mask texture; meshes, textures and programs stay
+  void Reconfigure(const Size& rtt_size, const Size& mask_size, mask_type mask);
+
+private:
+  // index range of one level of detail
+  struct lod_range
+  {
+    GLuint _first, _count;
+    float  _error; // object space
+  };
+
+  // one interleaved vertex buffer + index buffer, attribute setup recorded in the VAO
+  struct VBO
+  {
+    VBO(GLuint vao = 0, GLuint v = 0, GLuint i = 0, GLuint count = 0, GLenum iType = GL_UNSIGNED_INT): _vao(vao), _v(v), _i(i), _count(count), _iType(iType) {}
+    GLuint _vao, _v, _i, _count;
+    GLenum _iType; // GL_UNSIGNED_BYTE/SHORT/INT
+    std::vector<lod_range> _lods; // of the mesh file, empty: one mesh of _count indices
+  };
+
+  enum res_type { SCENE, RTT, MASK };
+
+  struct instance_group
+  {
+    std::string           _name;       // its VBO in _vboMap
+    GLuint                _buffer = 0; // instance attributes
+    std::vector<instance> _instances;  // for per-instance draws
+    cull::aabb            _meshBox;
+    float                 _maxScale = 0.f; // largest axis scale of any instance, for LOD errors
+    size_t                _first = 0;  // of its boxes in _instanceBoxes
+    std::vector<uint32_t> _drawn;      // instances (indices into _instanceBoxes) in _buffer, in order
+    std::vector<uint32_t> _visible;    // this frame
+  };
+
+  gl::program _program_2D;
+  gl::program _program_2D_blur;
+  gl::program _program_3D;
+  gl::program _program_2D_blur_sep;
+  gl::program _program_kawase_down;
+  gl::program _program_2D_blur_pyramid;
+  gl::program _program_blur_box;        // BLUR_COMPUTE, 0 without compute shaders
+  gl::program _program_2D_blur_only;    // BLUR_SIMPLE tiles where the mask is 1
+  GLuint _framebufferInd;
+  GLuint _renderedTexture;
+  GLuint _blurMaskTex;
+  GLuint _depthrenderbuffer;
+  GLuint _blurFramebuffer;  // horizontal pass target of BLUR_SEPARABLE and BLUR_COMPUTE, RTT sized
+  GLuint _blurTexture;
+  GLuint _linearSampler;    // bilinear + clamp, for merged blur taps
+  GLuint _pyramidFramebuffers[blur::pyramid_levels] = {}; // BLUR_PYRAMID chain, level k is RTT / 2^(k+1)
+  GLuint _pyramidTextures    [blur::pyramid_levels] = {};
+  GLuint _pyramidUpFramebuffers[blur::pyramid_levels - 1] = {}; // upsample chain, same sizes; the top level is its own
+  GLuint _pyramidUpTextures    [blur::pyramid_levels - 1] = {};
+
+  Size      _sizes[3];
+
+  float     _angle       = 0.f;
+  float     _objDistance = 3.f;
+  float     _lightPower  = 8.f;
+
+  bool      _ready   = false;
+  bool      _lightOn = true;
+  bool      _optimizeMesh = true;
+  bool      _packVertices = true;
+  bool      _compressTextures = false;
+  
+  mask_type _mask_type;
+  blur_mode _blur_mode  = BLUR_SIMPLE;
+  int       _blurRadius = 16;
+  bool      _blurTapsDirty = true;
+  GLuint    _targetFramebuffer = 0;
+  double    _loadSeconds = 0.;
+  texture_stats _textureStats;
+
+  typedef std::chrono::steady_clock load_clock;
+
+  std::shared_ptr<capture::FrameCapture> _capture;
+
+  std::map<std::string, VBO>      _vboMap;
+  std::map<std::string, GLuint>   _textureMap;
+  std::map<std::string, std::shared_ptr<mesh::MeshFile>> _objCache;
+  std::shared_ptr<mesh::MeshFile> _objectMesh; // SetObjectMesh()
+  std::vector<instance_group>     _instanceGroups;
+  std::vector<cull::aabb>         _instanceBoxes; // world space, every group
+  cull::BVH                       _instanceBVH;
+  std::vector<uint32_t>           _visibleInstances;
+  std::vector<instance>           _instanceStaging;
+  cull::aabb                      _objectBox;
+  bool                            _culling = true;
+  cull_stats                      _cullStats;
+  bool                            _instancing = true;
+  size_t                          _drawCalls  = 0;
+  size_t                          _triangles  = 0;
+  float                           _lodThreshold = 1.f;
+  bool                            _maskTiles  = true;
+  GLuint                          _tileFirst[mask::TILE_CLASS_COUNT] = {}; // index range per class in the "tiles" VBO
+  GLuint                          _tileCount[mask::TILE_CLASS_COUNT] = {};
+  tile_stats                      _tileStats;
+  mask::Cache _maskCache; // survives Load(), switching back to a mask type reuses it
+  gl::ProgramCache _programCache {"programs.cache"}; // program binaries, across runs
+
+  // resolved from the maps after Load, so Frame() does no lookups
+  const VBO *_objectVBO     = nullptr;
+  const VBO *_backgroundVBO = nullptr;
+  GLuint     _objectTex     = 0;
+  GLuint     _backgroundTex = 0;
+
+  gl::StateCache _state;
+  profiler::Profiler _profiler;
+
+  const std::string _obj_filename     = "obj.obj";
+  const std::string _obj_mesh_filename = "obj.mesh"; // binary cache of _obj_filename
+  const std::string _bg_filename      = "background.png";
+  const std::string _obj_tex_filename = "object.png";
+
+
+  void prepareTexture(const std::string& obj_name, const texture::TextureFile& file);
+  inline void prepareRTT();
+  void uploadObject(const mesh::MeshFile& obj);
+  void loadMesh(const mesh::MeshFile& m, const std::string& obj_name); // loadVertex + its LOD chain
+  inline void buildBlurMask();
+  void prepareTiles(); // "tiles" VBO of the mask's screen tiles, grouped by class; on mask or screen size changes, not per frame
+
+  // vp: mesh::vertex, or mesh::packed_vertex (half uvs, 10-bit normals) when packed, uploaded as it is
+  void loadVertex(const void *vp, size_t vCount,
+    const GLvoid *ivp, size_t ivSize, GLenum ivType, bool packed, const std::string& obj_name);
+
+  inline void draw3DObject();
+  void drawInstances(const glm::mat4& vp, const glm::vec3& eye, float focalPixels);
+
+  // coarsest level of vbo within _lodThreshold; unitPixels: RTT pixels one object space unit covers at the
+  // mesh's nearest point
+  size_t selectLod(const VBO& vbo, float unitPixels) const;
+  bool cullObjects(const glm::mat4& vp); // false: the object is outside; fills every group's _visible
+  void blurSimple   (const glm::mat4& mvp);
+  void blurSeparable(const glm::mat4& mvp);
+  void blurPyramid  (const glm::mat4& mvp);
+  void blurCompute  (const glm::mat4& mvp);
+
+  void draw(GLuint tInd, const VBO& vbo, size_t lod = 0);
+
+  void cleanup();
+  void releaseRTT();  // everything prepareRTT() creates
+  void releaseMask();
+  void delVBO(VBO &vbo);  
+};
+
 #endif
\ No newline at end of file
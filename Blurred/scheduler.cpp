@@ -0,0 +1,218 @@
+#include "scheduler.h"
+#include "utils.h"
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2)
+#define SCHEDULER_WAIT_TIMEOUT
+#endif
+
+namespace scheduler
+{
+  namespace
+  {
+    // sleeps end a little early and the rest is polled, timer wakeups can be late by a scheduler tick
+    const double spin_seconds = 0.001;
+
+    double seconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+      return std::chrono::duration<double>(to - from).count();
+    }
+
+    void printSummary(std::ostream& out, const char *name, const profiler::summary& s)
+    {
+      out << "  " << std::left << std::setw(15) << name << std::right
+          << std::setw(8) << s._mean << std::setw(8) << s._p50 << std::setw(8) << s._p95
+          << std::setw(8) << s._p99  << std::setw(8) << s._max << "  (" << s._count << ")\n";
+    }
+  }
+
+  const char* modeName(mode m)
+  {
+    static const char* names[MODE_COUNT] = {"fixed", "vsync", "uncapped"};
+    return m < MODE_COUNT ? names[m] : "unknown";
+  }
+
+  FrameScheduler::FrameScheduler(GLFWwindow *window): _window(window)
+  {
+#ifndef SCHEDULER_WAIT_TIMEOUT
+    _waker = std::thread(&FrameScheduler::wake, this);
+#endif
+    reset();
+  }
+
+  FrameScheduler::~FrameScheduler()
+  {
+    if (_waker.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        _quit = true;
+      }
+      _wakeCondition.notify_one();
+      _waker.join();
+    }
+  }
+
+  void FrameScheduler::setMode(mode m)
+  {
+    _mode = m;
+    glfwSwapInterval(m == UNCAPPED ? 0 : 1);
+    _started = false; // intervals across the switch say nothing about either mode
+  }
+
+  void FrameScheduler::setRate(float fps)
+  {
+    _rate = std::max(fps, 1.f);
+  }
+
+  void FrameScheduler::wake()
+  {
+    std::unique_lock<std::mutex> lock(_wakeMutex);
+    while (!_quit)
+    {
+      if (!_armed)
+      {
+        _wakeCondition.wait(lock);
+        continue;
+      }
+
+      const clock::time_point at = _wakeAt;
+      if (_wakeCondition.wait_until(lock, at) == std::cv_status::timeout && _armed && _wakeAt == at)
+      {
+        _armed = false;
+        glfwPostEmptyEvent(); // thread safe
+      }
+    }
+  }
+
+  void FrameScheduler::waitEvents(double timeout)
+  {
+#ifdef SCHEDULER_WAIT_TIMEOUT
+    glfwWaitEventsTimeout(timeout);
+#else
+    {
+      std::lock_guard<std::mutex> lock(_wakeMutex);
+      _wakeAt = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(timeout));
+      _armed  = true;
+    }
+    _wakeCondition.notify_one();
+
+    glfwWaitEvents();
+
+    std::lock_guard<std::mutex> lock(_wakeMutex);
+    _armed = false; // an event came first
+#endif
+  }
+
+  float FrameScheduler::wait()
+  {
+    const clock::time_point waitStart = clock::now();
+
+    if (_mode == FIXED)
+    {
+      for (clock::time_point now = waitStart; now < _deadline && _queued.empty() && !glfwWindowShouldClose(_window); now = clock::now())
+      {
+        const double left = seconds(now, _deadline);
+        if (left > spin_seconds)
+          waitEvents(left - spin_seconds);
+        else
+        {
+          glfwPollEvents();
+          std::this_thread::yield();
+        }
+      }
+    }
+    glfwPollEvents(); // FIXED: whatever came with the deadline; otherwise the swap did the waiting
+
+    const clock::time_point start = clock::now();
+    _idleSeconds += seconds(waitStart, start);
+
+    // next grid point, unless a key brought this frame forward; a frame late by more than an interval
+    // starts a new grid instead of a burst
+    const clock::duration interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1. / _rate));
+    if (start >= _deadline)
+      _deadline += interval;
+    if (_deadline <= start)
+      _deadline = start + interval;
+
+    float delta = 0.f;
+    if (_started)
+    {
+      delta = float(seconds(_lastStart, start));
+      const float expected = _mode == FIXED ? 1.f / _rate : _lastInterval;
+      _interval.add(delta * 1000.);
+      _jitter  .add(std::abs(delta - expected) * 1000.);
+      _lastInterval = delta;
+    }
+    _lastStart = start;
+    _started   = true;
+    return delta;
+  }
+
+  void FrameScheduler::post(int key)
+  {
+    const key_event e = {key, clock::now()};
+    _queued.push_back(e);
+  }
+
+  void FrameScheduler::presented()
+  {
+    const clock::time_point now = clock::now();
+    for (const clock::time_point& t : _applied)
+      _latency.add(seconds(t, now) * 1000.);
+    _applied.clear();
+  }
+
+  stats FrameScheduler::getStats() const
+  {
+    stats s;
+    s._interval = _interval.summarize();
+    s._jitter   = _jitter  .summarize();
+    s._latency  = _latency .summarize();
+
+    const double wall = seconds(_statsStart, clock::now());
+    if (wall > 0.)
+    {
+      s._cpu  = (utils::cpuSeconds() - _cpuStart) / wall;
+      s._idle = _idleSeconds / wall;
+    }
+    return s;
+  }
+
+  void FrameScheduler::reset()
+  {
+    _interval.clear();
+    _jitter  .clear();
+    _latency .clear();
+    _statsStart  = clock::now();
+    _cpuStart    = utils::cpuSeconds();
+    _idleSeconds = 0.;
+    _started     = false;
+  }
+
+  void FrameScheduler::print(std::ostream& out) const
+  {
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+
+    const stats s = getStats();
+    out << "frame pacing, " << modeName(_mode);
+    if (_mode == FIXED)
+      out << " " << std::setprecision(0) << _rate << " FPS" << std::setprecision(3);
+    out << "\n  ms                 mean     p50     p95     p99     max\n";
+
+    printSummary(out, "interval",    s._interval);
+    printSummary(out, "jitter",      s._jitter);
+    printSummary(out, "key latency", s._latency);
+
+    out << std::setprecision(1) << "  CPU " << s._cpu * 100. << "% of a core, " << s._idle * 100. << "% of the time waiting\n";
+
+    out.flags(flags);
+    out.precision(precision);
+  }
+}
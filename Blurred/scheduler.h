@@ -0,0 +1,114 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "profiler.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// pacing of the interactive main loop on the monotonic clock: between frames the thread sleeps in
+// the event wait instead of spinning, key events are queued and applied at the start of the next frame
+
+namespace scheduler
+{
+  enum mode
+  {
+    FIXED,    // frames on a 1/rate grid, the thread waits for events until the next grid point
+    VSYNC,    // swap interval 1, the swap blocks until the refresh
+    UNCAPPED, // swap interval 0, frames back to back
+    MODE_COUNT
+  };
+
+  const char* modeName(mode m);
+
+  struct stats
+  {
+    profiler::summary _interval; // ms from one frame start to the next
+    profiler::summary _jitter;   // ms, FIXED: |interval - 1/rate|, otherwise |interval - previous interval|
+    profiler::summary _latency;  // ms from a key event to the end of the swap of the frame that applied it
+    double            _cpu  = 0.; // process CPU time / wall time since reset(), 1: one core busy
+    double            _idle = 0.; // share of the wall time spent waiting for the next frame
+  };
+
+  class FrameScheduler
+  {
+  public:
+    explicit FrameScheduler(GLFWwindow *window);
+    ~FrameScheduler();
+
+    void  setMode(mode m); // sets the swap interval, the window's context must be current
+    void  setRate(float fps);
+    mode  getMode() const {return _mode;}
+    float getRate() const {return _rate;}
+
+    // handles window events until the next frame is due, a key is queued or the window is closing;
+    // returns seconds since the previous frame started (0 for the first)
+    float wait();
+
+    void post(int key); // from the key callback
+    template<typename F>
+    void dispatch(F handler) // start of the frame: handler(key) for every queued key
+    {
+      for (const key_event& e : _queued)
+      {
+        handler(e._key);
+        _applied.push_back(e._time);
+      }
+      _queued.clear();
+    }
+    void presented(); // after the swap
+
+    stats getStats() const;
+    void  reset();
+    void  print(std::ostream& out) const;
+
+  private:
+    FrameScheduler(const FrameScheduler&);
+    FrameScheduler& operator=(const FrameScheduler&);
+
+    typedef std::chrono::steady_clock clock;
+
+    struct key_event
+    {
+      int               _key;
+      clock::time_point _time;
+    };
+
+    void waitEvents(double timeout); // glfwWaitEventsTimeout, emulated with the waker thread on GLFW 3.1
+    void wake();                     // waker thread
+
+    GLFWwindow *_window;
+    mode        _mode = FIXED;
+    float       _rate = 30.f;
+
+    clock::time_point _deadline;
+    clock::time_point _lastStart;
+    bool              _started  = false;
+    float             _lastInterval = 0.f;
+
+    std::vector<key_event>         _queued;
+    std::vector<clock::time_point> _applied; // arrival times of the keys the current frame applied
+
+    profiler::Histogram _interval;
+    profiler::Histogram _jitter;
+    profiler::Histogram _latency;
+    clock::time_point   _statsStart;
+    double              _cpuStart    = 0.;
+    double              _idleSeconds = 0.;
+
+    // posts an empty event at _wakeAt, so glfwWaitEvents returns
+    std::thread             _waker;
+    std::mutex              _wakeMutex;
+    std::condition_variable _wakeCondition;
+    clock::time_point       _wakeAt;
+    bool                    _armed = false;
+    bool                    _quit  = false;
+  };
+}
+
+#endif
@@ -0,0 +1,427 @@
+#include "texture.h"
+#include "utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTURE_SSE2
+#endif
+
+namespace texture
+{
+  namespace
+  {
+    const size_t rows_per_job = 16;
+
+    inline unsigned char average(const unsigned char *a, const unsigned char *b, const unsigned char *c, const unsigned char *d, int ch)
+    {
+      return (unsigned char)((a[ch] + b[ch] + c[ch] + d[ch] + 2) >> 2);
+    }
+
+    void downsampleRow(const unsigned char *row0, const unsigned char *row1, size_t width, size_t dstWidth, unsigned char *dst, bool simd)
+    {
+      size_t x = 0;
+
+#ifdef TEXTURE_SSE2
+      // 4 destination pixels from 8 source pixels of each row; needs 2x+1 inside the row
+      if (simd)
+      {
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        for (; x + 4 <= dstWidth && 2 * x + 8 <= width; x += 4)
+        {
+          const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x));
+          const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x + 16));
+          const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x));
+          const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x + 16));
+
+          // vertical sums, 16 bits per channel, two pixels per register
+          const __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+          const __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+          const __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+          const __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+          // horizontal pair sums land in the low 64 bits
+          const __m128i h0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+          const __m128i h1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+          const __m128i h2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+          const __m128i h3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+          const __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h0, h1), round), 2);
+          const __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h2, h3), round), 2);
+          _mm_storeu_si128((__m128i*)(dst + 4 * x), _mm_packus_epi16(lo, hi));
+        }
+      }
+#else
+      (void)simd;
+#endif
+
+      for (; x < dstWidth; x++)
+      {
+        const size_t x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+        const unsigned char *a = row0 + 4 * x0, *b = row0 + 4 * x1, *c = row1 + 4 * x0, *d = row1 + 4 * x1;
+        for (int ch = 0; ch < 4; ch++)
+          dst[4 * x + ch] = average(a, b, c, d, ch);
+      }
+    }
+
+    inline uint16_t to565(int r, int g, int b)
+    {
+      return uint16_t(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+    }
+
+    inline void from565(uint16_t c, int rgb[3])
+    {
+      const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+      rgb[0] = (r << 3) | (r >> 2);
+      rgb[1] = (g << 2) | (g >> 4);
+      rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // one 4x4 block, pixels as BGRA
+    void compressBlock(const unsigned char block[16][4], unsigned char out[8])
+    {
+      int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+      for (int i = 0; i < 16; i++)
+        for (int ch = 0; ch < 3; ch++)
+        {
+          const int v = block[i][2 - ch]; // rgb order
+          lo[ch] = std::min(lo[ch], v);
+          hi[ch] = std::max(hi[ch], v);
+        }
+
+      // pull endpoints in a little, the box corners are rarely the best fit
+      for (int ch = 0; ch < 3; ch++)
+      {
+        const int inset = (hi[ch] - lo[ch]) >> 4;
+        lo[ch] += inset;
+        hi[ch] -= inset;
+      }
+
+      uint16_t c0 = to565(hi[0], hi[1], hi[2]);
+      uint16_t c1 = to565(lo[0], lo[1], lo[2]);
+      if (c0 < c1)
+        std::swap(c0, c1);
+
+      // c0 > c1 selects the 4-colour mode; equal endpoints only need index 0
+      int palette[4][3];
+      from565(c0, palette[0]);
+      from565(c1, palette[1]);
+      for (int ch = 0; ch < 3; ch++)
+      {
+        palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+        palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+      }
+
+      uint32_t indices = 0;
+      if (c0 != c1)
+        for (int i = 0; i < 16; i++)
+        {
+          int best = 0, bestDist = INT32_MAX;
+          for (int p = 0; p < 4; p++)
+          {
+            int dist = 0;
+            for (int ch = 0; ch < 3; ch++)
+            {
+              const int d = block[i][2 - ch] - palette[p][ch];
+              dist += d * d;
+            }
+            if (dist < bestDist)
+            {
+              bestDist = dist;
+              best = p;
+            }
+          }
+          indices |= uint32_t(best) << (2 * i);
+        }
+
+      out[0] = (unsigned char)(c0 & 0xff);
+      out[1] = (unsigned char)(c0 >> 8);
+      out[2] = (unsigned char)(c1 & 0xff);
+      out[3] = (unsigned char)(c1 >> 8);
+      memcpy(out + 4, &indices, 4);
+    }
+  }
+
+  size_t levelCount(size_t width, size_t height)
+  {
+    size_t levels = 1;
+    while ((width > 1 || height > 1) && levels < max_levels)
+    {
+      width  = std::max<size_t>(width  / 2, 1);
+      height = std::max<size_t>(height / 2, 1);
+      levels++;
+    }
+    return levels;
+  }
+
+  size_t levelSize(format f, size_t width, size_t height)
+  {
+    return f == BC1 ? ((width + 3) / 4) * ((height + 3) / 4) * 8 : width * height * 4;
+  }
+
+  void downsample(const unsigned char *src, size_t width, size_t height, unsigned char *dst, bool simd)
+  {
+    const size_t dstWidth  = std::max<size_t>(width  / 2, 1);
+    const size_t dstHeight = std::max<size_t>(height / 2, 1);
+
+    const size_t jobs = (dstHeight + rows_per_job - 1) / rows_per_job;
+    utils::parallel_for(jobs, [&](size_t job)
+    {
+      const size_t end = std::min(dstHeight, (job + 1) * rows_per_job);
+      for (size_t y = job * rows_per_job; y < end; y++)
+      {
+        const unsigned char *row0 = src + 4 * width * (2 * y);
+        const unsigned char *row1 = src + 4 * width * std::min(2 * y + 1, height - 1);
+        downsampleRow(row0, row1, width, dstWidth, dst + 4 * dstWidth * y, simd);
+      }
+    });
+  }
+
+  void compressBC1(const unsigned char *bgra, size_t width, size_t height, unsigned char *out)
+  {
+    const size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+
+    utils::parallel_for(blocksY, [&](size_t by)
+    {
+      unsigned char block[16][4];
+      for (size_t bx = 0; bx < blocksX; bx++)
+      {
+        // partial blocks at the right/top edge repeat the last pixel
+        for (size_t i = 0; i < 16; i++)
+        {
+          const size_t x = std::min(bx * 4 + i % 4, width  - 1);
+          const size_t y = std::min(by * 4 + i / 4, height - 1);
+          memcpy(block[i], bgra + 4 * (y * width + x), 4);
+        }
+        compressBlock(block, out + 8 * (by * blocksX + bx));
+      }
+    });
+  }
+
+  void decompressBC1(const unsigned char *blocks, size_t width, size_t height, unsigned char *bgra)
+  {
+    const size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+
+    utils::parallel_for(blocksY, [&](size_t by)
+    {
+      for (size_t bx = 0; bx < blocksX; bx++)
+      {
+        const unsigned char *b = blocks + 8 * (by * blocksX + bx);
+        const uint16_t c0 = uint16_t(b[0] | (b[1] << 8)), c1 = uint16_t(b[2] | (b[3] << 8));
+        const uint32_t indices = uint32_t(b[4]) | (uint32_t(b[5]) << 8) | (uint32_t(b[6]) << 16) | (uint32_t(b[7]) << 24);
+
+        // c0 <= c1 is the 3-colour mode, index 3 is black
+        int palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int ch = 0; ch < 3; ch++)
+        {
+          palette[2][ch] = c0 > c1 ? (2 * palette[0][ch] + palette[1][ch]) / 3 : (palette[0][ch] + palette[1][ch]) / 2;
+          palette[3][ch] = c0 > c1 ? (palette[0][ch] + 2 * palette[1][ch]) / 3 : 0;
+        }
+
+        for (size_t i = 0; i < 16; i++)
+        {
+          const size_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+          if (x >= width || y >= height)
+            continue;
+
+          const int *rgb = palette[(indices >> (2 * i)) & 3];
+          unsigned char *dst = bgra + 4 * (y * width + x);
+          dst[0] = (unsigned char)rgb[2];
+          dst[1] = (unsigned char)rgb[1];
+          dst[2] = (unsigned char)rgb[0];
+          dst[3] = 255;
+        }
+      }
+    });
+  }
+
+  void serialize(const utils::image& img, format f, uint64_t sourceHash, uint64_t sourceSize, std::vector<char>& out)
+  {
+    file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header._magic, file_magic, sizeof(file_magic));
+    header._version    = file_version;
+    header._sourceHash = sourceHash;
+    header._sourceSize = sourceSize;
+    header._width      = uint32_t(img._width);
+    header._height     = uint32_t(img._height);
+    header._levels     = uint32_t(levelCount(img._width, img._height));
+    header._format     = f;
+    header._alpha      = img._alpha ? 1 : 0;
+
+    size_t offset = sizeof(file_header);
+    for (size_t i = 0, w = img._width, h = img._height; i < header._levels; i++, w = std::max<size_t>(w / 2, 1), h = std::max<size_t>(h / 2, 1))
+    {
+      header._offsets[i] = offset;
+      header._sizes  [i] = levelSize(f, w, h);
+      offset += size_t(header._sizes[i]);
+    }
+
+    out.assign(offset, 0);
+    memcpy(out.data(), &header, sizeof(header));
+
+    // mips are always filtered from the uncompressed previous level
+    std::vector<unsigned char> level(img._bits), next;
+    for (size_t i = 0, w = img._width, h = img._height; i < header._levels; i++)
+    {
+      unsigned char *dst = (unsigned char*)out.data() + header._offsets[i];
+      if (f == BC1)
+        compressBC1(level.data(), w, h, dst);
+      else
+        memcpy(dst, level.data(), level.size());
+
+      if (i + 1 < header._levels)
+      {
+        const size_t nw = std::max<size_t>(w / 2, 1), nh = std::max<size_t>(h / 2, 1);
+        next.resize(nw * nh * 4);
+        downsample(level.data(), w, h, next.data());
+        level.swap(next);
+        w = nw;
+        h = nh;
+      }
+    }
+  }
+
+  TextureFile::TextureFile(const char *path)
+    : _mapped(new utils::MappedFile(path))
+  {
+    if (_mapped->valid())
+      check(_mapped->data(), _mapped->size());
+  }
+
+  TextureFile::TextureFile(std::vector<char>& bytes)
+  {
+    _bytes.swap(bytes);
+    if (!_bytes.empty())
+      check(_bytes.data(), _bytes.size());
+  }
+
+  TextureFile::~TextureFile()
+  {
+  }
+
+  void TextureFile::check(const char *data, size_t size)
+  {
+    if (size < sizeof(file_header))
+      return;
+
+    const file_header *header = (const file_header*)data;
+    if (memcmp(header->_magic, file_magic, sizeof(file_magic)) != 0 ||
+        header->_version != file_version ||
+        (header->_format != BGRA8 && header->_format != BC1) ||
+        header->_levels == 0 || header->_levels > max_levels)
+      return;
+
+    for (size_t i = 0; i < header->_levels; i++)
+      if (header->_offsets[i] + header->_sizes[i] > size)
+        return;
+
+    _header = header;
+    _size   = size;
+  }
+
+  bool TextureFile::write(const char *path) const
+  {
+    if (!valid())
+      return false;
+
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write((const char*)_header, _size);
+    if (!out)
+    {
+      std::cerr << "unable to write texture file " << path << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  std::string cachePath(const std::string& image_path)
+  {
+    const size_t dot = image_path.find_last_of('.');
+    return (dot == std::string::npos ? image_path : image_path.substr(0, dot)) + ".tex";
+  }
+
+  std::shared_ptr<TextureFile> load(const char *image_path, const char *texture_path, format f)
+  {
+    uint64_t source_hash = 0, source_size = 0;
+    {
+      utils::MappedFile source(image_path);
+      if (source.valid())
+      {
+        source_hash = utils::hash64(source.data(), source.size());
+        source_size = source.size();
+      }
+    }
+
+    // texture file is used as is if it was built from the same source in the wanted format
+    // (an opaque BC1 request is also satisfied by the BGRA8 fallback of an image with alpha)
+    auto cached = std::make_shared<TextureFile>(texture_path);
+    if (cached->valid() && (source_size == 0 || (cached->header()._sourceHash == source_hash &&
+                                                 cached->header()._sourceSize == source_size)))
+    {
+      const file_header& h = cached->header();
+      if (h._format == uint32_t(f) || (f == BC1 && h._alpha))
+        return cached;
+    }
+
+    cached.reset(); // unmapped, so the file can be rewritten
+
+    utils::image img;
+    if (!utils::decodeImage(image_path, img))
+      return nullptr;
+
+    if (f == BC1 && img._alpha)
+      f = BGRA8; // BC1 has no usable alpha
+
+    std::vector<char> bytes;
+    serialize(img, f, source_hash, source_size, bytes);
+
+    auto built = std::make_shared<TextureFile>(bytes);
+    if (built->write(texture_path))
+      std::cout << texture_path << " rebuilt from " << image_path << "\n";
+
+    return built;
+  }
+
+  size_t upload(const TextureFile& file, GLuint& id)
+  {
+    const file_header& h = file.header();
+
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,  GLint(h._levels - 1));
+
+    // S3TC is an extension, drivers without it get the blocks decoded back to BGRA8
+    const bool compressed = h._format == BC1 && GLEW_EXT_texture_compression_s3tc;
+    std::vector<unsigned char> decoded;
+
+    size_t bytes = 0;
+    for (size_t i = 0, w = h._width, hgt = h._height; i < h._levels; i++, w = std::max<size_t>(w / 2, 1), hgt = std::max<size_t>(hgt / 2, 1))
+    {
+      if (compressed)
+        glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GLsizei(w), GLsizei(hgt), 0,
+          GLsizei(h._sizes[i]), file.level(i));
+      else if (h._format == BC1)
+      {
+        decoded.resize(w * hgt * 4);
+        decompressBC1((const unsigned char*)file.level(i), w, hgt, decoded.data());
+        glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_RGB8, GLsizei(w), GLsizei(hgt), 0,
+          GL_BGRA, GL_UNSIGNED_BYTE, decoded.data());
+      }
+      else
+        glTexImage2D(GL_TEXTURE_2D, GLint(i), h._alpha ? GL_RGBA8 : GL_RGB8, GLsizei(w), GLsizei(hgt), 0,
+          GL_BGRA, GL_UNSIGNED_BYTE, file.level(i));
+
+      bytes += size_t(h._sizes[i]);
+    }
+    return bytes;
+  }
+}
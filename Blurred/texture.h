@@ -0,0 +1,103 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+// texture files: decoded once, all mip levels built on the CPU, optionally BC1 compressed,
+// then mapped and uploaded level by level without FreeImage or glGenerateMipmap
+
+namespace utils
+{
+  class MappedFile;
+  struct image;
+}
+
+namespace texture
+{
+  enum format
+  {
+    BGRA8, // 4 bytes per pixel, alpha kept
+    BC1    // DXT1, 8 bytes per 4x4 block, opaque
+  };
+
+  const size_t max_levels = 16;
+
+  struct file_header
+  {
+    char     _magic[4];
+    uint32_t _version;
+    uint64_t _sourceHash;   // utils::hash64 of the image the texture was built from
+    uint64_t _sourceSize;
+    uint32_t _width;
+    uint32_t _height;
+    uint32_t _levels;
+    uint32_t _format;       // texture::format
+    uint32_t _alpha;        // source has an alpha channel
+    uint32_t _reserved;
+    uint64_t _offsets[max_levels]; // from the start of the file
+    uint64_t _sizes  [max_levels];
+  };
+
+  const char     file_magic[4] = {'B', 'T', 'E', 'X'};
+  const uint32_t file_version  = 1;
+
+  // full chain down to 1x1
+  size_t levelCount(size_t width, size_t height);
+  size_t levelSize (format f, size_t width, size_t height); // bytes of one level
+
+  // next mip level of a BGRA8 image: rounded 2x2 box filter, last row/column repeated at odd sizes;
+  // rows on parallel_for threads, SSE2 when available, both paths give identical bytes
+  void downsample(const unsigned char *src, size_t width, size_t height, unsigned char *dst, bool simd = true);
+
+  // BC1 blocks of a BGRA8 image, alpha ignored; bounding box endpoints inset by 1/16, nearest palette entry
+  void compressBC1(const unsigned char *bgra, size_t width, size_t height, unsigned char *out);
+
+  // BGRA8 pixels of BC1 blocks, alpha 255; upload's fallback when S3TC is missing
+  void decompressBC1(const unsigned char *blocks, size_t width, size_t height, unsigned char *bgra);
+
+  void serialize(const utils::image& img, format f, uint64_t sourceHash, uint64_t sourceSize, std::vector<char>& out);
+
+  // read-only view of a serialized texture, either mapped from disk or owning its bytes
+  class TextureFile
+  {
+  public:
+    explicit TextureFile(const char *path);
+    explicit TextureFile(std::vector<char>& bytes); // takes over the buffer
+    ~TextureFile();
+
+    bool valid() const {return _header != nullptr;}
+
+    const file_header& header() const {return *_header;}
+    const void* level(size_t i) const {return (const char*)_header + _header->_offsets[i];}
+
+    bool write(const char *path) const;
+
+  private:
+    TextureFile(const TextureFile&);
+    TextureFile& operator=(const TextureFile&);
+
+    void check(const char *data, size_t size);
+
+    std::unique_ptr<utils::MappedFile> _mapped;
+    std::vector<char>  _bytes;
+    const file_header *_header = nullptr;
+    size_t             _size   = 0;
+  };
+
+  // "background.png" -> "background.tex"
+  std::string cachePath(const std::string& image_path);
+
+  // texture_path if it was built from image_path in this format, otherwise decodes, builds and rewrites it;
+  // BC1 falls back to BGRA8 for images with alpha. No GL, safe on worker threads
+  std::shared_ptr<TextureFile> load(const char *image_path, const char *texture_path, format f);
+
+  // all levels into a new GL_TEXTURE_2D, returns the bytes read from the file;
+  // BC1 is decoded on the CPU when GL_EXT_texture_compression_s3tc is missing
+  size_t upload(const TextureFile& file, GLuint& id);
+}
+
+#endif
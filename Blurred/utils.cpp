@@ -1,188 +1,817 @@
-#include "utils.h"
-#include <stdio.h>
-#include <string>
-#include <fstream>
-#include <iostream>
-#include "FreeImage.h"
-
-namespace utils
-{
-  glm::vec3 xyz(const glm::vec4& v) 
-  {
-    return glm::vec3(v.x, v.y, v.z); 
-  }
-
-  float dt(clock_t first, clock_t second)
-  {
-    return std::abs(float(first) - float(second)) / CLOCKS_PER_SEC;
-  }
-
-  bool loadTexture(const std::string& texName, GLuint& id)
-  {  
-    FIBITMAP* bitmap = FreeImage_Load(FreeImage_GetFileType(texName.c_str(), 0), texName.c_str());
-    if(!bitmap)
-    {
-      std::cerr << "unable to load texture " << texName;
-      return false;
-    }
-
-    BITMAPINFO *info = FreeImage_GetInfo(bitmap);
-
-    GLsizei w = (GLsizei)FreeImage_GetWidth(bitmap);
-    GLsizei h = (GLsizei)FreeImage_GetHeight(bitmap);
-
-    GLuint texInd = -1;
-    glGenTextures(1, &texInd);
-    glBindTexture(GL_TEXTURE_2D, texInd);
-    void* bits = FreeImage_GetBits(bitmap);
-
-    bool with_alpha = info->bmiHeader.biBitCount > 24;
-
-    glTexImage2D(GL_TEXTURE_2D, 0, with_alpha ? GL_RGBA : GL_RGB, w, h,
-      0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, bits);
-
-    FreeImage_Unload(bitmap);
-    id = texInd;
-    return true;
-  }
-
-  size_t loadOBJ(const char * path,
-               std::vector<float>& out_vertices, 
-               std::vector<float>& out_uvs,
-               std::vector<float>& out_normals
-               )
-  {
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> temp_vertices; 
-    std::vector<glm::vec2> temp_uvs;
-    std::vector<glm::vec3> temp_normals;
-  
-    FILE* file = nullptr;
-    fopen_s(&file, path, "r");
-
-    if( file == NULL ){
-      std::cerr << "cannot open file " << path;
-      return 0;
-    }
-    while( 1 ){
-
-      char lineHeader[128];
-      int res = fscanf_s(file, "%s", lineHeader, 128);
-      if (res == EOF)
-        break;
-      if ( strcmp( lineHeader, "v" ) == 0 ){
-        glm::vec3 vertex;
-        fscanf_s(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-        temp_vertices.push_back(vertex);
-      }else if ( strcmp( lineHeader, "vt" ) == 0 ){
-        glm::vec2 uv;
-        fscanf_s(file, "%f %f\n", &uv.x, &uv.y );
-        temp_uvs.push_back(uv);
-      }else if ( strcmp( lineHeader, "vn" ) == 0 ){
-        glm::vec3 normal;
-        fscanf_s(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-        temp_normals.push_back(normal);
-      }else if ( strcmp( lineHeader, "f" ) == 0 ){
-        unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-        int matches = fscanf_s(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-        if (matches != 9){
-          std::cerr << "can't parse file " << path;
-          return 0;
-        }
-        vertexIndices.push_back(vertexIndex[0]);
-        vertexIndices.push_back(vertexIndex[1]);
-        vertexIndices.push_back(vertexIndex[2]);
-      
-        uvIndices    .push_back(uvIndex[0]);
-        uvIndices    .push_back(uvIndex[1]);
-        uvIndices    .push_back(uvIndex[2]);
-
-        normalIndices.push_back(normalIndex[0]);
-        normalIndices.push_back(normalIndex[1]);
-        normalIndices.push_back(normalIndex[2]);
-      }else{
-        char stupidBuffer[1000];
-        fgets(stupidBuffer, 1000, file);
-      }
-    }
-
-    for(size_t i = 0; i < vertexIndices.size(); i++)
-    {
-      size_t vertexIndex = vertexIndices[i];
-      size_t uvIndex = uvIndices[i];
-      size_t normalIndex = normalIndices[i];
-
-      glm::vec3 vertex = temp_vertices[vertexIndex - 1];
-      glm::vec2 uv = temp_uvs[uvIndex - 1];
-      glm::vec3 normal = temp_normals[normalIndex - 1];
-
-      out_vertices.push_back(vertex[0]);
-      out_vertices.push_back(vertex[1]);
-      out_vertices.push_back(vertex[2]);
-      out_uvs     .push_back(uv[0]);
-      out_uvs     .push_back(uv[1]);
-      out_normals .push_back(normal[0]);
-      out_normals .push_back(normal[1]);
-      out_normals .push_back(normal[2]);
-    }
-    return vertexIndices.size();
-  }
-
-   bool loadShaders(const char *vertex_file_path,const char *fragment_file_path, GLuint& id)
-  {
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    std::string Line = "";
-    while(getline(VertexShaderStream, Line))
-      VertexShaderCode += "\n" + Line;
-    VertexShaderStream.close();
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    Line.clear();
-    while(getline(FragmentShaderStream, Line))
-      FragmentShaderCode += "\n" + Line;
-    FragmentShaderStream.close();
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
-    char const *VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-    glCompileShader(VertexShaderID);
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-      std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-      glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-      std::cerr << "shader error: " << &VertexShaderErrorMessage[0];
-      return false;
-    }
-    char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-    glCompileShader(FragmentShaderID);
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-      std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-      glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-      std::cerr << "shader error: " << &FragmentShaderErrorMessage[0];
-      return false;
-    }
-    GLuint ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, FragmentShaderID);
-    glLinkProgram(ProgramID);
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-      std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-      glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-      std::cerr << "shader error: " << &ProgramErrorMessage[0];
-      return false;
-    }
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
-    id = ProgramID;
-    return true;
-  }
+#include "utils.h"
+#include <stdio.h>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include "FreeImage.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace utils
+{
+  glm::vec3 xyz(const glm::vec4& v) 
+  {
+    return glm::vec3(v.x, v.y, v.z); 
+  }
+
+  float dt(std::chrono::steady_clock::time_point first, std::chrono::steady_clock::time_point second)
+  {
+    return std::abs(std::chrono::duration<float>(first - second).count());
+  }
+
+  bool loadTexture(const std::string& texName, GLuint& id)
+  {
+    image img;
+    return decodeImage(texName, img) && uploadTexture(img, id);
+  }
+
+  bool decodeImage(const std::string& fileName, image& out)
+  {
+    FIBITMAP* bitmap = FreeImage_Load(FreeImage_GetFileType(fileName.c_str(), 0), fileName.c_str());
+    if(!bitmap)
+    {
+      std::cerr << "unable to load texture " << fileName;
+      return false;
+    }
+
+    out._width  = FreeImage_GetWidth(bitmap);
+    out._height = FreeImage_GetHeight(bitmap);
+    out._alpha  = FreeImage_GetBPP(bitmap) > 24;
+
+    // 24-bit (and palettized) images as 32-bit BGRA, so rows are tight and match GL_BGRA
+    if (FreeImage_GetBPP(bitmap) != 32)
+    {
+      FIBITMAP* converted = FreeImage_ConvertTo32Bits(bitmap);
+      FreeImage_Unload(bitmap);
+      bitmap = converted;
+      if (!bitmap)
+      {
+        std::cerr << "unable to convert texture " << fileName;
+        return false;
+      }
+    }
+
+    const size_t rowBytes = out._width * 4;
+    out._bits.resize(rowBytes * out._height);
+    for (size_t y = 0; y < out._height; y++)
+      memcpy(&out._bits[y * rowBytes], FreeImage_GetScanLine(bitmap, int(y)), rowBytes);
+
+    FreeImage_Unload(bitmap);
+    return true;
+  }
+
+  bool uploadTexture(const image& img, GLuint& id)
+  {
+    GLuint texInd = -1;
+    glGenTextures(1, &texInd);
+    glBindTexture(GL_TEXTURE_2D, texInd);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, img._alpha ? GL_RGBA8 : GL_RGB8, GLsizei(img._width), GLsizei(img._height),
+      0, GL_BGRA, GL_UNSIGNED_BYTE, img._bits.data());
+
+    id = texInd;
+    return true;
+  }
+
+  bool readFile(const char *path, std::string& out)
+  {
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream)
+    {
+      std::cerr << "unable to open " << path;
+      return false;
+    }
+
+    out.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+  }
+
+  bool saveImage(const std::string& fileName, size_t w, size_t h, const void *bgra)
+  {
+    FREE_IMAGE_FORMAT format = FreeImage_GetFIFFromFilename(fileName.c_str());
+    if (format == FIF_UNKNOWN)
+    {
+      std::cerr << "unknown image format " << fileName;
+      return false;
+    }
+
+    // GL rows are bottom-up like FreeImage's, so no flip
+    FIBITMAP* bitmap = FreeImage_ConvertFromRawBits((BYTE*)bgra, int(w), int(h), int(w * 4), 32,
+      FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+    if (!bitmap)
+    {
+      std::cerr << "unable to convert image " << fileName;
+      return false;
+    }
+
+    // formats without alpha (jpg) need 24 bits
+    FIBITMAP* out = FreeImage_FIFSupportsExportBPP(format, 32) ? bitmap : FreeImage_ConvertTo24Bits(bitmap);
+    bool saved = out && FreeImage_Save(format, out, fileName.c_str()) == TRUE;
+    if (!saved)
+      std::cerr << "unable to save image " << fileName;
+
+    if (out != bitmap)
+      FreeImage_Unload(out);
+    FreeImage_Unload(bitmap);
+    return saved;
+  }
+
+  MappedFile::MappedFile(const char *path)
+  {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+      return;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+      CloseHandle(file);
+      return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+      CloseHandle(file);
+      return;
+    }
+
+    _data    = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    _size    = _data ? size_t(fileSize.QuadPart) : 0;
+    _file    = file;
+    _mapping = mapping;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      close(fd);
+      return;
+    }
+
+    void *data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+      return;
+
+    _data = (const char*)data;
+    _size = size_t(st.st_size);
+#endif
+  }
+
+  MappedFile::~MappedFile()
+  {
+#ifdef _WIN32
+    if (_data)
+      UnmapViewOfFile(_data);
+    if (_mapping)
+      CloseHandle((HANDLE)_mapping);
+    if (_file)
+      CloseHandle((HANDLE)_file);
+#else
+    if (_data)
+      munmap((void*)_data, _size);
+#endif
+  }
+
+  size_t peakMemory()
+  {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+      return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0;
+    return size_t(usage.ru_maxrss) * 1024; // KB on Linux
+#endif
+  }
+
+  double cpuSeconds()
+  {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+      return 0.;
+    auto ticks = [](const FILETIME& t) {return (uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime;};
+    return (ticks(kernel) + ticks(user)) * 1e-7; // 100 ns units
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0.;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+  }
+
+  bool fileStamp(const char *path, uint64_t& size, uint64_t& time)
+  {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+      return false;
+    size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    time = (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+      return false;
+    size = uint64_t(st.st_size);
+#ifdef __APPLE__
+    const struct timespec& mtime = st.st_mtimespec;
+#else
+    const struct timespec& mtime = st.st_mtim;
+#endif
+    time = uint64_t(mtime.tv_sec) * 1000000000ull + uint64_t(mtime.tv_nsec); // st_mtime alone is whole seconds
+#endif
+    return true;
+  }
+
+  uint64_t hash64(const void *data, size_t size)
+  {
+    const uint64_t k0 = 0x9E3779B97F4A7C15ull, k1 = 0xC2B2AE3D27D4EB4Full;
+    auto rotl = [](uint64_t x, int r) {return (x << r) | (x >> (64 - r));};
+
+    // four independent lanes, so the multiplies overlap
+    uint64_t lanes[4] = {k0, k1, k0 ^ size, k1 ^ size};
+    const unsigned char *p = (const unsigned char*)data;
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+      for (int l = 0; l < 4; l++)
+      {
+        uint64_t w;
+        memcpy(&w, p + i + l * 8, sizeof(w));
+        lanes[l] = rotl(lanes[l] + w * k1, 31) * k0;
+      }
+
+    uint64_t h = size * k0;
+    for (int l = 0; l < 4; l++)
+      h = rotl(h ^ lanes[l], 27) * k1 + k0;
+
+    for (; i < size; i += 8)
+    {
+      uint64_t w = 0;
+      memcpy(&w, p + i, std::min<size_t>(8, size - i));
+      h = rotl(h ^ (w * k1), 31) * k0;
+    }
+
+    h ^= h >> 33;
+    h *= k1;
+    h ^= h >> 29;
+    return h;
+  }
+
+  void parallel_for(size_t jobs, const std::function<void(size_t)>& fn, size_t maxThreads)
+  {
+    if (maxThreads == 0)
+      maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t threads = std::min(jobs, maxThreads);
+    if (threads <= 1)
+    {
+      for (size_t job = 0; job < jobs; job++)
+        fn(job);
+      return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+      for (size_t job = next++; job < jobs; job = next++)
+        fn(job);
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++)
+      pool.emplace_back(worker);
+
+    worker();
+
+    for (auto& t : pool)
+      t.join();
+  }
+
+  namespace
+  {
+    const size_t obj_min_chunk = 256 * 1024; // smaller files are not worth splitting
+
+    struct obj_chunk
+    {
+      const char *_begin, *_end;
+
+      std::vector<float>        _vs, _uvs, _ns;
+      std::vector<unsigned int> _faces; // v/vt/vn triples, 9 per face
+      size_t _line = 0; // first bad line (1-based inside the chunk), 0 if none
+    };
+
+    inline bool isBlank(char c) {return c == ' ' || c == '\t' || c == '\r';}
+    inline bool isDigit(char c) {return c >= '0' && c <= '9';}
+
+    inline const char* skipBlanks(const char *p, const char *end)
+    {
+      while (p < end && isBlank(*p))
+        ++p;
+      return p;
+    }
+
+    inline const char* nextLine(const char *p, const char *end)
+    {
+      const char *eol = (const char*)memchr(p, '\n', end - p);
+      return eol ? eol + 1 : end;
+    }
+
+    const char* parseFloatSlow(const char *p, const char *end, float& out)
+    {
+      char buf[64];
+      size_t len = 0;
+      while (p + len < end && len < sizeof(buf) - 1 && !isBlank(p[len]) && p[len] != '\n')
+      {
+        buf[len] = p[len];
+        len++;
+      }
+      buf[len] = 0;
+
+      char *parsed = nullptr;
+      out = strtof(buf, &parsed);
+      return parsed == buf ? nullptr : p + (parsed - buf);
+    }
+
+    // plain decimals ("-0.049068") are converted exactly through double; everything else
+    // (exponents, long mantissas, halfway cases) goes through strtof, so results match scanf's "%f"
+    const char* parseFloat(const char *p, const char *end, float& out)
+    {
+      static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+      p = skipBlanks(p, end);
+      const char *start = p;
+
+      bool negative = false;
+      if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+      uint64_t mantissa = 0;
+      int digits = 0, fraction = 0;
+
+      for (; p < end && isDigit(*p); ++p, ++digits)
+        mantissa = mantissa * 10 + (*p - '0');
+
+      if (p < end && *p == '.')
+        for (++p; p < end && isDigit(*p); ++p, ++digits, ++fraction)
+          mantissa = mantissa * 10 + (*p - '0');
+
+      if (digits == 0 || digits > 15 || (p < end && !isBlank(*p) && *p != '\n'))
+        return parseFloatSlow(start, end, out);
+
+      const double d = double(mantissa) / pow10[fraction];
+      const float  f = float(d);
+
+      if (double(f) != d)
+      {
+        const float other = std::nextafter(f, double(f) < d ? FLT_MAX : -FLT_MAX);
+        if ((double(f) + double(other)) * 0.5 == d) // double rounding could go the wrong way
+          return parseFloatSlow(start, end, out);
+      }
+
+      out = negative ? -f : f;
+      return p;
+    }
+
+    inline const char* parseUInt(const char *p, const char *end, unsigned int& out)
+    {
+      if (p >= end || !isDigit(*p))
+        return nullptr;
+
+      unsigned int value = 0;
+      for (; p < end && isDigit(*p); ++p)
+        value = value * 10 + (*p - '0');
+
+      out = value;
+      return p;
+    }
+
+    const char* parseFaceVertex(const char *p, const char *end, unsigned int *ind)
+    {
+      p = skipBlanks(p, end);
+      for (int i = 0; i < 3 && p; i++)
+      {
+        if (i > 0)
+          p = (p < end && *p == '/') ? p + 1 : nullptr;
+        if (p)
+          p = parseUInt(p, end, ind[i]);
+      }
+      return p;
+    }
+
+    void parseChunk(obj_chunk& chunk)
+    {
+      const char *end = chunk._end;
+      size_t line = 0;
+
+      for (const char *p = chunk._begin; p < end; p = nextLine(p, end))
+      {
+        line++;
+        p = skipBlanks(p, end);
+
+        const char *q = p;
+        while (q < end && !isBlank(*q) && *q != '\n')
+          ++q;
+
+        const size_t tokenLen = q - p;
+        bool ok = true;
+
+        if (tokenLen == 1 && p[0] == 'v')
+        {
+          float v[3];
+          for (int i = 0; i < 3 && q; i++)
+            q = parseFloat(q, end, v[i]);
+
+          ok = q != nullptr;
+          if (ok)
+            chunk._vs.insert(chunk._vs.end(), v, v + 3);
+        }
+        else if (tokenLen == 2 && p[0] == 'v' && p[1] == 't')
+        {
+          float uv[2];
+          for (int i = 0; i < 2 && q; i++)
+            q = parseFloat(q, end, uv[i]);
+
+          ok = q != nullptr;
+          if (ok)
+            chunk._uvs.insert(chunk._uvs.end(), uv, uv + 2);
+        }
+        else if (tokenLen == 2 && p[0] == 'v' && p[1] == 'n')
+        {
+          float n[3];
+          for (int i = 0; i < 3 && q; i++)
+            q = parseFloat(q, end, n[i]);
+
+          ok = q != nullptr;
+          if (ok)
+            chunk._ns.insert(chunk._ns.end(), n, n + 3);
+        }
+        else if (tokenLen == 1 && p[0] == 'f')
+        {
+          unsigned int ind[9];
+          for (int i = 0; i < 3 && q; i++)
+            q = parseFaceVertex(q, end, ind + i * 3);
+
+          ok = q != nullptr;
+          if (ok)
+            chunk._faces.insert(chunk._faces.end(), ind, ind + 9);
+        }
+
+        if (!ok)
+        {
+          chunk._line = line;
+          return;
+        }
+      }
+    }
+
+    template<typename T>
+    void concat(std::vector<obj_chunk>& chunks, std::vector<T> obj_chunk::*member, std::vector<T>& out)
+    {
+      size_t total = 0;
+      for (auto& chunk : chunks)
+        total += (chunk.*member).size();
+
+      out.reserve(total);
+      for (auto& chunk : chunks)
+        out.insert(out.end(), (chunk.*member).begin(), (chunk.*member).end());
+    }
+
+    struct obj_raw
+    {
+      std::vector<obj_chunk> _chunks;
+      std::vector<float>     _vs, _uvs, _ns; // merged, faces use global indices
+
+      size_t vertexCount() const
+      {
+        size_t count = 0;
+        for (auto& chunk : _chunks)
+          count += chunk._faces.size() / 3;
+        return count;
+      }
+
+      bool validFaceVertex(const unsigned int *ind) const
+      {
+        return ind[0] > 0 && size_t(ind[0] - 1) * 3 < _vs .size() &&
+               ind[1] > 0 && size_t(ind[1] - 1) * 2 < _uvs.size() &&
+               ind[2] > 0 && size_t(ind[2] - 1) * 3 < _ns .size();
+      }
+    };
+
+    bool parseOBJ(const char *path, obj_raw& raw)
+    {
+      MappedFile file(path);
+      if (!file.valid())
+      {
+        std::cerr << "cannot open file " << path;
+        return false;
+      }
+
+      const char *begin = file.data();
+      const char *end   = begin + file.size();
+
+      // line-aligned chunks, parsed independently
+      const size_t jobs = std::max<size_t>(1, std::min<size_t>(file.size() / obj_min_chunk, std::thread::hardware_concurrency()));
+      std::vector<obj_chunk>& chunks = raw._chunks;
+      chunks.resize(jobs);
+
+      const char *chunkBegin = begin;
+      for (size_t i = 0; i < jobs; i++)
+      {
+        const char *chunkEnd = (i + 1 == jobs) ? end : begin + file.size() * (i + 1) / jobs;
+        if (chunkEnd < chunkBegin)
+          chunkEnd = chunkBegin;
+        else if (chunkEnd > begin && chunkEnd < end && chunkEnd[-1] != '\n')
+          chunkEnd = nextLine(chunkEnd, end);
+
+        chunks[i]._begin = chunkBegin;
+        chunks[i]._end   = chunkEnd;
+        chunkBegin = chunkEnd;
+      }
+
+      parallel_for(jobs, [&](size_t i) {parseChunk(chunks[i]);});
+
+      for (auto& chunk : chunks)
+        if (chunk._line > 0)
+        {
+          size_t line = std::count(begin, chunk._begin, '\n') + chunk._line;
+          std::cerr << "can't parse file " << path << ", line " << line;
+          return false;
+        }
+
+      concat(chunks, &obj_chunk::_vs,  raw._vs);
+      concat(chunks, &obj_chunk::_uvs, raw._uvs);
+      concat(chunks, &obj_chunk::_ns,  raw._ns);
+
+      for (auto& chunk : chunks) // pointers into the file are not valid anymore
+        chunk._begin = chunk._end = nullptr;
+
+      return true;
+    }
+
+    const unsigned int empty = ~0u;
+
+    // open addressing map from v/vt/vn triple to output vertex index
+    class vertex_hash
+    {
+    public:
+      explicit vertex_hash(size_t capacity)
+      {
+        size_t size = 16;
+        while (size < capacity * 2)
+          size <<= 1;
+
+        _mask = size - 1;
+        _keys  .resize(size * 3);
+        _values.assign(size, empty);
+      }
+
+      // returns existing index of the triple or stores newIndex for it
+      unsigned int insert(const unsigned int *key, unsigned int newIndex)
+      {
+        size_t slot = hash(key) & _mask;
+        while (_values[slot] != empty)
+        {
+          const unsigned int *k = &_keys[slot * 3];
+          if (k[0] == key[0] && k[1] == key[1] && k[2] == key[2])
+            return _values[slot];
+          slot = (slot + 1) & _mask;
+        }
+
+        memcpy(&_keys[slot * 3], key, sizeof(unsigned int) * 3);
+        _values[slot] = newIndex;
+        return newIndex;
+      }
+
+    private:
+      static size_t hash(const unsigned int *key)
+      {
+        uint64_t h = key[0] * 0x9E3779B97F4A7C15ull;
+        h ^= (h >> 29) + key[1] * 0xC2B2AE3D27D4EB4Full;
+        h ^= (h >> 31) + key[2] * 0x165667B19E3779F9ull;
+        return size_t(h ^ (h >> 32));
+      }
+
+      size_t                    _mask;
+      std::vector<unsigned int> _keys;
+      std::vector<unsigned int> _values;
+    };
+  }
+
+  size_t loadOBJ(const char * path,
+               std::vector<float>& out_vertices,
+               std::vector<float>& out_uvs,
+               std::vector<float>& out_normals
+               )
+  {
+    obj_raw raw;
+    if (!parseOBJ(path, raw))
+      return 0;
+
+    const std::vector<obj_chunk>& chunks = raw._chunks;
+    const size_t jobs = chunks.size();
+
+    std::vector<size_t> firstVertex(jobs + 1, 0);
+    for (size_t i = 0; i < jobs; i++)
+      firstVertex[i + 1] = firstVertex[i] + chunks[i]._faces.size() / 3;
+
+    const size_t count = firstVertex[jobs];
+    const size_t vBase = out_vertices.size(), tBase = out_uvs.size(), nBase = out_normals.size();
+    out_vertices.resize(vBase + count * 3);
+    out_uvs     .resize(tBase + count * 2);
+    out_normals .resize(nBase + count * 3);
+
+    std::atomic<bool> valid(true);
+    parallel_for(jobs, [&](size_t i)
+    {
+      const std::vector<unsigned int>& faces = chunks[i]._faces;
+      float *outV = &out_vertices[0] + vBase + firstVertex[i] * 3;
+      float *outT = &out_uvs     [0] + tBase + firstVertex[i] * 2;
+      float *outN = &out_normals [0] + nBase + firstVertex[i] * 3;
+
+      for (size_t f = 0; f < faces.size(); f += 3)
+      {
+        if (!raw.validFaceVertex(&faces[f]))
+        {
+          valid = false;
+          return;
+        }
+
+        memcpy(outV, &raw._vs [(faces[f]     - 1) * 3], sizeof(float) * 3);
+        memcpy(outT, &raw._uvs[(faces[f + 1] - 1) * 2], sizeof(float) * 2);
+        memcpy(outN, &raw._ns [(faces[f + 2] - 1) * 3], sizeof(float) * 3);
+        outV += 3;
+        outT += 2;
+        outN += 3;
+      }
+    });
+
+    if (!valid)
+    {
+      std::cerr << "face index out of range in file " << path;
+      out_vertices.resize(vBase);
+      out_uvs     .resize(tBase);
+      out_normals .resize(nBase);
+      return 0;
+    }
+
+    return count;
+  }
+
+  size_t loadOBJ(const char * path,
+               std::vector<float>& out_vertices,
+               std::vector<float>& out_uvs,
+               std::vector<float>& out_normals,
+               std::vector<unsigned int>& out_indices
+               )
+  {
+    obj_raw raw;
+    if (!parseOBJ(path, raw))
+      return 0;
+
+    const size_t count = raw.vertexCount();
+    const size_t vBase = out_vertices.size(), tBase = out_uvs.size(), nBase = out_normals.size(), iBase = out_indices.size();
+    const unsigned int firstIndex = (unsigned int)(vBase / 3);
+
+    out_indices.reserve(iBase + count);
+
+    // vertices are emitted in order of first use, so the output stays deterministic
+    vertex_hash unique(count);
+    unsigned int next = firstIndex;
+
+    for (auto& chunk : raw._chunks)
+      for (size_t f = 0; f < chunk._faces.size(); f += 3)
+      {
+        const unsigned int *ind = &chunk._faces[f];
+        if (!raw.validFaceVertex(ind))
+        {
+          std::cerr << "face index out of range in file " << path;
+          out_vertices.resize(vBase);
+          out_uvs     .resize(tBase);
+          out_normals .resize(nBase);
+          out_indices .resize(iBase);
+          return 0;
+        }
+
+        const unsigned int index = unique.insert(ind, next);
+        if (index == next)
+        {
+          out_vertices.insert(out_vertices.end(), &raw._vs [(ind[0] - 1) * 3], &raw._vs [(ind[0] - 1) * 3] + 3);
+          out_uvs     .insert(out_uvs     .end(), &raw._uvs[(ind[1] - 1) * 2], &raw._uvs[(ind[1] - 1) * 2] + 2);
+          out_normals .insert(out_normals .end(), &raw._ns [(ind[2] - 1) * 3], &raw._ns [(ind[2] - 1) * 3] + 3);
+          next++;
+        }
+        out_indices.push_back(index);
+      }
+
+    return count;
+  }
+
+  size_t loadOBJ_scanf(const char * path,
+               std::vector<float>& out_vertices, 
+               std::vector<float>& out_uvs,
+               std::vector<float>& out_normals
+               )
+  {
+    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+    std::vector<glm::vec3> temp_vertices; 
+    std::vector<glm::vec2> temp_uvs;
+    std::vector<glm::vec3> temp_normals;
+  
+    FILE* file = nullptr;
+    fopen_s(&file, path, "r");
+
+    if( file == NULL ){
+      std::cerr << "cannot open file " << path;
+      return 0;
+    }
+    while( 1 ){
+
+      char lineHeader[128];
+      int res = fscanf_s(file, "%s", lineHeader, 128);
+      if (res == EOF)
+        break;
+      if ( strcmp( lineHeader, "v" ) == 0 ){
+        glm::vec3 vertex;
+        fscanf_s(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
+        temp_vertices.push_back(vertex);
+      }else if ( strcmp( lineHeader, "vt" ) == 0 ){
+        glm::vec2 uv;
+        fscanf_s(file, "%f %f\n", &uv.x, &uv.y );
+        temp_uvs.push_back(uv);
+      }else if ( strcmp( lineHeader, "vn" ) == 0 ){
+        glm::vec3 normal;
+        fscanf_s(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
+        temp_normals.push_back(normal);
+      }else if ( strcmp( lineHeader, "f" ) == 0 ){
+        unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+        int matches = fscanf_s(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
+        if (matches != 9){
+          std::cerr << "can't parse file " << path;
+          return 0;
+        }
+        vertexIndices.push_back(vertexIndex[0]);
+        vertexIndices.push_back(vertexIndex[1]);
+        vertexIndices.push_back(vertexIndex[2]);
+      
+        uvIndices    .push_back(uvIndex[0]);
+        uvIndices    .push_back(uvIndex[1]);
+        uvIndices    .push_back(uvIndex[2]);
+
+        normalIndices.push_back(normalIndex[0]);
+        normalIndices.push_back(normalIndex[1]);
+        normalIndices.push_back(normalIndex[2]);
+      }else{
+        char stupidBuffer[1000];
+        fgets(stupidBuffer, 1000, file);
+      }
+    }
+
+    for(size_t i = 0; i < vertexIndices.size(); i++)
+    {
+      size_t vertexIndex = vertexIndices[i];
+      size_t uvIndex = uvIndices[i];
+      size_t normalIndex = normalIndices[i];
+
+      glm::vec3 vertex = temp_vertices[vertexIndex - 1];
+      glm::vec2 uv = temp_uvs[uvIndex - 1];
+      glm::vec3 normal = temp_normals[normalIndex - 1];
+
+      out_vertices.push_back(vertex[0]);
+      out_vertices.push_back(vertex[1]);
+      out_vertices.push_back(vertex[2]);
+      out_uvs     .push_back(uv[0]);
+      out_uvs     .push_back(uv[1]);
+      out_normals .push_back(normal[0]);
+      out_normals .push_back(normal[1]);
+      out_normals .push_back(normal[2]);
+    }
+    return vertexIndices.size();
+  }
 }
\ No newline at end of file
@@ -1,28 +1,99 @@
-#ifndef UTILS_H
-#define UTILS_H
-
-#include <GL/glew.h>
-#include <glm/glm.hpp>
-#include <vector>
-#include <time.h>
-
-// 3rdparty code
-
-namespace utils
-{
-  float dt(clock_t first, clock_t second);
-
-  glm::vec3 xyz(const glm::vec4& v);
-
-  bool loadTexture(const std::string& texName, GLuint &id);
-
-  size_t loadOBJ(const char *path,
-    std::vector<float>& out_vertices,
-    std::vector<float>& out_uvs,
-    std::vector<float>& out_normals
-    );
-
-  bool loadShaders(const char *vertex_file_path, const char *fragment_file_path, GLuint& id);
-}
-
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <chrono>
+
+// 3rdparty code
+
+namespace utils
+{
+  float dt(std::chrono::steady_clock::time_point first, std::chrono::steady_clock::time_point second); // seconds, wall time
+
+  glm::vec3 xyz(const glm::vec4& v);
+
+  bool loadTexture(const std::string& texName, GLuint &id); // decodeImage + uploadTexture
+
+  // decoded image, 8-bit BGRA (alpha 255 if the file has none), bottom row first, no row padding
+  struct image
+  {
+    size_t _width  = 0;
+    size_t _height = 0;
+    bool   _alpha  = false;
+    std::vector<unsigned char> _bits;
+  };
+
+  bool decodeImage(const std::string& fileName, image& out); // no GL, safe on worker threads
+  bool uploadTexture(const image& img, GLuint &id);
+
+  bool readFile(const char *path, std::string& out);
+
+  // w x h 8-bit BGRA pixels, bottom row first (as glReadPixels returns them); format from the extension
+  bool saveImage(const std::string& fileName, size_t w, size_t h, const void *bgra);
+
+  // read-only view of a whole file, mapped into memory (no copy)
+  class MappedFile
+  {
+  public:
+    explicit MappedFile(const char *path);
+    ~MappedFile();
+
+    bool        valid() const {return _data != nullptr;}
+    const char* data()  const {return _data;}
+    size_t      size()  const {return _size;}
+
+  private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char *_data = nullptr;
+    size_t      _size = 0;
+    void       *_file    = nullptr; // platform handles
+    void       *_mapping = nullptr;
+  };
+
+  // peak resident memory of this process so far, bytes (0 if unknown)
+  size_t peakMemory();
+
+  // CPU time used by this process so far, user + kernel on all threads, seconds
+  double cpuSeconds();
+
+  // fast non-cryptographic hash, for detecting changed files
+  uint64_t hash64(const void *data, size_t size);
+
+  // size and last write time (100 ns on Windows, ns elsewhere; only compared for equality) without opening the file; false if missing
+  bool fileStamp(const char *path, uint64_t& size, uint64_t& time);
+
+  // runs fn(job) for job in [0, jobs) on up to `threads` threads (0: hardware_concurrency);
+  // idle threads take the next unclaimed job, so uneven jobs balance out
+  void parallel_for(size_t jobs, const std::function<void(size_t)>& fn, size_t threads = 0);
+
+  size_t loadOBJ(const char *path,
+    std::vector<float>& out_vertices,
+    std::vector<float>& out_uvs,
+    std::vector<float>& out_normals
+    );
+
+  // indexed variant: unique v/vt/vn combinations only, out_indices refers to them;
+  // returns the number of indices
+  size_t loadOBJ(const char *path,
+    std::vector<float>& out_vertices,
+    std::vector<float>& out_uvs,
+    std::vector<float>& out_normals,
+    std::vector<unsigned int>& out_indices
+    );
+
+  // old fscanf-based loader, kept as a reference for benchmarks
+  size_t loadOBJ_scanf(const char *path,
+    std::vector<float>& out_vertices,
+    std::vector<float>& out_uvs,
+    std::vector<float>& out_normals
+    );
+}
+
 #endif
\ No newline at end of file